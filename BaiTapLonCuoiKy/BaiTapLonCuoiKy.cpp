@@ -1,4 +1,13 @@
 #include "appointment_structures.h"
+#include "reminder_scheduler.h"
+#include "write_ahead_log.h"
+#include "snapshot.h"
+#include "bulk_import.h"
+#include "date_codec.h"
+#include "command_batch.h"
+#include "concurrent_hashmap.h"
+#include "persistent_avl.h"
+#include "request_server.h"
 #include <iostream>
 #include <ctime>
 #include <limits>
@@ -6,12 +15,31 @@
 #include <iomanip>
 #include <cctype>
 #include <algorithm>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <random>
+#include <csignal>
+#ifdef _WIN32
+#ifndef NOMINMAX
 #define NOMINMAX
+#endif
 #include <windows.h>
-#define VIETNAM_TZ_OFFSET 7 * 3600
+#endif
 
 using namespace std;
 
+// Biên dịch với -DTIME_INDEX_BPLUS_TREE để dùng B+-tree thay cho cây AVL làm chỉ mục thời gian
+#ifdef TIME_INDEX_BPLUS_TREE
+typedef BPlusTree<> TimeIndex;
+#else
+typedef AVLTree<> TimeIndex;
+#endif
+
 string trim(const string& str) {
     size_t first = str.find_first_not_of(" \t\r\n");
     size_t last = str.find_last_not_of(" \t\r\n");
@@ -19,373 +47,2749 @@ string trim(const string& str) {
     return str.substr(first, last - first + 1);
 }
 
-string toVietnamTime(time_t utc_time) {
-    if (utc_time == 0) return "Chưa đặt thời gian";
+string toVietnamTime(time_t utc_time) {
+    if (utc_time == 0) return "Chưa đặt thời gian";
+
+    char buffer[DATE_TEXT_MAX];
+    return string(buffer, EncodeDateTime(utc_time, buffer));
+}
+
+time_t parseDateTime(const string& datetime) {
+    time_t result = 0;
+    const char* error = DecodeDateTime(datetime.data(), datetime.data() + datetime.size(), result);
+    if (error) {
+        throw runtime_error(error);
+    }
+    return result;
+}
+
+time_t getCurrentTime() {
+    return time(nullptr);
+}
+
+// ID còn phải ghi được vào nhật ký nên không dài quá LOG_MAX_STRING
+bool isAlphanumeric(const string& str) {
+    if (str.empty() || str.size() > LOG_MAX_STRING) return false;
+    for (char c : str) {
+        if (!isalnum(c)) return false;
+    }
+    return true;
+}
+
+#define COMPACT_STEPS_PER_COMMAND 64
+
+struct IndexStats {
+    const char* name;
+    size_t live;
+    size_t dead;
+    IndexStats(const char* n, size_t l, size_t d) : name(n), live(l), dead(d) {}
+
+    double DeadRatio() const {
+        return live + dead ? (double)dead / (live + dead) : 0.0;
+    }
+};
+
+// Mã lỗi của thao tác, in kèm mỗi lệnh trong chế độ chạy lô để script xử lý mà không phải đọc thông báo
+enum class MaLoi : int {
+    ThanhCong = 0,
+    CuPhap = 1, // lệnh không tồn tại hoặc sai số tham số
+    KhongHopLe = 2, // ID, thời gian, trạng thái, thời lượng không hợp lệ
+    KhongTimThay = 3,
+    TrungLap = 4,
+    XungDot = 5, // bác sĩ không trống
+    KhongCoQuyen = 6,
+    TrangThai = 7, // lịch hẹn đã bị từ chối trước đó
+    HeThong = 8 // lỗi ghi nhật ký và các lỗi khác
+};
+
+inline const char* KyHieuMaLoi(MaLoi code) {
+    switch (code) {
+    case MaLoi::ThanhCong: return "OK";
+    case MaLoi::CuPhap: return "CU_PHAP";
+    case MaLoi::KhongHopLe: return "KHONG_HOP_LE";
+    case MaLoi::KhongTimThay: return "KHONG_TIM_THAY";
+    case MaLoi::TrungLap: return "TRUNG_LAP";
+    case MaLoi::XungDot: return "XUNG_DOT";
+    case MaLoi::KhongCoQuyen: return "KHONG_CO_QUYEN";
+    case MaLoi::TrangThai: return "TRANG_THAI";
+    default: return "HE_THONG";
+    }
+}
+
+// Lỗi nghiệp vụ có mã; vẫn là runtime_error nên các chỗ bắt lỗi cũ không phải đổi
+class LoiLichHen : public runtime_error {
+public:
+    MaLoi code;
+    LoiLichHen(MaLoi c, const string& message) : runtime_error(message), code(c) {}
+};
+
+class AppointmentSystem {
+private:
+    IdTable appointment_ids; // Chuỗi ID chỉ được tra một lần tại đây, bên trong dùng số nguyên
+    IdTable patient_ids;
+    IdTable doctor_ids;
+    AppointmentSlab records; // Bản ghi lịch hẹn, các chỉ mục bên dưới chỉ giữ handle
+    Hashmap<AppointmentHandle, uint32_t> appointments;
+    typedef Hashmap<unique_ptr<TimeIndex>, uint32_t> IndexMap;
+    IndexMap doctor_schedules; // Lịch hẹn còn hiệu lực của từng bác sĩ, sắp theo thời gian
+    IndexMap patient_schedules; // Tương tự cho từng bệnh nhân
+    TimeIndex schedule;
+    PriorityQueue reminders;
+    ReminderScheduler* scheduler; // Bộ nhắc nhở chạy nền, có thể không gắn
+    uint64_t reminder_tag; // OR với ID lịch hẹn thành khóa nhắc nhở, để nhiều hệ thống dùng chung scheduler
+    int default_duration; // phút
+    OccupancyMap occupancy; // Ô 30 phút đã có lịch của từng bác sĩ theo ngày
+    vector<AppointmentHandle> tombstones; // Lịch hẹn bị từ chối chờ thu hồi
+    size_t dead_records; // Bản ghi còn cấp phát nhưng không còn hiệu lực
+    WriteAheadLog* wal; // Nhật ký ghi trước, có thể không gắn
+    bool replaying; // Đang khôi phục từ nhật ký: không ghi lại, không in thông báo
+    ostream* out; // Nơi in thông báo của thao tác ghi; không xả sau mỗi dòng, menu dựa vào cin gắn với cout
+
+    AppointmentHandle* TimTheoID(const string& aid) {
+        const uint32_t* id = appointment_ids.Find(aid);
+        return id ? appointments.Find(*id) : nullptr;
+    }
+
+    NhacNho TaoNhacNho(const Appointment* app) const {
+        NhacNho reminder;
+        reminder.appointment_id = IDLichHen(app->appointment_id);
+        reminder.patient_id = IDBenhNhan(app->patient_id);
+        reminder.doctor_id = IDBacSi(app->doctor_id);
+        reminder.status = TenTrangThai(app->status);
+        reminder.time = app->time;
+        reminder.lead_minutes = 0;
+        return reminder;
+    }
+
+    // Đăng ký lại bộ hẹn giờ nhắc nhở theo thông tin hiện tại của lịch hẹn
+    void DangKyNhacNho(const Appointment* app) {
+        if (!scheduler) return;
+        scheduler->DatLich(reminder_tag | app->appointment_id, app->time + VIETNAM_TZ_OFFSET, TaoNhacNho(app));
+    }
+
+    void HuyNhacNho(uint32_t aid) {
+        if (scheduler) scheduler->Huy(reminder_tag | aid);
+    }
+
+    // Ghi thao tác vào nhật ký, trả về khi đã bền vững theo chế độ đồng bộ. Gọi sau mọi kiểm tra và
+    // trước khi sửa bộ nhớ (ThemLichHen thì hoàn tác được khi lỗi), để lỗi ghi hay fsync không để lại
+    // thay đổi mà nhật ký không có.
+    void GhiNhatKy(const LogRecord& record) {
+        if (wal && !replaying) wal->Append(record);
+    }
+
+    // Chuỗi quá dài làm GhiNhatKy ném lỗi; kiểm tra trước để thao tác bị từ chối khi chưa sửa gì
+    static void KiemTraBanGhi(const LogRecord& record) {
+        for (const string* id : { &record.appointment_id, &record.patient_id, &record.doctor_id, &record.user_id }) {
+            if (id->size() > LOG_MAX_STRING) throw LoiLichHen(MaLoi::KhongHopLe, "ID quá dài (tối đa 65535 ký tự)");
+        }
+    }
+
+    void ThongBao(const string& message) {
+        if (!replaying) *out << message << '\n';
+    }
+
+    // Giải phóng hẳn một lịch hẹn bị từ chối; ID đã thu hồi được thêm vào reclaimed nếu có
+    void ThuHoi(AppointmentHandle handle, vector<string>* reclaimed) {
+        const Appointment* app = records.Get(handle);
+        if (!app || app->is_valid) return; // Đã bị xóa hoặc được đặt lại
+        uint32_t aid = app->appointment_id;
+        LogRecord record;
+        record.op = LogOp::ThuHoiLichHen;
+        record.appointment_id = IDLichHen(aid);
+        GhiNhatKy(record);
+        if (reclaimed) reclaimed->push_back(record.appointment_id);
+        appointments.Remove(aid);
+        appointment_ids.Release(aid);
+        records.Free(handle);
+        dead_records--;
+    }
+
+    TimeIndex* TimChiMuc(IndexMap& indexes, uint32_t id) {
+        unique_ptr<TimeIndex>* index = indexes.Find(id);
+        return index ? index->get() : nullptr;
+    }
+
+    TimeIndex& LayChiMuc(IndexMap& indexes, uint32_t id) {
+        TimeIndex* index = TimChiMuc(indexes, id);
+        if (index) return *index;
+        indexes.Insert(id, unique_ptr<TimeIndex>(new TimeIndex(records)));
+        return *TimChiMuc(indexes, id);
+    }
+
+    // Chia các lịch hẹn đã sắp theo thời gian thành từng nhóm theo trường field (sắp xếp đếm, giữ
+    // nguyên thứ tự trong nhóm) rồi dựng hàng loạt chỉ mục của từng nhóm
+    void DungChiMucPhu(IndexMap& indexes, const vector<AppointmentHandle>& sorted, size_t id_count,
+        uint32_t Appointment::* field) {
+        vector<uint32_t> starts(id_count + 1, 0);
+        for (AppointmentHandle handle : sorted) starts[records.Get(handle)->*field + 1]++;
+        for (size_t id = 0; id < id_count; id++) starts[id + 1] += starts[id];
+        vector<uint32_t> next(starts.begin(), starts.end() - 1);
+        vector<AppointmentHandle> grouped(sorted.size());
+        for (AppointmentHandle handle : sorted) grouped[next[records.Get(handle)->*field]++] = handle;
+        vector<uint32_t> ids;
+        vector<unique_ptr<TimeIndex>> built;
+        for (uint32_t id = 0; id < id_count; id++) {
+            if (starts[id] == starts[id + 1]) continue;
+            ids.push_back(id);
+            built.emplace_back(new TimeIndex(records));
+            built.back()->BuildSorted(grouped.data() + starts[id], (int)(starts[id + 1] - starts[id]));
+        }
+        indexes.InsertBulk(ids.size(), [&](size_t i) { return ids[i]; }, [&](size_t i) { return move(built[i]); });
+    }
+
+    // Dựng hàng loạt mọi chỉ mục còn lại từ các lịch hẹn còn hiệu lực đã sắp theo (time, appointment_id);
+    // bảng appointments do nơi gọi dựng vì có thể gồm cả lịch hẹn đã bị từ chối
+    void DungChiMuc(const vector<AppointmentHandle>& live) {
+        schedule.BuildSorted(live.data(), (int)live.size());
+        DungChiMucPhu(doctor_schedules, live, doctor_ids.Size(), &Appointment::doctor_id);
+        DungChiMucPhu(patient_schedules, live, patient_ids.Size(), &Appointment::patient_id);
+        for (AppointmentHandle handle : live) {
+            const Appointment* app = records.Get(handle);
+            occupancy.Mark(app->doctor_id, app->time, app->EndTime());
+        }
+        // Heap nhắc nhở và bộ hẹn giờ chỉ cần các lịch hẹn chưa qua
+        time_t now = getCurrentTime() - VIETNAM_TZ_OFFSET;
+        size_t first = partition_point(live.begin(), live.end(), [&](AppointmentHandle handle) {
+            return records.Get(handle)->time <= now;
+        }) - live.begin();
+        reminders.BuildSorted(live.data() + first, (int)(live.size() - first));
+        if (scheduler) {
+            vector<LichNhac> batch(live.size() - first);
+            for (size_t i = first; i < live.size(); i++) {
+                const Appointment* app = records.Get(live[i]);
+                LichNhac& item = batch[i - first];
+                item.key = reminder_tag | app->appointment_id;
+                item.utc_time = app->time + VIETNAM_TZ_OFFSET;
+                item.reminder = TaoNhacNho(app);
+            }
+            scheduler->DatLichHangLoat(move(batch));
+        }
+    }
+
+    // Chỉ mục phụ (theo bác sĩ, theo bệnh nhân, bitmap chiếm chỗ) chỉ chứa lịch hẹn còn hiệu lực
+    void ThemVaoChiMucPhu(AppointmentHandle handle) {
+        const Appointment* app = records.Get(handle);
+        LayChiMuc(doctor_schedules, app->doctor_id).Insert(handle);
+        LayChiMuc(patient_schedules, app->patient_id).Insert(handle);
+        occupancy.Mark(app->doctor_id, app->time, app->EndTime());
+    }
+
+    // Gọi trước khi đổi time/doctor_id của lịch hẹn. Chỉ mục rỗng bị hủy ngay nên không có bia mộ.
+    void BoKhoiChiMucPhu(const Appointment* app) {
+        TimeIndex* patient_index = TimChiMuc(patient_schedules, app->patient_id);
+        if (patient_index) {
+            patient_index->Remove(app->time, app->appointment_id);
+            if (patient_index->Size() == 0) patient_schedules.Remove(app->patient_id);
+        }
+        TimeIndex* doctor_index = TimChiMuc(doctor_schedules, app->doctor_id);
+        if (!doctor_index) return;
+        doctor_index->Remove(app->time, app->appointment_id);
+        occupancy.Unmark(app->doctor_id, app->time, app->EndTime(), *doctor_index, records);
+        if (doctor_index->Size() == 0) doctor_schedules.Remove(app->doctor_id);
+    }
+
+    // Gỡ lịch hẹn khỏi mọi chỉ mục rồi giải phóng bản ghi
+    void GoLichHen(AppointmentHandle handle) {
+        Appointment* app = records.Get(handle);
+        uint32_t aid = app->appointment_id;
+        if (!app->is_valid) dead_records--;
+        app->is_valid = false;
+        schedule.Remove(app->time, aid);
+        BoKhoiChiMucPhu(app);
+        reminders.Remove(handle);
+        HuyNhacNho(aid);
+        appointments.Remove(aid);
+        appointment_ids.Release(aid);
+        records.Free(handle); // Các handle còn sót trong chỉ mục khác sẽ tự vô hiệu
+    }
+
+    // Phần chung của LichHenCuaBacSi và DuyetLichHenCuaBacSi, visit nhận handle
+    template <typename TVisitor>
+    size_t DuyetTrangBacSi(const string& did, time_t from, int offset, int limit, TVisitor visit) {
+        const uint32_t* id = doctor_ids.Find(did);
+        TimeIndex* index = id ? TimChiMuc(doctor_schedules, *id) : nullptr;
+        if (!index || offset < 0 || limit == 0) return 0;
+        int first = index->Rank(from) + offset;
+        const Appointment* app = records.Get(index->Select(first));
+        if (!app) return 0;
+        // Các lịch hẹn cùng thời điểm đứng trước vị trí first được bỏ qua khi duyệt
+        int skip = first - index->Rank(app->time);
+        size_t count = 0;
+        for (AppointmentHandle handle : index->Range(app->time, numeric_limits<time_t>::max())) {
+            if (skip > 0) {
+                skip--;
+                continue;
+            }
+            if (!records.Get(handle)) continue;
+            visit(handle);
+            if (++count == (size_t)limit) break;
+        }
+        return count;
+    }
+
+    // Phần chung của ThemLichHen và NhanLichHen: ghi logged vào nhật ký thay cho thao tác thêm nếu có
+    void ThemVaGhi(const string& aid_str, const string& pid_str, const string& did_str, time_t time, const string& status,
+        int duration_minutes, const LogRecord* logged) {
+        int duration = duration_minutes ? duration_minutes : default_duration;
+        if (duration < 1 || duration > UINT16_MAX) throw LoiLichHen(MaLoi::KhongHopLe, "Thời lượng lịch hẹn không hợp lệ");
+        const uint32_t* known_doctor = doctor_ids.Find(did_str);
+        if (known_doctor && !KiemTraThoiGianTrong(*known_doctor, time, duration)) {
+            throw LoiLichHen(MaLoi::XungDot, "Bác sĩ không trống tại thời gian này");
+        }
+        if (TimTheoID(aid_str)) {
+            throw LoiLichHen(MaLoi::TrungLap, "ID lịch hẹn trùng lặp: " + aid_str);
+        }
+        TrangThai trang_thai = DocTrangThai(status);
+        LogRecord record;
+        record.op = LogOp::ThemLichHen;
+        record.appointment_id = aid_str;
+        record.patient_id = pid_str;
+        record.doctor_id = did_str;
+        record.time = time;
+        record.status = (uint8_t)trang_thai;
+        record.duration = (uint16_t)duration;
+        KiemTraBanGhi(record);
+        if (logged) KiemTraBanGhi(*logged);
+        bool new_patient = !patient_ids.Find(pid_str);
+        bool new_doctor = !known_doctor;
+        uint32_t aid = appointment_ids.Intern(aid_str);
+        uint32_t pid = patient_ids.Intern(pid_str);
+        uint32_t did = doctor_ids.Intern(did_str);
+        AppointmentHandle handle = records.Allocate(Appointment(aid, pid, did, time, trang_thai, (uint16_t)duration));
+        try {
+            appointments.Insert(aid, handle);
+            ThemVaoChiMucPhu(handle);
+            schedule.Insert(handle);
+            reminders.Push(handle);
+            DangKyNhacNho(records.Get(handle));
+            GhiNhatKy(logged ? *logged : record);
+        }
+        catch (...) {
+            // GoLichHen bỏ qua các chỉ mục chưa kịp thêm, giải phóng bản ghi và trả lại ID lịch hẹn
+            GoLichHen(handle);
+            if (new_patient) patient_ids.Release(pid);
+            if (new_doctor) doctor_ids.Release(did);
+            throw;
+        }
+    }
+
+public:
+    AppointmentSystem() : schedule(records), reminders(records), scheduler(nullptr), reminder_tag(0),
+        default_duration(DEFAULT_APPOINTMENT_MINUTES), occupancy(parseDateTime("01-01-2000 00:00")),
+        dead_records(0), wal(nullptr), replaying(false), out(&cout) {}
+    ~AppointmentSystem() {}
+
+    void DatDauRa(ostream& stream) {
+        out = &stream;
+    }
+
+    void GanBoNhacNho(ReminderScheduler* reminder_scheduler, uint64_t tag = 0) {
+        scheduler = reminder_scheduler;
+        reminder_tag = tag;
+    }
+
+    // Áp dụng lại nhật ký từ thao tác from_lsn (LSN của ảnh chụp đã nạp, 0 nếu không có) rồi ghi tiếp
+    // các thao tác mới vào đó. Thao tác lỗi khi áp dụng lại (chỉ có thể do nhật ký bị sửa tay)
+    // được bỏ qua và đếm vào failed.
+    size_t GanNhatKy(WriteAheadLog* log, uint64_t from_lsn = 0, size_t* failed = nullptr) {
+        size_t errors = 0;
+        size_t applied = 0;
+        replaying = true;
+        try {
+            applied = log->Replay(from_lsn, [&](const LogRecord& record) {
+                try {
+                    ApDung(record);
+                }
+                catch (const exception&) {
+                    errors++;
+                }
+            });
+        }
+        catch (...) {
+            replaying = false;
+            throw;
+        }
+        replaying = false;
+        wal = log;
+        if (failed) *failed = errors;
+        return applied;
+    }
+
+    // Gắn (hoặc gỡ, với nullptr) nhật ký mà không áp dụng lại; dùng khi nhật ký được nhiều hệ thống
+    // chung nhau và nơi gọi đã tự khôi phục
+    void DatNhatKy(WriteAheadLog* log) {
+        wal = log;
+    }
+
+    // Dựng toàn bộ trạng thái từ ảnh chụp; chỉ gọi khi hệ thống còn rỗng, trước GanNhatKy. Bản ghi
+    // trong ảnh đã sắp theo thời gian nên các chỉ mục thời gian và heap nhắc nhở được dựng hàng loạt
+    // trong O(n) thay vì n lần Insert. Trả về số lịch hẹn đã nạp.
+    size_t NapAnhChup(const SnapshotFile& snapshot) {
+        if (appointments.Size()) throw runtime_error("Chỉ nạp ảnh chụp khi hệ thống chưa có dữ liệu");
+        size_t count = snapshot.RecordCount();
+        // Chỉ số trong ảnh chụp chính là ID nội bộ
+        vector<string> names[3];
+        for (int table = 0; table < 3; table++) names[table].reserve(snapshot.NameCount((SnapshotFile::NameTable)table));
+        snapshot.ForEachName([&](SnapshotFile::NameTable table, const string& name) { names[table].push_back(name); });
+        appointment_ids.Load(move(names[SnapshotFile::kLichHen]));
+        patient_ids.Load(move(names[SnapshotFile::kBenhNhan]));
+        doctor_ids.Load(move(names[SnapshotFile::kBacSi]));
+
+        records.Reserve(count);
+        vector<AppointmentHandle> handles(count);
+        vector<AppointmentHandle> live;
+        live.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            const SnapshotRecord& item = snapshot.Record(i);
+            Appointment app(item.appointment_id, item.patient_id, item.doctor_id, (time_t)item.time,
+                (TrangThai)item.status, item.duration);
+            app.is_valid = item.is_valid;
+            AppointmentHandle handle = records.Allocate(app);
+            handles[i] = handle;
+            if (item.is_valid) {
+                live.push_back(handle);
+            }
+            else {
+                tombstones.push_back(handle);
+                dead_records++;
+            }
+        }
+        appointments.InsertBulk(count, [](size_t i) { return (uint32_t)i; }, [&](size_t i) { return handles[i]; });
+        DungChiMuc(live);
+        return count;
+    }
+
+    // Dòng nhập đã chuyển đổi, viết lại theo thứ tự cột mặc định để ghi vào báo cáo
+    static string MoTaDong(const ImportRow& row) {
+        return row.appointment_id + "," + row.patient_id + "," + row.doctor_id + "," + toVietnamTime(row.time) + ","
+            + TenTrangThai(row.status) + "," + to_string(row.duration);
+    }
+
+    // Nhập các dòng đã đọc vào hệ thống còn rỗng. Dòng trùng ID lịch hẹn với một dòng trước đó bị loại;
+    // sau đó các dòng được sắp theo (bác sĩ, thời gian) và một lượt quét loại những lịch hẹn chồng lên
+    // lịch hẹn đã giữ của cùng bác sĩ (giữ lịch bắt đầu sớm hơn, cùng giờ thì giữ dòng đứng trước).
+    // Các dòng bị loại được thêm vào input.rejects; trả về số lịch hẹn đã nhập.
+    size_t NhapHangLoat(ImportResult& input) {
+        if (appointments.Size() || appointment_ids.Size()) {
+            throw runtime_error("Chỉ nhập hàng loạt khi hệ thống chưa có dữ liệu");
+        }
+        vector<ImportRow>& rows = input.rows;
+        // Chép các khóa sắp xếp ra mảng gọn để hai lần sắp không phải nhảy vào từng dòng
+        struct Candidate {
+            time_t time;
+            uint32_t row;
+            uint32_t aid;
+            uint32_t pid;
+            uint32_t did;
+            uint16_t duration;
+            TrangThai status;
+
+            time_t EndTime() const {
+                return time + (time_t)duration * 60;
+            }
+        };
+        vector<Candidate> candidates;
+        candidates.reserve(rows.size());
+        appointment_ids.Reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            size_t known = appointment_ids.Size();
+            uint32_t aid = appointment_ids.Intern(rows[i].appointment_id);
+            if (appointment_ids.Size() == known) {
+                input.rejects.emplace_back(rows[i].line, "ID lịch hẹn trùng lặp: " + rows[i].appointment_id, MoTaDong(rows[i]));
+                continue;
+            }
+            // Bệnh nhân chỉ được Intern khi dòng được giữ, để dòng bị loại không để lại ID. Bác sĩ thì không
+            // cần: dòng bị loại luôn chồng lên một dòng được giữ của cùng bác sĩ.
+            Candidate candidate = { rows[i].time, (uint32_t)i, aid, 0, doctor_ids.Intern(rows[i].doctor_id),
+                rows[i].duration, rows[i].status };
+            candidates.push_back(candidate);
+        }
+
+        sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            if (a.did != b.did) return a.did < b.did;
+            if (a.time != b.time) return a.time < b.time;
+            return a.row < b.row;
+        });
+        vector<Candidate> kept;
+        kept.reserve(candidates.size());
+        for (const Candidate& candidate : candidates) {
+            if (!kept.empty() && kept.back().did == candidate.did && candidate.time < kept.back().EndTime()) {
+                const ImportRow& row = rows[candidate.row];
+                input.rejects.emplace_back(row.line, "Bác sĩ không trống tại thời gian này", MoTaDong(row));
+                appointment_ids.Release(candidate.aid);
+                continue;
+            }
+            kept.push_back(candidate);
+            kept.back().pid = patient_ids.Intern(rows[candidate.row].patient_id);
+        }
+
+        sort(kept.begin(), kept.end(), [](const Candidate& a, const Candidate& b) {
+            if (a.time != b.time) return a.time < b.time;
+            return a.aid < b.aid;
+        });
+        records.Reserve(kept.size());
+        vector<AppointmentHandle> live(kept.size());
+        for (size_t i = 0; i < kept.size(); i++) {
+            const Candidate& item = kept[i];
+            live[i] = records.Allocate(Appointment(item.aid, item.pid, item.did, item.time, item.status, item.duration));
+        }
+        appointments.InsertBulk(live.size(), [&](size_t i) { return kept[i].aid; }, [&](size_t i) { return live[i]; });
+        DungChiMuc(live);
+        stable_sort(input.rejects.begin(), input.rejects.end(), [](const ImportReject& a, const ImportReject& b) {
+            return a.line < b.line;
+        });
+        return live.size();
+    }
+
+    // Các thao tác thêm lịch hẹn dựng lại đúng trạng thái hiện tại; dùng để ghi nhật ký sau khi nhập
+    // hàng loạt vào hệ thống rỗng mà không có ảnh chụp
+    vector<LogRecord> BanGhiTaoLai() {
+        vector<LogRecord> result;
+        vector<AppointmentHandle*> handles = appointments.GetAllValues();
+        result.reserve(handles.size());
+        for (AppointmentHandle* handle : handles) {
+            const Appointment* app = records.Get(*handle);
+            if (!app || !app->is_valid) continue;
+            LogRecord record;
+            record.op = LogOp::ThemLichHen;
+            record.appointment_id = IDLichHen(app->appointment_id);
+            record.patient_id = IDBenhNhan(app->patient_id);
+            record.doctor_id = IDBacSi(app->doctor_id);
+            record.time = app->time;
+            record.status = (uint8_t)app->status;
+            record.duration = app->duration;
+            result.push_back(record);
+        }
+        return result;
+    }
+
+    // Chép những gì ảnh chụp cần ở luồng chính, giữa hai lệnh; wal_lsn là LSN của thao tác kế tiếp.
+    // Phần sắp xếp, mã hóa và ghi tệp do SnapshotWriter làm ở luồng nền.
+    SnapshotData ChupAnh(uint64_t wal_lsn) {
+        SnapshotData data;
+        data.wal_lsn = wal_lsn;
+        vector<AppointmentHandle*> handles = appointments.GetAllValues();
+        data.records.reserve(handles.size());
+        for (AppointmentHandle* handle : handles) {
+            const Appointment* app = records.Get(*handle);
+            if (app) data.records.push_back(*app);
+        }
+        data.appointment_names = appointment_ids.Names();
+        data.patient_names = patient_ids.Names();
+        data.doctor_names = doctor_ids.Names();
+        return data;
+    }
+
+    void ApDung(const LogRecord& record) {
+        switch (record.op) {
+        case LogOp::ThemLichHen:
+            ThemLichHen(record.appointment_id, record.patient_id, record.doctor_id, record.time,
+                TenTrangThai((TrangThai)record.status), record.duration);
+            break;
+        case LogOp::XoaLichHen:
+            XoaLichHen(record.appointment_id, record.user_id, record.flag);
+            break;
+        case LogOp::ChinhSuaLichHen:
+            ChinhSuaLichHen(record.appointment_id, record.time, record.doctor_id);
+            break;
+        case LogOp::XacNhanLichHen:
+            XacNhanLichHen(record.appointment_id, record.doctor_id, record.flag);
+            break;
+        case LogOp::ThuHoiLichHen: {
+            AppointmentHandle* handle = TimTheoID(record.appointment_id);
+            if (handle) ThuHoi(*handle, nullptr);
+            break;
+        }
+        }
+    }
+
+    void DatThoiLuongMacDinh(int minutes) {
+        if (minutes < 1 || minutes > UINT16_MAX) throw LoiLichHen(MaLoi::KhongHopLe, "Thời lượng lịch hẹn không hợp lệ");
+        default_duration = minutes;
+    }
+
+    const string& IDLichHen(uint32_t id) const { return appointment_ids.Name(id); }
+    const string& IDBenhNhan(uint32_t id) const { return patient_ids.Name(id); }
+    const string& IDBacSi(uint32_t id) const { return doctor_ids.Name(id); }
+
+    // Các lịch hẹn của một bác sĩ không chồng lên nhau, nên chỉ lịch hẹn bắt đầu muộn nhất
+    // trước khi đoạn mới kết thúc mới có thể trùng: một lần Rank + Select, O(log n).
+    // exclude_aid là lịch hẹn đang được chỉnh sửa, không tính là xung đột với chính nó.
+    bool KiemTraThoiGianTrong(uint32_t did, time_t time, int duration, uint32_t exclude_aid = UINT32_MAX) {
+        TimeIndex* index = TimChiMuc(doctor_schedules, did);
+        if (!index) return true;
+        time_t end = time + (time_t)duration * 60;
+        int k = index->Rank(end);
+        while (k > 0) {
+            const Appointment* app = records.Get(index->Select(--k));
+            if (!app) continue;
+            if (app->appointment_id == exclude_aid) continue;
+            return app->EndTime() <= time;
+        }
+        return true;
+    }
+
+    // duration_minutes = 0 nghĩa là dùng thời lượng mặc định
+    void ThemLichHen(const string& aid_str, const string& pid_str, const string& did_str, time_t time, const string& status,
+        int duration_minutes = 0) {
+        ThemVaGhi(aid_str, pid_str, did_str, time, status, duration_minutes, nullptr);
+        ThongBao("Đã thêm lịch hẹn " + aid_str + " thành công.");
+    }
+
+    void XoaLichHen(const string& aid_str, const string& user_id, bool is_doctor) {
+        AppointmentHandle* handle = TimTheoID(aid_str);
+        Appointment* app = handle ? records.Get(*handle) : nullptr;
+        if (!app) throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn");
+        if (is_doctor) {
+            const uint32_t* did = doctor_ids.Find(user_id);
+            if (!did || app->doctor_id != *did) {
+                throw LoiLichHen(MaLoi::KhongCoQuyen, "Bạn không phải bác sĩ của lịch hẹn này");
+            }
+        }
+        else {
+            const uint32_t* pid = patient_ids.Find(user_id);
+            if (!pid || app->patient_id != *pid) {
+                throw LoiLichHen(MaLoi::KhongCoQuyen, "Bạn không phải bệnh nhân của lịch hẹn này");
+            }
+        }
+        LogRecord record;
+        record.op = LogOp::XoaLichHen;
+        record.appointment_id = aid_str;
+        record.user_id = user_id;
+        record.flag = is_doctor;
+        KiemTraBanGhi(record);
+        GhiNhatKy(record);
+        GoLichHen(*handle);
+        ThongBao("Đã xóa lịch hẹn " + aid_str + " thành công.");
+    }
+
+    // Nhận lịch hẹn chuyển từ hệ thống khác khi đổi sang new_doctor: thêm như ThemLichHen nhưng ghi
+    // nhật ký thao tác chỉnh sửa tương ứng, không thông báo. Nếu ghi nhật ký lỗi thì không thêm gì.
+    void NhanLichHen(const string& aid, const string& pid, const string& new_doctor, time_t new_time, const string& status,
+        int duration) {
+        LogRecord record;
+        record.op = LogOp::ChinhSuaLichHen;
+        record.appointment_id = aid;
+        record.doctor_id = new_doctor;
+        record.time = new_time;
+        ThemVaGhi(aid, pid, new_doctor, new_time, status, duration, &record);
+    }
+
+    // Gỡ lịch hẹn khỏi hệ thống mà không kiểm tra quyền, không ghi nhật ký và không thông báo. Chỉ dùng
+    // sau NhanLichHen ở hệ thống khác: ConcurrentAppointmentSystem chuyển lịch hẹn sang phân vùng mới khi
+    // đổi bác sĩ, và bản ghi chỉnh sửa mà NhanLichHen đã ghi thay cho cả hai bước.
+    void BoLichHen(const string& aid) {
+        AppointmentHandle* handle = TimTheoID(aid);
+        if (!handle || !records.Get(*handle)) throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn");
+        GoLichHen(*handle);
+    }
+
+    void ChinhSuaLichHen(const string& aid_str, time_t new_time, const string& new_doctor_str) {
+        AppointmentHandle* found = TimTheoID(aid_str);
+        if (!found || !records.Get(*found)) throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn");
+        AppointmentHandle handle = *found;
+        const Appointment* current = records.Get(handle);
+        const uint32_t* known_doctor = doctor_ids.Find(new_doctor_str);
+        if (known_doctor && !KiemTraThoiGianTrong(*known_doctor, new_time, current->duration, current->appointment_id)) {
+            throw LoiLichHen(MaLoi::XungDot, "Bác sĩ mới không trống tại thời gian này");
+        }
+        LogRecord record;
+        record.op = LogOp::ChinhSuaLichHen;
+        record.appointment_id = aid_str;
+        record.doctor_id = new_doctor_str;
+        record.time = new_time;
+        KiemTraBanGhi(record);
+        GhiNhatKy(record);
+        uint32_t new_doctor_id = doctor_ids.Intern(new_doctor_str);
+        Appointment* app = records.Get(handle);
+        uint32_t aid = app->appointment_id;
+        if (!app->is_valid) dead_records--; // Lịch hẹn bị từ chối được đặt lại
+        app->is_valid = false;
+        schedule.Remove(app->time, aid);
+        BoKhoiChiMucPhu(app);
+        // Cập nhật thông tin lịch hẹn
+        app->time = new_time;
+        app->doctor_id = new_doctor_id;
+        app->is_valid = true;
+        schedule.Insert(handle);
+        ThemVaoChiMucPhu(handle);
+        reminders.Push(handle); // Đã có trong heap thì chỉ đổi vị trí, không thêm bản sao
+        DangKyNhacNho(app);
+        ThongBao("Đã chỉnh sửa lịch hẹn " + aid_str + " thành công.");
+    }
+
+    void XacNhanLichHen(const string& aid, const string& doctor_id, bool confirm) {
+        AppointmentHandle* handle = TimTheoID(aid);
+        Appointment* app = handle ? records.Get(*handle) : nullptr;
+        if (!app) throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn");
+        const uint32_t* did = doctor_ids.Find(doctor_id);
+        if (!did || app->doctor_id != *did) {
+            throw LoiLichHen(MaLoi::KhongCoQuyen, "Bạn không phải bác sĩ của lịch hẹn này");
+        }
+        if (app->status == TrangThai::BiTuChoi) {
+            throw LoiLichHen(MaLoi::TrangThai, "Lịch hẹn đã bị từ chối trước đó");
+        }
+        LogRecord record;
+        record.op = LogOp::XacNhanLichHen;
+        record.appointment_id = aid;
+        record.doctor_id = doctor_id;
+        record.flag = confirm;
+        KiemTraBanGhi(record);
+        GhiNhatKy(record);
+        app->status = confirm ? TrangThai::DaXacNhan : TrangThai::BiTuChoi;
+        app->is_valid = confirm;
+        if (!confirm) {
+            schedule.Remove(app->time, app->appointment_id);
+            BoKhoiChiMucPhu(app);
+            reminders.Remove(*handle);
+            HuyNhacNho(app->appointment_id);
+            tombstones.push_back(*handle);
+            dead_records++;
+        }
+        else {
+            DangKyNhacNho(app); // Cập nhật trạng thái trong nội dung nhắc nhở
+        }
+        ThongBao("Lịch hẹn " + aid + " đã được " + (confirm ? "xác nhận" : "từ chối") + ".");
+    }
+
+    // Các truy vấn bên dưới không in gì. visit nhận const Appointment& trỏ thẳng vào bản ghi trong slab,
+    // không sao chép, chỉ hợp lệ trong lúc gọi và không được sửa hệ thống; trả về số lịch hẹn đã duyệt.
+    // Handle trong chỉ mục đã bị giải phóng (Get trả về nullptr) được bỏ qua thay vì làm sập chương trình.
+    // Việc định dạng kết quả nằm ở DinhDangKetQua.
+
+    // Con trỏ trả về chỉ hợp lệ tới lần thêm lịch hẹn kế tiếp; nullptr nếu không có hoặc đã bị từ chối
+    const Appointment* TimLichHen(const string& aid) {
+        const Appointment* app = TimBanGhi(aid);
+        return app && app->is_valid ? app : nullptr;
+    }
+
+    // Như TimLichHen nhưng trả về cả lịch hẹn bị từ chối chưa thu hồi
+    const Appointment* TimBanGhi(const string& aid) {
+        AppointmentHandle* handle = TimTheoID(aid);
+        return handle ? records.Get(*handle) : nullptr;
+    }
+
+    // Mọi lịch hẹn còn hiệu lực của bệnh nhân theo thời gian
+    template <typename TVisitor>
+    size_t DuyetLichHenCuaBenhNhan(const string& pid, TVisitor visit) {
+        const uint32_t* id = patient_ids.Find(pid);
+        TimeIndex* index = id ? TimChiMuc(patient_schedules, *id) : nullptr;
+        if (!index) return 0;
+        size_t count = 0;
+        for (AppointmentHandle handle : index->Range(numeric_limits<time_t>::min(), numeric_limits<time_t>::max())) {
+            const Appointment* app = records.Get(handle);
+            if (!app) continue;
+            visit(*app);
+            count++;
+        }
+        return count;
+    }
+
+    // Lịch hẹn sắp tới gần nhất của bệnh nhân (chưa bắt đầu), nullptr nếu không có. O(log n)
+    const Appointment* LichHenKeTiep(const string& pid) {
+        const uint32_t* id = patient_ids.Find(pid);
+        TimeIndex* index = id ? TimChiMuc(patient_schedules, *id) : nullptr;
+        if (!index) return nullptr;
+        time_t now = getCurrentTime() - VIETNAM_TZ_OFFSET; // cùng hệ quy chiếu với Appointment::time
+        return records.Get(index->Select(index->Rank(now)));
+    }
+
+    // Lịch hẹn của bệnh nhân trong [start, end] theo thời gian, O(log n + k)
+    vector<AppointmentHandle> LichHenCuaBenhNhan(const string& pid, time_t start, time_t end) {
+        vector<AppointmentHandle> result;
+        const uint32_t* id = patient_ids.Find(pid);
+        TimeIndex* index = id ? TimChiMuc(patient_schedules, *id) : nullptr;
+        if (!index || end < start) return result;
+        for (AppointmentHandle handle : index->Range(start, end)) result.push_back(handle);
+        return result;
+    }
+
+    size_t DemLichHenCuaBenhNhan(const string& pid) {
+        const uint32_t* id = patient_ids.Find(pid);
+        TimeIndex* index = id ? TimChiMuc(patient_schedules, *id) : nullptr;
+        return index ? index->Size() : 0;
+    }
+
+    // Một trang lịch của bác sĩ theo thời gian: bỏ qua offset lịch hẹn đầu tiên có time >= from,
+    // duyệt tối đa limit lịch hẹn (limit < 0: không giới hạn). O(log n + k) trên chỉ mục của bác sĩ.
+    template <typename TVisitor>
+    size_t DuyetLichHenCuaBacSi(const string& did, time_t from, int offset, int limit, TVisitor visit) {
+        return DuyetTrangBacSi(did, from, offset, limit, [&](AppointmentHandle handle) { visit(*records.Get(handle)); });
+    }
+
+    vector<AppointmentHandle> LichHenCuaBacSi(const string& did, time_t from, int offset, int limit) {
+        vector<AppointmentHandle> result;
+        DuyetTrangBacSi(did, from, offset, limit, [&](AppointmentHandle handle) { result.push_back(handle); });
+        return result;
+    }
+
+    size_t DemLichHenCuaBacSi(const string& did) {
+        const uint32_t* id = doctor_ids.Find(did);
+        TimeIndex* index = id ? TimChiMuc(doctor_schedules, *id) : nullptr;
+        return index ? index->Size() : 0;
+    }
+
+    // Lịch hẹn còn hiệu lực trong [start, end] theo thời gian, O(log n + k)
+    template <typename TVisitor>
+    size_t DuyetLichHenTheoThoiGian(time_t start, time_t end, TVisitor visit) {
+        if (difftime(end, start) < 0) {
+            throw LoiLichHen(MaLoi::KhongHopLe, "Thời gian kết thúc phải sau thời gian bắt đầu");
+        }
+        size_t count = 0;
+        for (AppointmentHandle handle : schedule.Range(start, end)) {
+            const Appointment* app = records.Get(handle);
+            if (!app) continue;
+            visit(*app);
+            count++;
+        }
+        return count;
+    }
+
+    // Tối đa limit ô 30 phút trống sớm nhất trong [from, to) của bất kỳ bác sĩ nào trong danh sách,
+    // hoặc của tất cả bác sĩ cùng lúc nếu require_all. Bác sĩ chưa có lịch hẹn được coi là luôn trống.
+    // Hàm chỉ đọc nên không Intern ID lạ; vì vậy doctor_id của kết quả là vị trí bác sĩ trong doctors.
+    vector<FreeSlot> TimOTrong(const vector<string>& doctors, time_t from, time_t to, int limit, bool require_all = false) {
+        vector<uint32_t> ids;
+        ids.reserve(doctors.size());
+        for (const string& did : doctors) {
+            const uint32_t* id = doctor_ids.Find(did);
+            ids.push_back(id ? *id : UINT32_MAX); // không có bitmap nào cho UINT32_MAX: luôn trống
+        }
+        vector<FreeSlot> result = occupancy.FindFree(ids, from, to, limit, require_all);
+        for (FreeSlot& slot : result) slot.doctor_id = (uint32_t)(find(ids.begin(), ids.end(), slot.doctor_id) - ids.begin());
+        return result;
+    }
+
+    int DemLichHenTheoThoiGian(time_t start, time_t end) {
+        return schedule.CountInRange(start, end);
+    }
+
+    // Lịch hẹn thứ k (từ 0) trong [start, end]; nullptr nếu không có
+    const Appointment* LichHenThuK(time_t start, time_t end, int k) {
+        return records.Get(schedule.KthInRange(start, end, k));
+    }
+
+    // Lịch hẹn chưa bắt đầu trong hours_before giờ tới theo thời gian. Bỏ luôn các lịch hẹn đã qua
+    // khỏi heap nhắc nhở nên không phải hàm chỉ đọc.
+    template <typename TVisitor>
+    size_t DuyetNhacNho(int hours_before, TVisitor visit) {
+        // Đưa "bây giờ" về cùng hệ quy chiếu với Appointment::time
+        time_t now = getCurrentTime() - VIETNAM_TZ_OFFSET;
+        time_t threshold = hours_before * 3600;
+        size_t count = 0;
+        reminders.PopUntil(now);
+        reminders.ForEachUntil(now + threshold, [&](AppointmentHandle handle) {
+            const Appointment* app = records.Get(handle);
+            if (!app) return;
+            visit(*app);
+            count++;
+        });
+        return count;
+    }
+
+    // Số phần tử còn hiệu lực / đã chết của từng chỉ mục. Chỉ mục theo bác sĩ/bệnh nhân và bitmap
+    // được dọn ngay khi xóa nên không có phần tử chết.
+    vector<IndexStats> ThongKeChiMuc() {
+        vector<IndexStats> stats;
+        time_t now = getCurrentTime() - VIETNAM_TZ_OFFSET;
+        size_t upcoming = schedule.Size() - schedule.Rank(now + 1); // lịch hẹn chưa qua, đều còn trong heap
+        stats.push_back(IndexStats("records", records.Size() - dead_records, dead_records));
+        stats.push_back(IndexStats("appointments", appointments.Size() - dead_records, dead_records));
+        stats.push_back(IndexStats("schedule", schedule.Size(), 0));
+        stats.push_back(IndexStats("reminders", upcoming, reminders.Size() - upcoming));
+        stats.push_back(IndexStats("doctor_schedules", doctor_schedules.Size(), 0));
+        stats.push_back(IndexStats("patient_schedules", patient_schedules.Size(), 0));
+        stats.push_back(IndexStats("occupancy", occupancy.Size(), 0));
+        return stats;
+    }
+
+    // Thu gọn tối đa budget bước rồi trả về số bước đã làm; gọi giữa các lệnh nên mỗi lần chỉ tốn
+    // một khoảng ngắn có giới hạn. Thứ tự: thu hồi lịch hẹn bị từ chối, bỏ lịch hẹn đã qua khỏi heap
+    // nhắc nhở, cuối cùng thu nhỏ dần các bảng băm quá thưa. ID của các lịch hẹn đã thu hồi được
+    // thêm vào reclaimed nếu có.
+    int DonDep(int budget, vector<string>* reclaimed = nullptr) {
+        int steps = 0;
+        while (steps < budget && !tombstones.empty()) {
+            steps++;
+            ThuHoi(tombstones.back(), reclaimed); // Lỗi ghi nhật ký thì lịch hẹn vẫn chờ thu hồi
+            tombstones.pop_back();
+        }
+        if (steps < budget) {
+            steps += reminders.PopUntil(getCurrentTime() - VIETNAM_TZ_OFFSET, budget - steps);
+        }
+        while (steps < budget && (appointments.Compact() || appointment_ids.Compact()
+            || doctor_schedules.Compact() || patient_schedules.Compact())) {
+            steps++;
+        }
+        return steps;
+    }
+
+    bool KiemTraIDTonTai(const string& aid) {
+        AppointmentHandle* handle = TimTheoID(aid);
+        return handle && records.IsLive(*handle);
+    }
+};
+
+#define CONCURRENT_SHARDS 16
+#define CONCURRENT_ID_LOCKS 64
+
+// Bản sao bất biến của một lịch hẹn trong bảng ID của ConcurrentAppointmentSystem, đọc không cần khóa
+struct LichHenTomTat {
+    uint32_t shard; // phân vùng đang giữ lịch hẹn
+    bool is_valid;  // false: đã bị từ chối, chờ thu hồi
+    TrangThai status;
+    uint16_t duration;
+    time_t time;
+    string appointment_id;
+    string patient_id;
+    string doctor_id;
+};
+
+// Chế độ đồng thời cho nhiều quầy tiếp đón dùng chung một tiến trình. Lịch hẹn được chia vào các phân vùng
+// theo băm ID bác sĩ; mỗi phân vùng là một AppointmentSystem riêng có khóa đọc-ghi riêng, nên việc kiểm
+// tra xung đột và đặt lịch cho bác sĩ ở các phân vùng khác nhau chạy song song. Truy vấn theo bệnh
+// nhân, bác sĩ, thời gian chỉ giữ khóa đọc nên chạy song song với nhau.
+// Bảng ID lịch hẹn là ConcurrentHashmap chứa bản tóm tắt của từng lịch hẹn, nên TimLichHen và
+// KiemTraIDTonTai (lệnh gọi nhiều nhất) không khóa gì. Các thao tác ghi trên cùng một ID nối tiếp nhau
+// qua một khóa trong dải khóa ID, giữ suốt thao tác để bảng ID luôn khớp với phân vùng.
+// Truy vấn theo thời gian đọc một chỉ mục thời gian bền vững (PersistentAVLTree) chứa cùng các bản
+// tóm tắt: báo cáo dài duyệt một phiên bản cố định, không khóa và không chặn thao tác ghi.
+// Thứ tự khóa: khóa ID trước rồi tới phân vùng; nhiều phân vùng thì theo chỉ số tăng dần.
+// Mọi phân vùng ghi chung một nhật ký. Bản ghi nhật ký mang ID chuỗi và luôn được ghi khi đang giữ khóa
+// ghi của phân vùng liên quan, nên thứ tự trong nhật ký khớp với thứ tự thao tác trên từng phân vùng và
+// GanNhatKy áp dụng lại qua chính lớp này là ra đúng trạng thái. Ảnh chụp gộp mọi phân vùng thành một tệp
+// như của AppointmentSystem; bộ nhắc nhở dùng chung, mỗi phân vùng một dải khóa.
+class ConcurrentAppointmentSystem {
+private:
+    struct Shard {
+        shared_timed_mutex lock;
+        AppointmentSystem system;
+        ostream silent; // Bỏ thông báo của phân vùng: thành công là không có ngoại lệ
+
+        Shard() : silent(nullptr) {
+            system.DatDauRa(silent);
+        }
+    };
+
+    // Một dòng kết quả gom từ nhiều phân vùng, con trỏ chỉ hợp lệ khi còn giữ khóa
+    struct Row {
+        time_t time;
+        uint32_t shard;
+        const Appointment* app;
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    ConcurrentHashmap<LichHenTomTat> directory;
+    PersistentAVLTree<LichHenTomTat> time_index; // chỉ lịch hẹn còn hiệu lực
+    unique_ptr<mutex[]> id_locks; // chỉ thao tác ghi dùng
+    size_t id_lock_count;
+    atomic<uint32_t> next_cleanup; // Phân vùng sẽ được dọn ở lần DonDep kế tiếp
+    WriteAheadLog* wal; // Nhật ký dùng chung của các phân vùng, có thể không gắn
+
+    uint32_t ChiSoPhanVung(const string& did) const {
+        return (uint32_t)(HashKey(did) % shards.size());
+    }
+
+    // Chọn theo các bit cao của băm, độc lập với dải khóa bên trong ConcurrentHashmap
+    mutex& KhoaID(const string& aid) {
+        return id_locks[(HashKey(aid) >> 32) % id_lock_count];
+    }
+
+    // Gọi khi đã giữ khóa ID
+    uint32_t PhanVungCuaLichHen(const string& aid) {
+        uint32_t index = 0;
+        if (!directory.Find(aid, [&index](const LichHenTomTat& entry) { index = entry.shard; })) {
+            throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn");
+        }
+        return index;
+    }
+
+    // Cập nhật bảng ID và chỉ mục thời gian theo bản ghi hiện tại của aid trong phân vùng index; gọi
+    // khi đã giữ khóa ID và khóa của phân vùng. Nhờ khóa phân vùng, thứ tự các phiên bản của chỉ mục
+    // khớp với thứ tự kiểm tra xung đột nên không phiên bản nào cho thấy hai lịch hẹn chồng nhau.
+    void CapNhatTomTat(uint32_t index, const string& aid) {
+        AppointmentSystem& system = shards[index]->system;
+        const Appointment* app = system.TimBanGhi(aid);
+        LichHenTomTat entry;
+        entry.shard = index;
+        entry.appointment_id = aid;
+        entry.patient_id = system.IDBenhNhan(app->patient_id);
+        entry.doctor_id = system.IDBacSi(app->doctor_id);
+        entry.time = app->time;
+        entry.status = app->status;
+        entry.duration = app->duration;
+        entry.is_valid = app->is_valid;
+        LichHenTomTat previous;
+        bool indexed = directory.Get(aid, previous) && previous.is_valid;
+        directory.Assign(aid, entry);
+        if (entry.is_valid) time_index.Replace(indexed ? previous.time : entry.time, aid, entry.time, entry);
+        else if (indexed) time_index.Remove(previous.time, aid);
+    }
+
+    // Giữ khóa TLock của mọi phân vùng theo thứ tự, gom các lịch hẹn mà collect(phân vùng, add) đưa ra
+    // theo thời gian rồi duyệt theo thời gian; cùng thời điểm thì theo thứ tự phân vùng. Kết quả là một
+    // lát cắt nhất quán.
+    template <typename TLock, typename TCollect, typename TVisitor>
+    size_t DuyetGop(TCollect collect, TVisitor visit) {
+        vector<TLock> guards;
+        guards.reserve(shards.size());
+        vector<Row> rows;
+        vector<size_t> bounds(1, 0); // đoạn của phân vùng i là [bounds[i], bounds[i + 1])
+        for (uint32_t i = 0; i < shards.size(); i++) {
+            guards.emplace_back(shards[i]->lock);
+            collect(shards[i]->system, [&rows, i](const Appointment& app) { rows.push_back(Row{ app.time, i, &app }); });
+            bounds.push_back(rows.size());
+        }
+        // Mỗi đoạn đã theo thời gian: trộn từng cặp đoạn kề nhau, log2(số phân vùng) lượt
+        auto earlier = [](const Row& a, const Row& b) { return a.time < b.time; };
+        size_t runs = shards.size();
+        for (size_t width = 1; width < runs; width *= 2) {
+            for (size_t i = 0; i + width < runs; i += 2 * width) {
+                inplace_merge(rows.begin() + bounds[i], rows.begin() + bounds[i + width],
+                    rows.begin() + bounds[min(i + 2 * width, runs)], earlier);
+            }
+        }
+        for (const Row& row : rows) visit(shards[row.shard]->system, *row.app);
+        return rows.size();
+    }
+
+public:
+    ConcurrentAppointmentSystem(int shard_count = CONCURRENT_SHARDS, int id_lock_total = CONCURRENT_ID_LOCKS)
+        : id_locks(new mutex[max(id_lock_total, 1)]), id_lock_count(max(id_lock_total, 1)), next_cleanup(0),
+        wal(nullptr) {
+        for (int i = 0; i < max(shard_count, 1); i++) shards.emplace_back(new Shard());
+    }
+
+    ConcurrentAppointmentSystem(const ConcurrentAppointmentSystem&) = delete;
+    ConcurrentAppointmentSystem& operator=(const ConcurrentAppointmentSystem&) = delete;
+
+    void DatThoiLuongMacDinh(int minutes) {
+        for (auto& shard : shards) {
+            unique_lock<shared_timed_mutex> guard(shard->lock);
+            shard->system.DatThoiLuongMacDinh(minutes);
+        }
+    }
+
+    // ID số trong từng phân vùng trùng nhau nên phân vùng i dùng dải khóa nhắc nhở có i ở 32 bit cao
+    void GanBoNhacNho(ReminderScheduler* scheduler) {
+        for (uint32_t i = 0; i < shards.size(); i++) {
+            unique_lock<shared_timed_mutex> guard(shards[i]->lock);
+            shards[i]->system.GanBoNhacNho(scheduler, (uint64_t)i << 32);
+        }
+    }
+
+    // Như AppointmentSystem::GanNhatKy, nhưng bản ghi được áp dụng lại qua ApDung của lớp này để về đúng
+    // phân vùng và cập nhật bảng ID; sau đó mọi phân vùng ghi tiếp vào log
+    size_t GanNhatKy(WriteAheadLog* log, uint64_t from_lsn = 0, size_t* failed = nullptr) {
+        size_t errors = 0;
+        size_t applied = log->Replay(from_lsn, [&](const LogRecord& record) {
+            try {
+                ApDung(record);
+            }
+            catch (const exception&) {
+                errors++;
+            }
+        });
+        wal = log;
+        for (auto& shard : shards) {
+            unique_lock<shared_timed_mutex> guard(shard->lock);
+            shard->system.DatNhatKy(log);
+        }
+        if (failed) *failed = errors;
+        return applied;
+    }
+
+    void ApDung(const LogRecord& record) {
+        switch (record.op) {
+        case LogOp::ThemLichHen:
+            ThemLichHen(record.appointment_id, record.patient_id, record.doctor_id, record.time,
+                TenTrangThai((TrangThai)record.status), record.duration);
+            break;
+        case LogOp::XoaLichHen:
+            XoaLichHen(record.appointment_id, record.user_id, record.flag);
+            break;
+        case LogOp::ChinhSuaLichHen:
+            ChinhSuaLichHen(record.appointment_id, record.time, record.doctor_id);
+            break;
+        case LogOp::XacNhanLichHen:
+            XacNhanLichHen(record.appointment_id, record.doctor_id, record.flag);
+            break;
+        case LogOp::ThuHoiLichHen: {
+            lock_guard<mutex> id_guard(KhoaID(record.appointment_id));
+            LichHenTomTat previous;
+            if (!directory.Get(record.appointment_id, previous) || previous.is_valid) break;
+            {
+                unique_lock<shared_timed_mutex> guard(shards[previous.shard]->lock);
+                shards[previous.shard]->system.ApDung(record);
+            }
+            directory.Remove(record.appointment_id);
+            break;
+        }
+        }
+    }
+
+    // Dựng từ ảnh chụp vào hệ thống còn rỗng, trước GanNhatKy; trả về số lịch hẹn đã nạp. Lịch hẹn bị
+    // từ chối không giữ chỗ nên được dựng trước, từng cái thêm rồi từ chối ngay, sau đó mới tới lịch hẹn
+    // còn hiệu lực. Chậm hơn nạp hàng loạt của AppointmentSystem vì phải chia lại theo phân vùng.
+    size_t NapAnhChup(const SnapshotFile& snapshot) {
+        if (directory.Size()) throw runtime_error("Chỉ nạp ảnh chụp khi hệ thống chưa có dữ liệu");
+        vector<string> names[3];
+        for (int table = 0; table < 3; table++) names[table].reserve(snapshot.NameCount((SnapshotFile::NameTable)table));
+        snapshot.ForEachName([&](SnapshotFile::NameTable table, const string& name) { names[table].push_back(name); });
+        size_t count = snapshot.RecordCount();
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t i = 0; i < count; i++) {
+                const SnapshotRecord& item = snapshot.Record(i);
+                if (item.is_valid != (pass == 1)) continue;
+                const string& aid = names[SnapshotFile::kLichHen][item.appointment_id];
+                const string& did = names[SnapshotFile::kBacSi][item.doctor_id];
+                ThemLichHen(aid, names[SnapshotFile::kBenhNhan][item.patient_id], did, (time_t)item.time,
+                    item.is_valid ? TenTrangThai((TrangThai)item.status) : "đang chờ", item.duration);
+                if (!item.is_valid) XacNhanLichHen(aid, did, false);
+            }
+        }
+        return count;
+    }
+
+    // Như AppointmentSystem::NhapHangLoat: dòng trùng ID lịch hẹn với một dòng trước đó bị loại ở đây vì
+    // hai dòng có thể thuộc hai phân vùng, phần còn lại chia theo bác sĩ cho từng phân vùng tự nhập
+    size_t NhapHangLoat(ImportResult& input) {
+        if (directory.Size()) throw runtime_error("Chỉ nhập hàng loạt khi hệ thống chưa có dữ liệu");
+        vector<ImportResult> parts(shards.size());
+        IdTable seen;
+        seen.Reserve(input.rows.size());
+        for (ImportRow& row : input.rows) {
+            size_t known = seen.Size();
+            seen.Intern(row.appointment_id);
+            if (seen.Size() == known) {
+                input.rejects.emplace_back(row.line, "ID lịch hẹn trùng lặp: " + row.appointment_id,
+                    AppointmentSystem::MoTaDong(row));
+                continue;
+            }
+            parts[ChiSoPhanVung(row.doctor_id)].rows.push_back(move(row));
+        }
+        size_t imported = 0;
+        for (uint32_t i = 0; i < shards.size(); i++) {
+            unique_lock<shared_timed_mutex> guard(shards[i]->lock);
+            AppointmentSystem& system = shards[i]->system;
+            imported += system.NhapHangLoat(parts[i]);
+            input.rejects.insert(input.rejects.end(), make_move_iterator(parts[i].rejects.begin()),
+                make_move_iterator(parts[i].rejects.end()));
+            vector<ImportRow>().swap(parts[i].rows);
+            SnapshotData part = system.ChupAnh(0);
+            for (const Appointment& app : part.records) CapNhatTomTat(i, part.appointment_names[app.appointment_id]);
+        }
+        stable_sort(input.rejects.begin(), input.rejects.end(), [](const ImportReject& a, const ImportReject& b) {
+            return a.line < b.line;
+        });
+        return imported;
+    }
+
+    vector<LogRecord> BanGhiTaoLai() {
+        vector<LogRecord> result;
+        for (auto& shard : shards) {
+            shared_lock<shared_timed_mutex> guard(shard->lock);
+            vector<LogRecord> part = shard->system.BanGhiTaoLai();
+            result.insert(result.end(), make_move_iterator(part.begin()), make_move_iterator(part.end()));
+        }
+        return result;
+    }
+
+    // Giữ khóa đọc mọi phân vùng nên không thao tác ghi nào đang dở, và LSN đọc được khớp với dữ liệu.
+    // ID lịch hẹn của từng phân vùng được dời theo số tên đã gộp trước nó (mỗi ID chỉ ở một phân vùng);
+    // bệnh nhân có thể có ở nhiều phân vùng nên tên bệnh nhân, bác sĩ được gộp qua IdTable để ảnh chụp
+    // nạp được cả vào AppointmentSystem. WriteSnapshot đánh số lại khi ghi.
+    SnapshotData ChupAnh() {
+        vector<shared_lock<shared_timed_mutex>> guards;
+        guards.reserve(shards.size());
+        for (auto& shard : shards) guards.emplace_back(shard->lock);
+        SnapshotData data;
+        data.wal_lsn = wal ? wal->NextLsn() : 0;
+        IdTable patients;
+        IdTable doctors;
+        auto gop = [](IdTable& merged, const vector<string>& names) {
+            vector<uint32_t> ids(names.size());
+            for (size_t i = 0; i < names.size(); i++) {
+                if (!names[i].empty()) ids[i] = merged.Intern(names[i]); // chuỗi rỗng: ID đã trả lại
+            }
+            return ids;
+        };
+        for (auto& shard : shards) {
+            SnapshotData part = shard->system.ChupAnh(0);
+            uint32_t aid_base = (uint32_t)data.appointment_names.size();
+            vector<uint32_t> pids = gop(patients, part.patient_names);
+            vector<uint32_t> dids = gop(doctors, part.doctor_names);
+            for (Appointment& app : part.records) {
+                app.appointment_id += aid_base;
+                app.patient_id = pids[app.patient_id];
+                app.doctor_id = dids[app.doctor_id];
+                data.records.push_back(app);
+            }
+            data.appointment_names.insert(data.appointment_names.end(), make_move_iterator(part.appointment_names.begin()),
+                make_move_iterator(part.appointment_names.end()));
+        }
+        data.patient_names = patients.Names();
+        data.doctor_names = doctors.Names();
+        return data;
+    }
+
+    // Khi ID trùng và bác sĩ cùng lúc không trống thì báo trùng ID, khác thứ tự kiểm tra của AppointmentSystem
+    void ThemLichHen(const string& aid, const string& pid, const string& did, time_t time, const string& status,
+        int duration_minutes = 0) {
+        lock_guard<mutex> id_guard(KhoaID(aid));
+        if (directory.Contains(aid)) throw LoiLichHen(MaLoi::TrungLap, "ID lịch hẹn trùng lặp: " + aid);
+        uint32_t index = ChiSoPhanVung(did);
+        unique_lock<shared_timed_mutex> guard(shards[index]->lock);
+        shards[index]->system.ThemLichHen(aid, pid, did, time, status, duration_minutes);
+        CapNhatTomTat(index, aid);
+    }
+
+    void XoaLichHen(const string& aid, const string& user_id, bool is_doctor) {
+        lock_guard<mutex> id_guard(KhoaID(aid));
+        LichHenTomTat previous;
+        if (!directory.Get(aid, previous)) throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn");
+        Shard& shard = *shards[previous.shard];
+        unique_lock<shared_timed_mutex> guard(shard.lock);
+        shard.system.XoaLichHen(aid, user_id, is_doctor);
+        directory.Remove(aid);
+        if (previous.is_valid) time_index.Remove(previous.time, aid);
+    }
+
+    // Đổi sang bác sĩ thuộc phân vùng khác thì lịch hẹn được dựng lại ở phân vùng mới (giữ bệnh nhân,
+    // trạng thái, thời lượng) rồi mới gỡ khỏi phân vùng cũ, nên lỗi xung đột hay lỗi ghi nhật ký không làm
+    // mất lịch hẹn. NhanLichHen ghi một bản ghi chỉnh sửa cho cả hai bước.
+    void ChinhSuaLichHen(const string& aid, time_t new_time, const string& new_doctor) {
+        lock_guard<mutex> id_guard(KhoaID(aid));
+        uint32_t from = PhanVungCuaLichHen(aid);
+        uint32_t to = ChiSoPhanVung(new_doctor);
+        if (from == to) {
+            unique_lock<shared_timed_mutex> guard(shards[from]->lock);
+            shards[from]->system.ChinhSuaLichHen(aid, new_time, new_doctor);
+            CapNhatTomTat(from, aid);
+            return;
+        }
+        unique_lock<shared_timed_mutex> first(shards[min(from, to)]->lock);
+        unique_lock<shared_timed_mutex> second(shards[max(from, to)]->lock);
+        AppointmentSystem& source = shards[from]->system;
+        const Appointment* app = source.TimBanGhi(aid);
+        if (!app) throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn");
+        try {
+            shards[to]->system.NhanLichHen(aid, source.IDBenhNhan(app->patient_id), new_doctor, new_time,
+                TenTrangThai(app->status), app->duration);
+        }
+        catch (const LoiLichHen& e) {
+            if (e.code == MaLoi::XungDot) throw LoiLichHen(MaLoi::XungDot, "Bác sĩ mới không trống tại thời gian này");
+            throw;
+        }
+        source.BoLichHen(aid);
+        CapNhatTomTat(to, aid);
+    }
+
+    void XacNhanLichHen(const string& aid, const string& doctor_id, bool confirm) {
+        lock_guard<mutex> id_guard(KhoaID(aid));
+        uint32_t index = PhanVungCuaLichHen(aid);
+        unique_lock<shared_timed_mutex> guard(shards[index]->lock);
+        shards[index]->system.XacNhanLichHen(aid, doctor_id, confirm);
+        CapNhatTomTat(index, aid);
+    }
+
+    // Không khóa
+    bool KiemTraIDTonTai(const string& aid) {
+        bool live = false;
+        directory.Find(aid, [&live](const LichHenTomTat& entry) { live = entry.is_valid; });
+        return live;
+    }
 
-    time_t vn_time = utc_time + VIETNAM_TZ_OFFSET;
-    struct tm timeinfo;
-    localtime_s(&timeinfo, &vn_time);
+    // Không khóa: visit(const LichHenTomTat&) chạy trên bản tóm tắt hiện hành nếu lịch hẹn còn hiệu lực
+    template <typename TVisitor>
+    bool TimLichHen(const string& aid, TVisitor visit) {
+        bool found = false;
+        directory.Find(aid, [&](const LichHenTomTat& entry) {
+            if (!entry.is_valid) return;
+            found = true;
+            visit(entry);
+        });
+        return found;
+    }
 
-    char buffer[20];
-    strftime(buffer, sizeof(buffer), "%d-%m-%Y %H:%M", &timeinfo);
-    return string(buffer);
-}
+    // Các hàm Duyet* còn lại gọi visit(phân vùng, lịch hẹn) khi còn giữ khóa đọc; dùng phân vùng để
+    // đổi ID số của lịch hẹn ra chuỗi (IDLichHen, IDBenhNhan, IDBacSi). Trả về số lịch hẹn đã duyệt.
 
-bool isValidDate(int day, int month, int year) {
-    if (year < 1970 || month < 1 || month > 12 || day < 1) return false;
+    // Bệnh nhân có thể có lịch hẹn ở mọi phân vùng nên phải gộp
+    template <typename TVisitor>
+    size_t DuyetLichHenCuaBenhNhan(const string& pid, TVisitor visit) {
+        return DuyetGop<shared_lock<shared_timed_mutex>>([&pid](AppointmentSystem& system, const auto& add) {
+            system.DuyetLichHenCuaBenhNhan(pid, add);
+        }, visit);
+    }
 
-    int daysInMonth[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-    if ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0)) {
-        daysInMonth[1] = 29;
+    template <typename TVisitor>
+    size_t DuyetLichHenCuaBacSi(const string& did, time_t from, int offset, int limit, TVisitor visit) {
+        Shard& shard = *shards[ChiSoPhanVung(did)];
+        shared_lock<shared_timed_mutex> guard(shard.lock);
+        return shard.system.DuyetLichHenCuaBacSi(did, from, offset, limit, [&](const Appointment& app) {
+            visit(shard.system, app);
+        });
     }
-    return day <= daysInMonth[month - 1];
-}
 
-time_t parseDateTime(const string& datetime) {
-    string cleaned = trim(datetime);
-    if (cleaned.empty()) {
-        throw runtime_error("Chuỗi thời gian rỗng");
+    // Báo cáo gồm nhiều truy vấn trên cùng một phiên bản: AnhChupThoiGian view(system.ChiMucThoiGian());
+    typedef PersistentAVLTree<LichHenTomTat>::Snapshot AnhChupThoiGian;
+
+    const PersistentAVLTree<LichHenTomTat>& ChiMucThoiGian() const {
+        return time_index;
+    }
+
+    // Không khóa: visit(const LichHenTomTat&) theo (thời gian, ID lịch hẹn) trên một phiên bản cố
+    // định của chỉ mục thời gian, nên báo cáo dài không bị xé bởi thao tác ghi chạy song song
+    template <typename TVisitor>
+    size_t DuyetLichHenTheoThoiGian(time_t start, time_t end, TVisitor visit) {
+        if (difftime(end, start) < 0) {
+            throw LoiLichHen(MaLoi::KhongHopLe, "Thời gian kết thúc phải sau thời gian bắt đầu");
+        }
+        AnhChupThoiGian snapshot(time_index);
+        size_t count = 0;
+        for (const LichHenTomTat& entry : snapshot.Range(start, end)) {
+            visit(entry);
+            count++;
+        }
+        return count;
+    }
+
+    // Bỏ lịch hẹn đã qua khỏi heap nhắc nhở nên cần khóa ghi mọi phân vùng
+    template <typename TVisitor>
+    size_t DuyetNhacNho(int hours_before, TVisitor visit) {
+        return DuyetGop<unique_lock<shared_timed_mutex>>([hours_before](AppointmentSystem& system, const auto& add) {
+            system.DuyetNhacNho(hours_before, add);
+        }, visit);
+    }
+
+    // Không khóa, O(log n) trên một phiên bản của chỉ mục thời gian
+    int DemLichHenTheoThoiGian(time_t start, time_t end) {
+        AnhChupThoiGian snapshot(time_index);
+        return snapshot.CountInRange(start, end);
+    }
+
+    // Mỗi lần chỉ dọn một phân vùng (xoay vòng) để giữ thời gian khóa ghi ngắn; ID của lịch hẹn đã thu
+    // hồi được bỏ khỏi bảng ID sau khi nhả khóa phân vùng, đúng thứ tự khóa. Trong khoảng giữa, bản tóm
+    // tắt còn lại đều có is_valid = false nên không lộ ra ngoài; chỉ mục thời gian đã gỡ chúng từ trước.
+    int DonDep(int budget) {
+        uint32_t index = next_cleanup.fetch_add(1, memory_order_relaxed) % shards.size();
+        vector<string> reclaimed;
+        int steps;
+        {
+            unique_lock<shared_timed_mutex> guard(shards[index]->lock);
+            steps = shards[index]->system.DonDep(budget, &reclaimed);
+        }
+        for (const string& aid : reclaimed) {
+            lock_guard<mutex> id_guard(KhoaID(aid));
+            uint32_t owner = UINT32_MAX;
+            directory.Find(aid, [&owner](const LichHenTomTat& entry) { owner = entry.shard; });
+            if (owner == index) directory.Remove(aid);
+        }
+        return steps;
     }
+};
 
-    stringstream ss(cleaned);
-    int day, month, year, hour, minute;
-    char dash1, dash2, colon;
+// Lớp định dạng: in kết quả truy vấn của AppointmentSystem ra out đúng như menu vẫn in. Thời gian được
+// ghi vào DateText trên stack nên mỗi dòng không cấp phát; tên ID là tham chiếu tới bảng ID.
+class DinhDangKetQua {
+private:
+    AppointmentSystem& system;
+    ostream& out;
 
-    ss >> day >> dash1 >> month >> dash2 >> year;
+    static DateText ThoiGian(time_t time) {
+        DateText text;
+        EncodeDateTime(time, text.text);
+        return text;
+    }
 
-    if (ss.get() != ' ') {
-        throw runtime_error("Dấu phân tách giữa ngày và giờ phải là khoảng trắng");
+    void InDayDu(const Appointment& app) {
+        out << "Lịch hẹn " << system.IDLichHen(app.appointment_id)
+            << " với bệnh nhân " << system.IDBenhNhan(app.patient_id)
+            << ", bác sĩ " << system.IDBacSi(app.doctor_id)
+            << " vào lúc " << ThoiGian(app.time).text
+            << ", trạng thái: " << TenTrangThai(app.status) << '\n';
     }
 
-    ss >> hour >> colon >> minute;
+public:
+    DinhDangKetQua(AppointmentSystem& appointment_system, ostream& stream) : system(appointment_system), out(stream) {}
 
-    if (ss.fail()) {
-        throw runtime_error("Không thể phân tích thời gian. Đảm bảo định dạng DD-MM-YYYY HH:MM");
+    // Trả về false nếu không tìm thấy
+    bool InLichHen(const string& aid) {
+        const Appointment* app = system.TimLichHen(aid);
+        if (!app) {
+            out << "Không tìm thấy lịch hẹn " << aid << "." << '\n';
+            return false;
+        }
+        out << "Tìm thấy: Lịch hẹn " << system.IDLichHen(app->appointment_id)
+            << " với bác sĩ " << system.IDBacSi(app->doctor_id)
+            << " vào lúc " << ThoiGian(app->time).text
+            << ", trạng thái: " << TenTrangThai(app->status) << '\n';
+        return true;
     }
 
-    if (dash1 != '-' || dash2 != '-') {
-        throw runtime_error("Dấu phân tách ngày/tháng/năm phải là '-'");
+    void InTheoBenhNhan(const string& pid) {
+        size_t count = system.DuyetLichHenCuaBenhNhan(pid, [this](const Appointment& app) {
+            out << "Lịch hẹn " << system.IDLichHen(app.appointment_id)
+                << " với bác sĩ " << system.IDBacSi(app.doctor_id)
+                << " vào lúc " << ThoiGian(app.time).text
+                << ", trạng thái: " << TenTrangThai(app.status) << '\n';
+        });
+        if (count == 0) out << "Không tìm thấy lịch hẹn nào cho bệnh nhân " << pid << "." << '\n';
     }
-    if (colon != ':') {
-        throw runtime_error("Dấu phân tách giờ/phút phải là ':'");
+
+    void InTheoBacSi(const string& did, int offset = 0, int limit = -1) {
+        size_t count = system.DuyetLichHenCuaBacSi(did, numeric_limits<time_t>::min(), offset, limit,
+            [this](const Appointment& app) {
+            out << "Lịch hẹn " << system.IDLichHen(app.appointment_id)
+                << " với bệnh nhân " << system.IDBenhNhan(app.patient_id)
+                << " vào lúc " << ThoiGian(app.time).text
+                << ", trạng thái: " << TenTrangThai(app.status) << '\n';
+        });
+        if (count == 0) out << "Không tìm thấy lịch hẹn nào cho bác sĩ " << did << "." << '\n';
     }
 
-    string extra;
-    getline(ss, extra);
-    if (!trim(extra).empty()) {
-        throw runtime_error("Có ký tự thừa sau thời gian");
+    void InTheoThoiGian(const string& start_datetime, const string& end_datetime) {
+        time_t start = parseDateTime(start_datetime);
+        time_t end = parseDateTime(end_datetime);
+        size_t count = system.DuyetLichHenTheoThoiGian(start, end, [this](const Appointment& app) { InDayDu(app); });
+        if (count == 0) {
+            out << "Không tìm thấy lịch hẹn nào trong khoảng thời gian từ "
+                << ThoiGian(start).text << " đến " << ThoiGian(end).text << "." << '\n';
+        }
     }
 
-    if (!isValidDate(day, month, year)) {
-        throw runtime_error("Ngày không hợp lệ (ngày 1-31, tháng 1-12, năm >= 1970)");
+    void InTrongNgay() {
+        time_t start = VietnamDayStart(getCurrentTime() - VIETNAM_TZ_OFFSET);
+        time_t end = start + 86400; // 1 ngày
+        if (system.DemLichHenTheoThoiGian(start, end) == 0) {
+            out << "Không có lịch hẹn nào trong ngày hôm nay (" << ThoiGian(start).text << ")." << '\n';
+            return;
+        }
+        out << "Lịch hẹn trong ngày hôm nay (" << ThoiGian(start).text << "):" << '\n';
+        system.DuyetLichHenTheoThoiGian(start, end, [this](const Appointment& app) { InDayDu(app); });
     }
-    if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
-        throw runtime_error("Giờ/phút không hợp lệ (giờ 0-23, phút 0-59)");
+
+    void InNhacNho(int hours_before) {
+        size_t count = system.DuyetNhacNho(hours_before, [this](const Appointment& app) {
+            out << "Nhắc nhở: ";
+            InDayDu(app);
+        });
+        if (count == 0) {
+            out << "Không có lịch hẹn nào cần nhắc nhở trong " << hours_before << " giờ tới." << '\n';
+        }
     }
+};
 
-    struct tm timeinfo = {};
-    timeinfo.tm_year = year - 1900;
-    timeinfo.tm_mon = month - 1;
-    timeinfo.tm_mday = day;
-    timeinfo.tm_hour = hour;
-    timeinfo.tm_min = minute;
-    timeinfo.tm_sec = 0;
-    timeinfo.tm_isdst = 0;
+string DinhDangNhacNho(const NhacNho& reminder) {
+    return "Nhắc nhở (trước " + to_string(reminder.lead_minutes) + " phút): Lịch hẹn " + reminder.appointment_id
+        + " với bệnh nhân " + reminder.patient_id
+        + ", bác sĩ " + reminder.doctor_id
+        + " vào lúc " + toVietnamTime(reminder.time)
+        + ", trạng thái: " + reminder.status;
+}
 
-    time_t result = mktime(&timeinfo);
-    if (result == -1) {
-        throw runtime_error("Không thể chuyển đổi thời gian");
+// Ghi từng lô nhắc nhở vào tệp (hoặc pipe có tên), "-" nghĩa là ghi ra màn hình
+ReminderSink TaoSinkTapTin(const string& path) {
+    if (path == "-") {
+        return [](const vector<NhacNho>& batch) {
+            string text;
+            for (const NhacNho& reminder : batch) text += DinhDangNhacNho(reminder) + "\n";
+            cout << text << flush;
+        };
     }
+    shared_ptr<ofstream> out = make_shared<ofstream>(path, ios::app);
+    if (!*out) throw runtime_error("Không mở được tệp nhắc nhở: " + path);
+    return [out](const vector<NhacNho>& batch) {
+        for (const NhacNho& reminder : batch) *out << DinhDangNhacNho(reminder) << '\n';
+        out->flush();
+    };
+}
 
-    result -= VIETNAM_TZ_OFFSET;
-    return result;
+int DocSoPhut(const string& text) {
+    string item = trim(text);
+    if (item.empty() || item.size() > 6 || item.find_first_not_of("0123456789") != string::npos) {
+        throw runtime_error("Số phút không hợp lệ: " + item);
+    }
+    return stoi(item);
 }
 
-time_t getCurrentTime() {
-    return time(nullptr);
+int DocSoThaoTac(const string& text) {
+    string item = trim(text);
+    if (item.empty() || item.size() > 9 || item.find_first_not_of("0123456789") != string::npos || stoi(item) == 0) {
+        throw runtime_error("Số thao tác không hợp lệ: " + item);
+    }
+    return stoi(item);
 }
 
-bool isAlphanumeric(const string& str) {
-    if (str.empty()) return false;
-    for (char c : str) {
-        if (!isalnum(c)) return false;
+// "60,1440" -> {60, 1440}
+vector<int> DocMocNhacNho(const string& text) {
+    vector<int> leads;
+    stringstream ss(text);
+    string item;
+    while (getline(ss, item, ',')) {
+        leads.push_back(DocSoPhut(item));
     }
-    return true;
+    if (leads.empty()) throw runtime_error("Chưa có mốc nhắc nhở");
+    return leads;
 }
 
-class AppointmentSystem {
-private:
-    Hashmap<shared_ptr<Appointment>> appointments;
-    Hashmap<vector<shared_ptr<Appointment>>> doctor_schedules; // Lưu lịch hẹn theo bác sĩ
-    Hashmap<vector<shared_ptr<Appointment>>> patient_schedules; // Lưu lịch hẹn theo bệnh nhân
-    AVLTree schedule;
-    PriorityQueue reminders;
-    DoublyLinkedList doctor_appointments;
+int DocSoLuong(const string& text) {
+    string item = trim(text);
+    if (item.empty() || item.size() > 3 || item.find_first_not_of("0123456789") != string::npos || stoi(item) == 0) {
+        throw runtime_error("Số luồng không hợp lệ: " + item);
+    }
+    return stoi(item);
+}
 
-public:
-    ~AppointmentSystem() {}
+// Kiểm tra một dòng nhập hàng loạt như khi nhập tay, trừ điều kiện thời gian ở tương lai vì dữ liệu
+// chuyển sang có cả lịch hẹn đã qua. Trạng thái trống là "đang chờ", thời lượng trống là mặc định.
+ImportRow DocDongNhap(const ImportFields& fields, int default_duration) {
+    ImportRow row;
+    row.appointment_id = trim(fields.appointment_id);
+    row.patient_id = trim(fields.patient_id);
+    row.doctor_id = trim(fields.doctor_id);
+    if (!isAlphanumeric(row.appointment_id)) throw runtime_error("ID lịch hẹn chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự");
+    if (!isAlphanumeric(row.patient_id)) throw runtime_error("ID bệnh nhân chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự");
+    if (!isAlphanumeric(row.doctor_id)) throw runtime_error("ID bác sĩ chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự");
+    row.time = parseDateTime(fields.time);
+    string status = trim(fields.status);
+    row.status = status.empty() ? TrangThai::DangCho : DocTrangThai(status);
+    string minutes = trim(fields.duration);
+    int duration = minutes.empty() ? default_duration : DocSoPhut(minutes);
+    if (duration < 1 || duration > UINT16_MAX) throw runtime_error("Thời lượng lịch hẹn không hợp lệ");
+    row.duration = (uint16_t)duration;
+    row.line = 0;
+    return row;
+}
 
-    bool KiemTraThoiGianTrong(const string& did, time_t time) {
-        auto* schedule = doctor_schedules.Find(did);
-        if (!schedule) return true;
-        for (const auto& app : *schedule) {
-            if (app->is_valid && abs(difftime(time, app->time)) < 1800) { // Trùng trong 30 phút
-                return false;
-            }
-        }
-        return true;
+// Ghi đè báo cáo sau mỗi lần nhập để không lẫn với lần trước, kể cả khi không có dòng nào bị loại
+void GhiBaoCaoNhap(const string& path, const vector<ImportReject>& rejects) {
+    ofstream out(path, ios::trunc);
+    if (!out) throw runtime_error("Không mở được tệp báo cáo nhập: " + path);
+    for (const ImportReject& reject : rejects) {
+        out << "Dòng " << reject.line << ": " << reject.reason << "\t" << reject.text << '\n';
+    }
+    if (!out.flush()) throw runtime_error("Không ghi được tệp báo cáo nhập: " + path);
+}
+
+// Lỗi khi đọc tham số của lệnh chạy lô đều là tham số không hợp lệ
+time_t DocThoiGianLenh(const string& date, const string& clock) {
+    try {
+        return parseDateTime(date + " " + clock);
+    }
+    catch (const runtime_error& e) {
+        throw LoiLichHen(MaLoi::KhongHopLe, e.what());
+    }
+}
+
+void KiemTraIDLenh(const string& id, const string& name) {
+    if (!isAlphanumeric(id)) throw LoiLichHen(MaLoi::KhongHopLe, "ID " + name + " chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự");
+}
+
+void KiemTraTuongLai(time_t time) {
+    if (difftime(time + VIETNAM_TZ_OFFSET, getCurrentTime()) <= 0) {
+        throw LoiLichHen(MaLoi::KhongHopLe, "Không thể đặt lịch hẹn trong quá khứ hoặc hiện tại");
     }
+}
+
+bool DocCoLenh(const string& text) {
+    if (text == "0") return false;
+    if (text == "1") return true;
+    throw LoiLichHen(MaLoi::KhongHopLe, "Giá trị phải là 0 hoặc 1: " + text);
+}
 
-    void ThemLichHen(const string& aid, const string& pid, const string& did, time_t time, const string& status) {
-        if (!KiemTraThoiGianTrong(did, time)) {
-            throw runtime_error("Bác sĩ không trống tại thời gian này");
+// Lệnh của chế độ chạy lô, mỗi dòng một lệnh, tham số cách nhau bởi khoảng trắng:
+//   them <lịch hẹn> <bệnh nhân> <bác sĩ> <DD-MM-YYYY> <HH:MM> ["đang chờ"|"đã xác nhận"] [phút]
+//   xoa <lịch hẹn> <0: bệnh nhân|1: bác sĩ> <ID người xóa>
+//   sua <lịch hẹn> <bác sĩ mới> <DD-MM-YYYY> <HH:MM>
+//   xacnhan <lịch hẹn> <bác sĩ> <0: từ chối|1: xác nhận>
+//   tim <lịch hẹn>    benhnhan <bệnh nhân>    bacsi <bác sĩ>
+//   khoang <DD-MM-YYYY> <HH:MM> <DD-MM-YYYY> <HH:MM>
+//   nhac <1|24>       homnay
+// Kiểm tra tham số như menu nhưng báo lỗi ngay thay vì hỏi lại. Trả về mã của lệnh không ném lỗi.
+MaLoi ThucHienLenh(AppointmentSystem& system, const vector<string>& args, ostream& out) {
+    DinhDangKetQua format(system, out);
+    const string& name = args[0];
+    size_t count = args.size() - 1;
+    auto expect = [&](size_t low, size_t high) {
+        if (count < low || count > high) throw LoiLichHen(MaLoi::CuPhap, "Sai số tham số của lệnh " + name);
+    };
+    if (name == "them") {
+        expect(5, 7);
+        KiemTraIDLenh(args[1], "lịch hẹn");
+        KiemTraIDLenh(args[2], "bệnh nhân");
+        KiemTraIDLenh(args[3], "bác sĩ");
+        time_t time = DocThoiGianLenh(args[4], args[5]);
+        KiemTraTuongLai(time);
+        string status = count >= 6 ? args[6] : "đang chờ";
+        if (status != "đang chờ" && status != "đã xác nhận") {
+            throw LoiLichHen(MaLoi::KhongHopLe, "Trạng thái chỉ được là 'đang chờ' hoặc 'đã xác nhận'");
         }
-        auto sp = make_shared<Appointment>(aid, pid, did, time, status);
-        try {
-            appointments.Insert(aid, sp);
+        int minutes = 0;
+        if (count == 7) {
             try {
-                // Thêm vào lịch bác sĩ
-                auto* doc_schedule = doctor_schedules.Find(did);
-                if (!doc_schedule) {
-                    vector<shared_ptr<Appointment>> new_schedule;
-                    new_schedule.push_back(sp);
-                    doctor_schedules.Insert(did, new_schedule);
-                }
-                else {
-                    doc_schedule->push_back(sp);
-                }
-                // Thêm vào lịch bệnh nhân
-                auto* pat_schedule = patient_schedules.Find(pid);
-                if (!pat_schedule) {
-                    vector<shared_ptr<Appointment>> new_schedule;
-                    new_schedule.push_back(sp);
-                    patient_schedules.Insert(pid, new_schedule);
-                }
-                else {
-                    pat_schedule->push_back(sp);
-                }
-                // Thêm vào các cấu trúc khác
-                schedule.Insert(sp);
-                reminders.Push(sp);
-                doctor_appointments.Append(sp);
-                cout << "Đã thêm lịch hẹn " << aid << " thành công." << endl;
+                minutes = DocSoPhut(args[7]);
             }
-            catch (...) {
-                appointments.Remove(aid);
-                throw;
+            catch (const runtime_error& e) {
+                throw LoiLichHen(MaLoi::KhongHopLe, e.what());
             }
         }
-        catch (...) {
-            throw;
-        }
+        system.ThemLichHen(args[1], args[2], args[3], time, status, minutes);
+    }
+    else if (name == "xoa") {
+        expect(3, 3);
+        system.XoaLichHen(args[1], args[3], DocCoLenh(args[2]));
+    }
+    else if (name == "sua") {
+        expect(4, 4);
+        KiemTraIDLenh(args[1], "lịch hẹn");
+        KiemTraIDLenh(args[2], "bác sĩ");
+        time_t time = DocThoiGianLenh(args[3], args[4]);
+        KiemTraTuongLai(time);
+        system.ChinhSuaLichHen(args[1], time, args[2]);
+    }
+    else if (name == "xacnhan") {
+        expect(3, 3);
+        system.XacNhanLichHen(args[1], args[2], DocCoLenh(args[3]));
+    }
+    else if (name == "tim") {
+        expect(1, 1);
+        if (!format.InLichHen(args[1])) return MaLoi::KhongTimThay;
+    }
+    else if (name == "benhnhan") {
+        expect(1, 1);
+        format.InTheoBenhNhan(args[1]);
     }
+    else if (name == "bacsi") {
+        expect(1, 1);
+        format.InTheoBacSi(args[1]);
+    }
+    else if (name == "khoang") {
+        expect(4, 4);
+        DocThoiGianLenh(args[1], args[2]);
+        DocThoiGianLenh(args[3], args[4]);
+        format.InTheoThoiGian(args[1] + " " + args[2], args[3] + " " + args[4]);
+    }
+    else if (name == "nhac") {
+        expect(1, 1);
+        if (args[1] != "1" && args[1] != "24") throw LoiLichHen(MaLoi::KhongHopLe, "Khoảng nhắc nhở chỉ được là 1 hoặc 24");
+        format.InNhacNho(stoi(args[1]));
+    }
+    else if (name == "homnay") {
+        expect(0, 0);
+        format.InTrongNgay();
+    }
+    else {
+        throw LoiLichHen(MaLoi::CuPhap, "Lệnh không hợp lệ: " + name);
+    }
+    return MaLoi::ThanhCong;
+}
 
-    void XoaLichHen(const string& aid, const string& user_id, bool is_doctor) {
-        shared_ptr<Appointment>* app = appointments.Find(aid);
-        if (!app || !(*app)) throw runtime_error("Không tìm thấy lịch hẹn");
-        if (is_doctor && (*app)->doctor_id != user_id) {
-            throw runtime_error("Bạn không phải bác sĩ của lịch hẹn này");
-        }
-        if (!is_doctor && (*app)->patient_id != user_id) {
-            throw runtime_error("Bạn không phải bệnh nhân của lịch hẹn này");
+// Chạy lần lượt các lệnh đọc từ input; sau kết quả của mỗi lệnh ghi một dòng trạng thái
+// "#<dòng> <mã> <KÝ_HIỆU>[ <thông báo lỗi>]" vào out. Dòng trống và dòng bắt đầu bằng '#' được bỏ qua.
+// after_command chạy sau mỗi lệnh và không được ném lỗi. Trả về số lệnh lỗi, executed nhận số lệnh đã chạy.
+size_t ChayLoLenh(AppointmentSystem& system, LineReader& input, ostream& out, const function<void()>& after_command,
+    size_t& executed) {
+    string line;
+    size_t line_number = 0;
+    size_t failures = 0;
+    executed = 0;
+    while (input.Next(line)) {
+        line_number++;
+        size_t first = line.find_first_not_of(" \t");
+        if (first == string::npos || line[first] == '#') continue;
+        MaLoi code = MaLoi::ThanhCong;
+        string message;
+        try {
+            vector<string> args;
+            try {
+                args = SplitCommand(line);
+            }
+            catch (const runtime_error& e) {
+                throw LoiLichHen(MaLoi::CuPhap, e.what());
+            }
+            code = ThucHienLenh(system, args, out);
         }
-        (*app)->is_valid = false;
-        appointments.Remove(aid);
-        schedule.Remove(aid);
-        doctor_appointments.Remove(aid);
-        cout << "Đã xóa lịch hẹn " << aid << " thành công." << endl;
-    }
-
-    void ChinhSuaLichHen(const string& aid, time_t new_time, const string& new_doctor_id) {
-        shared_ptr<Appointment>* app = appointments.Find(aid);
-        if (!app || !(*app)) throw runtime_error("Không tìm thấy lịch hẹn");
-        if (!KiemTraThoiGianTrong(new_doctor_id, new_time)) {
-            throw runtime_error("Bác sĩ mới không trống tại thời gian này");
-        }
-        (*app)->is_valid = false;
-        schedule.Remove(aid);
-        doctor_appointments.Remove(aid);
-        // Cập nhật lịch bác sĩ
-        auto* old_doc_schedule = doctor_schedules.Find((*app)->doctor_id);
-        if (old_doc_schedule) {
-            old_doc_schedule->erase(
-                remove_if(old_doc_schedule->begin(), old_doc_schedule->end(),
-                    [&](const shared_ptr<Appointment>& a) { return a->appointment_id == aid; }),
-                old_doc_schedule->end());
-        }
-        auto* new_doc_schedule = doctor_schedules.Find(new_doctor_id);
-        if (!new_doc_schedule) {
-            vector<shared_ptr<Appointment>> new_schedule;
-            new_schedule.push_back(*app);
-            doctor_schedules.Insert(new_doctor_id, new_schedule);
+        catch (const LoiLichHen& e) {
+            code = e.code;
+            message = e.what();
         }
-        else {
-            new_doc_schedule->push_back(*app);
+        catch (const exception& e) {
+            code = MaLoi::HeThong;
+            message = e.what();
         }
-        // Cập nhật thông tin lịch hẹn
-        (*app)->time = new_time;
-        (*app)->doctor_id = new_doctor_id;
-        (*app)->is_valid = true;
-        schedule.Insert(*app);
-        reminders.Push(*app);
-        doctor_appointments.Append(*app);
-        cout << "Đã chỉnh sửa lịch hẹn " << aid << " thành công." << endl;
+        executed++;
+        if (code != MaLoi::ThanhCong) failures++;
+        out << '#' << line_number << ' ' << (int)code << ' ' << KyHieuMaLoi(code);
+        if (!message.empty()) out << ' ' << message;
+        out << '\n';
+        after_command();
+    }
+    return failures;
+}
+
+// Loại yêu cầu của chế độ máy chủ, mỗi loại ứng với một mục của menu
+enum class LoaiYeuCau : uint8_t {
+    ThemLichHen = 1,
+    XoaLichHen = 2,
+    ChinhSuaLichHen = 3,
+    XacNhanLichHen = 4,
+    TimTheoID = 5,
+    TheoBenhNhan = 6,
+    TheoBacSi = 7,
+    TheoThoiGian = 8,
+    NhacNho = 9,
+    TrongNgay = 10
+};
+
+// Giao thức nhị phân của chế độ máy chủ: nội dung mã hóa bằng ByteWriter (little-endian, chuỗi có độ dài
+// 16 bit đứng trước), mỗi yêu cầu và trả lời là một khung của request_server.h. Thời gian trên dây là số
+// giây kể từ epoch (UTC). Yêu cầu: [mã yêu cầu u32][loại u8] rồi tham số theo loại:
+//   ThemLichHen      lịch hẹn, bệnh nhân, bác sĩ, thời gian i64, đã xác nhận u8, phút u16 (0: mặc định)
+//   XoaLichHen       lịch hẹn, là bác sĩ u8, ID người xóa
+//   ChinhSuaLichHen  lịch hẹn, bác sĩ mới, thời gian i64
+//   XacNhanLichHen   lịch hẹn, bác sĩ, xác nhận u8
+//   TimTheoID        lịch hẹn              TheoBenhNhan    bệnh nhân
+//   TheoBacSi        bác sĩ, bỏ qua u32, tối đa u32 (0: tất cả)
+//   TheoThoiGian     từ i64, đến i64       NhacNho         số giờ u8 (1 hoặc 24)      TrongNgay
+// Trả lời: [mã yêu cầu u32][MaLoi u8], rồi thông báo lỗi nếu mã khác ThanhCong, hoặc [số dòng u32] và mỗi
+// dòng [lịch hẹn][bệnh nhân][bác sĩ][thời gian i64][TrangThai u8][phút u16]. Thao tác ghi trả về 0 dòng.
+struct YeuCau {
+    uint32_t request_id; // khách tự đặt, trả lời mang lại nguyên giá trị
+    LoaiYeuCau type;
+    string appointment_id;
+    string patient_id;
+    string doctor_id;
+    string user_id; // người xóa
+    int64_t time; // thời gian hẹn, hoặc đầu khoảng
+    int64_t end;
+    uint8_t flag; // đã xác nhận, là bác sĩ, xác nhận hoặc số giờ nhắc tùy loại
+    uint16_t minutes;
+    uint32_t offset;
+    uint32_t limit;
+    YeuCau() : request_id(0), type(LoaiYeuCau::TrongNgay), time(0), end(0), flag(0), minutes(0), offset(0), limit(0) {}
+};
+
+inline void GhiYeuCau(ByteWriter& w, const YeuCau& q) {
+    w.U32(q.request_id);
+    w.U8((uint8_t)q.type);
+    switch (q.type) {
+    case LoaiYeuCau::ThemLichHen:
+        w.Str(q.appointment_id);
+        w.Str(q.patient_id);
+        w.Str(q.doctor_id);
+        w.I64(q.time);
+        w.U8(q.flag);
+        w.U16(q.minutes);
+        break;
+    case LoaiYeuCau::XoaLichHen:
+        w.Str(q.appointment_id);
+        w.U8(q.flag);
+        w.Str(q.user_id);
+        break;
+    case LoaiYeuCau::ChinhSuaLichHen:
+        w.Str(q.appointment_id);
+        w.Str(q.doctor_id);
+        w.I64(q.time);
+        break;
+    case LoaiYeuCau::XacNhanLichHen:
+        w.Str(q.appointment_id);
+        w.Str(q.doctor_id);
+        w.U8(q.flag);
+        break;
+    case LoaiYeuCau::TimTheoID:
+        w.Str(q.appointment_id);
+        break;
+    case LoaiYeuCau::TheoBenhNhan:
+        w.Str(q.patient_id);
+        break;
+    case LoaiYeuCau::TheoBacSi:
+        w.Str(q.doctor_id);
+        w.U32(q.offset);
+        w.U32(q.limit);
+        break;
+    case LoaiYeuCau::TheoThoiGian:
+        w.I64(q.time);
+        w.I64(q.end);
+        break;
+    case LoaiYeuCau::NhacNho:
+        w.U8(q.flag);
+        break;
+    case LoaiYeuCau::TrongNgay:
+        break;
     }
+}
 
-    void XacNhanLichHen(const string& aid, const string& doctor_id, bool confirm) {
-        shared_ptr<Appointment>* app = appointments.Find(aid);
-        if (!app || !(*app)) throw runtime_error("Không tìm thấy lịch hẹn");
-        if ((*app)->doctor_id != doctor_id) {
-            throw runtime_error("Bạn không phải bác sĩ của lịch hẹn này");
+// Lỗi định dạng là lỗi cú pháp; q.request_id đã có ngay khi đọc được 4 byte đầu để trả lời lỗi
+inline void DocYeuCau(ByteReader& r, YeuCau& q) {
+    try {
+        q.request_id = r.U32();
+        uint8_t type = r.U8();
+        if (type < (uint8_t)LoaiYeuCau::ThemLichHen || type > (uint8_t)LoaiYeuCau::TrongNgay) {
+            throw LoiLichHen(MaLoi::CuPhap, "Loại yêu cầu không hợp lệ: " + to_string(type));
         }
-        if ((*app)->status == "bị từ chối") {
-            throw runtime_error("Lịch hẹn đã bị từ chối trước đó");
+        q.type = (LoaiYeuCau)type;
+        switch (q.type) {
+        case LoaiYeuCau::ThemLichHen:
+            q.appointment_id = r.Str();
+            q.patient_id = r.Str();
+            q.doctor_id = r.Str();
+            q.time = r.I64();
+            q.flag = r.U8();
+            q.minutes = r.U16();
+            break;
+        case LoaiYeuCau::XoaLichHen:
+            q.appointment_id = r.Str();
+            q.flag = r.U8();
+            q.user_id = r.Str();
+            break;
+        case LoaiYeuCau::ChinhSuaLichHen:
+            q.appointment_id = r.Str();
+            q.doctor_id = r.Str();
+            q.time = r.I64();
+            break;
+        case LoaiYeuCau::XacNhanLichHen:
+            q.appointment_id = r.Str();
+            q.doctor_id = r.Str();
+            q.flag = r.U8();
+            break;
+        case LoaiYeuCau::TimTheoID:
+            q.appointment_id = r.Str();
+            break;
+        case LoaiYeuCau::TheoBenhNhan:
+            q.patient_id = r.Str();
+            break;
+        case LoaiYeuCau::TheoBacSi:
+            q.doctor_id = r.Str();
+            q.offset = r.U32();
+            q.limit = r.U32();
+            break;
+        case LoaiYeuCau::TheoThoiGian:
+            q.time = r.I64();
+            q.end = r.I64();
+            break;
+        default:
+            if (q.type == LoaiYeuCau::NhacNho) q.flag = r.U8();
+            break;
         }
-        (*app)->status = confirm ? "đã xác nhận" : "bị từ chối";
-        (*app)->is_valid = confirm;
-        cout << "Lịch hẹn " << aid << " đã được " << (confirm ? "xác nhận" : "từ chối") << "." << endl;
+    }
+    catch (const LoiLichHen&) {
+        throw;
+    }
+    catch (const runtime_error&) {
+        throw LoiLichHen(MaLoi::CuPhap, "Yêu cầu bị cắt cụt");
+    }
+    if (r.pos != r.size) throw LoiLichHen(MaLoi::CuPhap, "Yêu cầu có byte thừa");
+}
+
+// Thực hiện yêu cầu của chế độ máy chủ trên ConcurrentAppointmentSystem dùng chung, kiểm tra tham số như
+// ThucHienLenh. Không có khóa riêng: các luồng xử lý gọi thẳng vào hệ thống, nên đặt lịch cho bác sĩ ở
+// các phân vùng khác nhau chạy song song, tìm theo ID và truy vấn theo thời gian không khóa.
+// after_command chạy sau mỗi thao tác ghi thành công, như sau mỗi lệnh của chế độ chạy lô, và có thể
+// chạy đồng thời ở nhiều luồng.
+class MayChuLichHen {
+private:
+    ConcurrentAppointmentSystem& system;
+    function<void()> after_command;
+
+    static time_t ThoiGianLuuTru(int64_t epoch) {
+        return (time_t)(epoch - VIETNAM_TZ_OFFSET);
+    }
+
+    static void KiemTraCo(uint8_t flag) {
+        if (flag > 1) throw LoiLichHen(MaLoi::KhongHopLe, "Giá trị phải là 0 hoặc 1: " + to_string(flag));
+    }
+
+    // Dòng từ một phân vùng, ID số đổi ra chuỗi qua phân vùng đó
+    static void GhiDong(ByteWriter& response, const AppointmentSystem& shard, const Appointment& app) {
+        response.Str(shard.IDLichHen(app.appointment_id));
+        response.Str(shard.IDBenhNhan(app.patient_id));
+        response.Str(shard.IDBacSi(app.doctor_id));
+        response.I64((int64_t)app.time + VIETNAM_TZ_OFFSET);
+        response.U8((uint8_t)app.status);
+        response.U16(app.duration);
+    }
+
+    // Dòng từ bảng ID hoặc chỉ mục thời gian không khóa
+    static void GhiDong(ByteWriter& response, const LichHenTomTat& entry) {
+        response.Str(entry.appointment_id);
+        response.Str(entry.patient_id);
+        response.Str(entry.doctor_id);
+        response.I64((int64_t)entry.time + VIETNAM_TZ_OFFSET);
+        response.U8((uint8_t)entry.status);
+        response.U16(entry.duration);
+    }
+
+    // [số dòng] rồi các dòng query đưa cho visit (dạng nào GhiDong cũng nhận); số dòng được điền sau
+    // khi duyệt xong
+    template <typename TQuery>
+    void TraDanhSach(ByteWriter& response, TQuery query) {
+        size_t at = response.bytes.size();
+        response.U32(0);
+        uint32_t count = 0;
+        query([&](const auto&... row) {
+            GhiDong(response, row...);
+            count++;
+        });
+        for (int i = 0; i < 4; i++) response.bytes[at + i] = (char)(count >> (8 * i));
     }
 
-    shared_ptr<Appointment> TimLichHen(const string& aid) {
-        shared_ptr<Appointment>* app = appointments.Find(aid);
-        if (!app || !(*app) || !(*app)->is_valid || (*app)->appointment_id != aid) {
-            cout << "Không tìm thấy lịch hẹn " << aid << "." << endl;
-            return nullptr;
+    void ThucHienGhi(const YeuCau& q) {
+        switch (q.type) {
+        case LoaiYeuCau::ThemLichHen: {
+            KiemTraIDLenh(q.appointment_id, "lịch hẹn");
+            KiemTraIDLenh(q.patient_id, "bệnh nhân");
+            KiemTraIDLenh(q.doctor_id, "bác sĩ");
+            time_t time = ThoiGianLuuTru(q.time);
+            KiemTraTuongLai(time);
+            KiemTraCo(q.flag);
+            system.ThemLichHen(q.appointment_id, q.patient_id, q.doctor_id, time, q.flag ? "đã xác nhận" : "đang chờ",
+                q.minutes);
+            break;
+        }
+        case LoaiYeuCau::XoaLichHen:
+            KiemTraCo(q.flag);
+            system.XoaLichHen(q.appointment_id, q.user_id, q.flag != 0);
+            break;
+        case LoaiYeuCau::ChinhSuaLichHen: {
+            KiemTraIDLenh(q.appointment_id, "lịch hẹn");
+            KiemTraIDLenh(q.doctor_id, "bác sĩ");
+            time_t time = ThoiGianLuuTru(q.time);
+            KiemTraTuongLai(time);
+            system.ChinhSuaLichHen(q.appointment_id, time, q.doctor_id);
+            break;
+        }
+        default:
+            KiemTraCo(q.flag);
+            system.XacNhanLichHen(q.appointment_id, q.doctor_id, q.flag != 0);
+            break;
         }
-        return *app;
     }
 
-    void TimLichHenTheoBenhNhan(const string& pid) {
-        auto* schedule = patient_schedules.Find(pid);
-        if (!schedule || schedule->empty()) {
-            cout << "Không tìm thấy lịch hẹn nào cho bệnh nhân " << pid << "." << endl;
-            return;
+    void TruyVan(const YeuCau& q, ByteWriter& response) {
+        switch (q.type) {
+        case LoaiYeuCau::TimTheoID: {
+            response.U32(1);
+            bool found = system.TimLichHen(q.appointment_id, [&](const LichHenTomTat& entry) {
+                GhiDong(response, entry);
+            });
+            if (!found) throw LoiLichHen(MaLoi::KhongTimThay, "Không tìm thấy lịch hẹn " + q.appointment_id);
+            break;
         }
-        for (const auto& app : *schedule) {
-            if (app->is_valid) {
-                cout << "Lịch hẹn " << app->appointment_id
-                    << " với bác sĩ " << app->doctor_id
-                    << " vào lúc " << toVietnamTime(app->time)
-                    << ", trạng thái: " << app->status << endl;
+        case LoaiYeuCau::TheoBenhNhan:
+            TraDanhSach(response, [&](const auto& visit) {
+                system.DuyetLichHenCuaBenhNhan(q.patient_id, visit);
+            });
+            break;
+        case LoaiYeuCau::TheoBacSi:
+            if (q.offset > (uint32_t)numeric_limits<int>::max() || q.limit > (uint32_t)numeric_limits<int>::max()) {
+                throw LoiLichHen(MaLoi::KhongHopLe, "Vị trí hoặc số lượng trang không hợp lệ");
             }
+            TraDanhSach(response, [&](const auto& visit) {
+                system.DuyetLichHenCuaBacSi(q.doctor_id, numeric_limits<time_t>::min(), (int)q.offset,
+                    q.limit ? (int)q.limit : -1, visit);
+            });
+            break;
+        case LoaiYeuCau::TheoThoiGian:
+            TraDanhSach(response, [&](const auto& visit) {
+                system.DuyetLichHenTheoThoiGian(ThoiGianLuuTru(q.time), ThoiGianLuuTru(q.end), visit);
+            });
+            break;
+        case LoaiYeuCau::NhacNho:
+            if (q.flag != 1 && q.flag != 24) throw LoiLichHen(MaLoi::KhongHopLe, "Khoảng nhắc nhở chỉ được là 1 hoặc 24");
+            TraDanhSach(response, [&](const auto& visit) {
+                system.DuyetNhacNho(q.flag, visit);
+            });
+            break;
+        default: {
+            time_t start = VietnamDayStart(getCurrentTime() - VIETNAM_TZ_OFFSET);
+            TraDanhSach(response, [&](const auto& visit) {
+                system.DuyetLichHenTheoThoiGian(start, start + 86400, visit);
+            });
+            break;
+        }
         }
     }
 
-    void TimLichHenTheoBacSi(const string& did) {
-        auto result = doctor_appointments.FindByDoctor(did);
-        if (result.empty()) {
-            cout << "Không tìm thấy lịch hẹn nào cho bác sĩ " << did << "." << endl;
-            return;
+    // Thao tác ghi đã được ghi nhật ký và áp dụng: lỗi dọn dẹp hay chụp ảnh chỉ được báo ở máy chủ, không
+    // được biến trả lời thành công thành lỗi khiến khách thử lại một lịch hẹn đã đặt được
+    void SauThaoTacGhi() {
+        try {
+            after_command();
         }
-        for (const auto& app : result) {
-            cout << "Lịch hẹn " << app->appointment_id
-                << " với bệnh nhân " << app->patient_id
-                << " vào lúc " << toVietnamTime(app->time)
-                << ", trạng thái: " << app->status << endl;
+        catch (const exception& e) {
+            cerr << "Lỗi dọn dẹp sau yêu cầu: " << e.what() << endl;
         }
     }
 
-    void TimLichHenTheoThoiGian(const string& start_datetime, const string& end_datetime) {
-        time_t start = parseDateTime(start_datetime);
-        time_t end = parseDateTime(end_datetime);
-        if (difftime(end, start) < 0) {
-            throw runtime_error("Thời gian kết thúc phải sau thời gian bắt đầu");
+public:
+    MayChuLichHen(ConcurrentAppointmentSystem& appointment_system, const function<void()>& after)
+        : system(appointment_system), after_command(after) {}
+
+    // RequestHandler của máy chủ: luôn ghi đúng một trả lời, trả về true nếu là thao tác ghi
+    bool XuLy(ByteReader& request, ByteWriter& response) {
+        size_t start = response.bytes.size();
+        YeuCau q;
+        bool write = false;
+        MaLoi code = MaLoi::ThanhCong;
+        string message;
+        try {
+            DocYeuCau(request, q);
+            write = q.type <= LoaiYeuCau::XacNhanLichHen;
+            response.U32(q.request_id);
+            response.U8((uint8_t)MaLoi::ThanhCong);
+            if (write) {
+                ThucHienGhi(q);
+                response.U32(0);
+                SauThaoTacGhi();
+            }
+            else {
+                TruyVan(q, response);
+            }
         }
-        auto result = schedule.FindByTimeRange(start, end);
-        if (result.empty()) {
-            cout << "Không tìm thấy lịch hẹn nào trong khoảng thời gian từ "
-                << toVietnamTime(start) << " đến " << toVietnamTime(end) << "." << endl;
-            return;
+        catch (const LoiLichHen& e) {
+            code = e.code;
+            message = e.what();
         }
-        for (const auto& app : result) {
-            cout << "Lịch hẹn " << app->appointment_id
-                << " với bệnh nhân " << app->patient_id
-                << ", bác sĩ " << app->doctor_id
-                << " vào lúc " << toVietnamTime(app->time)
-                << ", trạng thái: " << app->status << endl;
+        catch (const exception& e) {
+            code = MaLoi::HeThong;
+            message = e.what();
         }
+        if (code != MaLoi::ThanhCong) {
+            // Bỏ các dòng đã ghi dở
+            response.bytes.resize(start);
+            response.U32(q.request_id);
+            response.U8((uint8_t)code);
+            response.Str(message);
+        }
+        return write;
     }
+};
 
-    void LietKeLichHenTrongNgay() {
-        time_t now = getCurrentTime();
-        struct tm timeinfo;
-        localtime_s(&timeinfo, &now);
-        timeinfo.tm_hour = 0;
-        timeinfo.tm_min = 0;
-        timeinfo.tm_sec = 0;
-        time_t start = mktime(&timeinfo) - VIETNAM_TZ_OFFSET;
-        time_t end = start + 86400; // 1 ngày
-        auto result = schedule.FindByTimeRange(start, end);
-        if (result.empty()) {
-            cout << "Không có lịch hẹn nào trong ngày hôm nay (" << toVietnamTime(start) << ")." << endl;
-            return;
+// Đo thông lượng của ConcurrentAppointmentSystem với tải trộn đọc/ghi từ 1 tới 32 luồng, so với cùng tải
+// trên 1 phân vùng và 1 khóa ID (tương đương một khóa đọc-ghi chung). Dữ liệu nạp sẵn 100000 lịch hẹn
+// của 1000 bác sĩ và 20000 bệnh nhân; mỗi luồng: 50% kiểm tra ID, 20% tìm theo ID, 8% lịch của bệnh
+// nhân, 2% lịch trong 1 giờ, 12% thêm, 4% chỉnh sửa và 4% xóa lịch hẹn do chính luồng đó thêm.
+void ChayThuDongThoi(int total_ops) {
+    const int doctors = 1000;
+    const int patients = 20000;
+    const int preload = 100000;
+    const time_t base = parseDateTime("01-01-2031 08:00");
+    auto measure = [&](int shard_count, int id_lock_total, int threads) {
+        ConcurrentAppointmentSystem system(shard_count, id_lock_total);
+        for (int i = 0; i < preload; i++) {
+            system.ThemLichHen("A" + to_string(i), "P" + to_string(i % patients), "D" + to_string(i % doctors),
+                base + (time_t)(i / doctors) * 1800, "đang chờ");
         }
-        cout << "Lịch hẹn trong ngày hôm nay (" << toVietnamTime(start) << "):" << endl;
-        for (const auto& app : result) {
-            cout << "Lịch hẹn " << app->appointment_id
-                << " với bệnh nhân " << app->patient_id
-                << ", bác sĩ " << app->doctor_id
-                << " vào lúc " << toVietnamTime(app->time)
-                << ", trạng thái: " << app->status << endl;
+        int per_thread = total_ops / threads;
+        atomic<int> ready(0);
+        atomic<bool> go(false);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                mt19937 rng(t + 1);
+                auto noop = [](const AppointmentSystem&, const Appointment&) {};
+                auto noop_summary = [](const LichHenTomTat&) {};
+                auto slot = [&]() { return base + (time_t)(100 + rng() % 100000) * 1800; };
+                vector<pair<string, string>> own; // lịch hẹn luồng này đã thêm: ID, bệnh nhân
+                int created = 0;
+                ready++;
+                while (!go) this_thread::yield();
+                for (int k = 0; k < per_thread; k++) {
+                    int kind = rng() % 100;
+                    try {
+                        if (kind < 50) {
+                            system.KiemTraIDTonTai("A" + to_string(rng() % preload));
+                        }
+                        else if (kind < 70) {
+                            system.TimLichHen("A" + to_string(rng() % preload), noop_summary);
+                        }
+                        else if (kind < 78) {
+                            system.DuyetLichHenCuaBenhNhan("P" + to_string(rng() % patients), noop);
+                        }
+                        else if (kind < 80) {
+                            time_t start = base + (time_t)(rng() % 100) * 1800;
+                            system.DuyetLichHenTheoThoiGian(start, start + 3600, noop_summary);
+                        }
+                        else if (kind < 92) {
+                            string aid = "T" + to_string(t) + "x" + to_string(created++);
+                            string pid = "P" + to_string(rng() % patients);
+                            system.ThemLichHen(aid, pid, "D" + to_string(rng() % doctors), slot(), "đang chờ");
+                            own.push_back(make_pair(aid, pid));
+                        }
+                        else if (kind < 96) {
+                            if (own.empty()) continue;
+                            system.ChinhSuaLichHen(own[rng() % own.size()].first, slot(), "D" + to_string(rng() % doctors));
+                        }
+                        else {
+                            if (own.empty()) continue;
+                            size_t pick = rng() % own.size();
+                            swap(own[pick], own.back());
+                            system.XoaLichHen(own.back().first, own.back().second, false);
+                            own.pop_back();
+                        }
+                    }
+                    catch (const LoiLichHen&) {
+                        // Xung đột lịch là một phần của tải
+                    }
+                }
+            });
         }
+        while (ready < threads) this_thread::yield();
+        auto started = chrono::steady_clock::now();
+        go = true;
+        for (thread& worker : workers) worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return seconds > 0 ? per_thread * threads / seconds : 0;
+    };
+
+    cout << "Số lõi: " << thread::hardware_concurrency() << ", " << total_ops << " thao tác mỗi lần đo." << endl;
+    // setw đếm byte nên tiêu đề tiếng Việt được căn sẵn
+    cout << "Luồng   Phân vùng (tt/giây)   Khóa chung (tt/giây)  Tăng tốc so với 1 luồng" << endl;
+    double first = 0;
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        double sharded = measure(CONCURRENT_SHARDS, CONCURRENT_ID_LOCKS, threads);
+        double global = measure(1, 1, threads);
+        if (threads == 1) first = sharded;
+        cout << left << setw(8) << threads << setw(22) << (long long)sharded << setw(22) << (long long)global
+            << fixed << setprecision(2) << (first > 0 ? sharded / first : 0) << "x" << endl;
     }
+}
 
-    void GuiNhacNho(int hours_before) {
-        bool has_reminders = false;
-        vector<shared_ptr<Appointment>> temp_reminders;
+// Đo khả năng mở rộng của tra cứu ID: n luồng đọc tra ID ngẫu nhiên trong khi một luồng ghi liên tục
+// thêm, sửa và xóa, so giữa ConcurrentHashmap và Hashmap đặt sau một khóa đọc-ghi chung (cách bảng
+// ID cũ làm). Luồng đọc kiểm tra bất biến trên mỗi giá trị đọc được; chạy được dưới ThreadSanitizer:
+//   g++ -std=c++14 -O1 -g -fsanitize=thread -pthread ... rồi chạy --thu-bang-bam 200000
+void ChayThuBangBam(int total_ops) {
+    const uint64_t stable = 100000; // ID "S<i>" luôn có mặt, giá trị % stable == i
+    const int churn_window = 1000;  // số ID "C<n>" tồn tại cùng lúc, giá trị == n
+    atomic<long long> violations(0);
 
-        while (!reminders.IsEmpty()) {
-            auto app = reminders.Pop();
-            if (app && app->is_valid) {
-                temp_reminders.push_back(app);
-            }
+    auto run = [&](bool lock_free, int readers) {
+        ConcurrentHashmap<uint64_t> concurrent_map;
+        Hashmap<uint64_t> locked_map;
+        shared_timed_mutex map_lock;
+        for (uint64_t i = 0; i < stable; i++) {
+            if (lock_free) concurrent_map.Insert("S" + to_string(i), i);
+            else locked_map.Insert("S" + to_string(i), i);
         }
+        // Trả về true nếu có ID, value nhận bản sao giá trị
+        auto lookup = [&](const string& key, uint64_t& value) {
+            if (lock_free) return concurrent_map.Get(key, value);
+            shared_lock<shared_timed_mutex> guard(map_lock);
+            const uint64_t* found = locked_map.Find(key);
+            if (found) value = *found;
+            return found != nullptr;
+        };
+        auto write = [&](int kind, const string& key, uint64_t value) {
+            if (lock_free) {
+                if (kind == 0) concurrent_map.Insert(key, value);
+                else if (kind == 1) concurrent_map.Assign(key, value);
+                else concurrent_map.Remove(key);
+                return;
+            }
+            unique_lock<shared_timed_mutex> guard(map_lock);
+            if (kind == 0) locked_map.Insert(key, value);
+            else if (kind == 1) *locked_map.Find(key) = value;
+            else locked_map.Remove(key);
+        };
 
-        sort(temp_reminders.begin(), temp_reminders.end(),
-            [](const shared_ptr<Appointment>& a, const shared_ptr<Appointment>& b) {
-                return a->time < b->time;
+        int per_reader = total_ops / readers;
+        atomic<int> ready(0);
+        atomic<bool> go(false);
+        atomic<bool> stop(false);
+        atomic<long long> writes(0);
+        thread writer([&]() {
+            mt19937_64 rng(99);
+            uint64_t next = 0, version = 0;
+            ready++;
+            while (!go) this_thread::yield();
+            while (!stop.load(memory_order_relaxed)) {
+                write(0, "C" + to_string(next), next);
+                if (next >= (uint64_t)churn_window) write(2, "C" + to_string(next - churn_window), 0);
+                next++;
+                uint64_t i = rng() % stable;
+                write(1, "S" + to_string(i), ++version * stable + i);
+                writes += 2;
+            }
+        });
+        vector<thread> workers;
+        for (int t = 0; t < readers; t++) {
+            workers.emplace_back([&, t]() {
+                mt19937_64 rng(t + 1);
+                long long bad = 0;
+                ready++;
+                while (!go) this_thread::yield();
+                for (int k = 0; k < per_reader; k++) {
+                    uint64_t value = 0;
+                    if (k % 4 != 3) {
+                        uint64_t i = rng() % stable;
+                        if (!lookup("S" + to_string(i), value) || value % stable != i) bad++;
+                    }
+                    else {
+                        uint64_t n = rng() % (stable / 10);
+                        if (lookup("C" + to_string(n), value) && value != n) bad++;
+                    }
+                }
+                violations += bad;
             });
+        }
+        while (ready < readers + 1) this_thread::yield();
+        auto started = chrono::steady_clock::now();
+        go = true;
+        for (thread& worker : workers) worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        stop = true;
+        writer.join();
+        size_t size = lock_free ? concurrent_map.Size() : locked_map.Size();
+        if (size < stable || size > stable + churn_window) violations++;
+        return make_pair(seconds > 0 ? per_reader * readers / seconds : 0, seconds > 0 ? writes / seconds : 0);
+    };
 
-        time_t now = getCurrentTime();
-        time_t threshold = hours_before * 3600;
+    cout << "Số lõi: " << thread::hardware_concurrency() << ", " << total_ops << " lần tra mỗi lần đo, 1 luồng ghi." << endl;
+    cout << "Luồng đọc  Không khóa (tra/giây)  Khóa chung (tra/giây)  Ghi song song (tt/giây)" << endl;
+    for (int readers = 1; readers <= 32; readers *= 2) {
+        pair<double, double> lock_free = run(true, readers);
+        pair<double, double> locked = run(false, readers);
+        cout << left << setw(11) << readers << setw(23) << (long long)lock_free.first << setw(23)
+            << (long long)locked.first << (long long)lock_free.second << " / " << (long long)locked.second << endl;
+    }
+    EpochDomain::Global().Collect();
+    cout << "Vi phạm bất biến: " << violations << ", đối tượng chờ thu hồi: " << EpochDomain::Global().PendingCount() << endl;
+    if (violations) throw runtime_error("Bảng băm đồng thời trả về giá trị sai");
+}
 
-        for (const auto& app : temp_reminders) {
-            time_t appointmentTime = app->time + VIETNAM_TZ_OFFSET;
-            if (appointmentTime > now && difftime(appointmentTime, now) <= threshold) {
-                cout << "Nhắc nhở: Lịch hẹn " << app->appointment_id
-                    << " với bệnh nhân " << app->patient_id
-                    << ", bác sĩ " << app->doctor_id
-                    << " vào lúc " << toVietnamTime(app->time)
-                    << ", trạng thái: " << app->status << endl;
-                has_reminders = true;
-            }
-        }
+// Đo ảnh hưởng của báo cáo dài lên thao tác ghi: 4 luồng dời lịch (ChinhSuaLichHen) trên 100000 lịch
+// hẹn trải đều một quý, lần đầu chạy riêng, lần sau kèm một luồng lặp lại báo cáo cả quý qua
+// DuyetLichHenTheoThoiGian. Dời lịch không đổi tập lịch hẹn, nên mỗi báo cáo phải thấy đúng 100000 lịch
+// hẹn theo thứ tự thời gian với cùng tập ID; báo cáo bị xé sẽ thiếu hoặc lặp lịch hẹn đang dời.
+void ChayThuBaoCao(int total_ops) {
+    const int doctors = 1000;
+    const int patients = 20000;
+    const int preload = 100000;
+    const int writers = 4;
+    const time_t base = parseDateTime("01-01-2031 08:00");
+    const time_t quarter = 90 * 24 * 3600;
+    uint64_t expected_ids = 0; // XOR băm các ID, không đổi khi chỉ dời lịch
+    for (int i = 0; i < preload; i++) expected_ids ^= HashKey("A" + to_string(i));
 
-        for (const auto& app : temp_reminders) {
-            reminders.Push(app);
+    auto run = [&](bool with_report) {
+        ConcurrentAppointmentSystem system;
+        for (int i = 0; i < preload; i++) {
+            system.ThemLichHen("A" + to_string(i), "P" + to_string(i % patients), "D" + to_string(i % doctors),
+                base + (time_t)(i % 4320) * 1800, "đang chờ");
+        }
+        int per_writer = total_ops / writers;
+        vector<vector<double>> latencies(writers);
+        atomic<int> running(writers);
+        atomic<bool> go(false);
+        vector<thread> workers;
+        for (int t = 0; t < writers; t++) {
+            workers.emplace_back([&, t]() {
+                mt19937 rng(t + 1);
+                latencies[t].reserve(per_writer);
+                while (!go) this_thread::yield();
+                for (int k = 0; k < per_writer; k++) {
+                    string aid = "A" + to_string(rng() % preload);
+                    time_t slot = base + (time_t)(rng() % 4320) * 1800;
+                    string did = "D" + to_string(rng() % doctors);
+                    auto started = chrono::steady_clock::now();
+                    try {
+                        system.ChinhSuaLichHen(aid, slot, did);
+                    }
+                    catch (const LoiLichHen&) {
+                        // Xung đột lịch là một phần của tải
+                    }
+                    latencies[t].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - started).count());
+                }
+                running--;
+            });
         }
+        long long reports = 0, torn = 0;
+        double report_ms = 0;
+        auto started = chrono::steady_clock::now();
+        go = true;
+        while (with_report && running > 0) {
+            auto report_started = chrono::steady_clock::now();
+            size_t rows = 0;
+            uint64_t ids = 0;
+            time_t last = 0;
+            bool ordered = true;
+            system.DuyetLichHenTheoThoiGian(base, base + quarter, [&](const LichHenTomTat& entry) {
+                if (entry.time < last) ordered = false;
+                last = entry.time;
+                ids ^= HashKey(entry.appointment_id);
+                rows++;
+            });
+            report_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - report_started).count();
+            reports++;
+            if (rows != (size_t)preload || ids != expected_ids || !ordered) torn++;
+        }
+        for (thread& worker : workers) worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
 
-        if (!has_reminders) {
-            cout << "Không có lịch hẹn nào cần nhắc nhở trong " << hours_before << " giờ tới." << endl;
+        vector<double> all;
+        for (const vector<double>& part : latencies) all.insert(all.end(), part.begin(), part.end());
+        sort(all.begin(), all.end());
+        auto at = [&all](double q) { return all.empty() ? 0 : all[min(all.size() - 1, (size_t)(q * all.size()))]; };
+        cout << left << (with_report ? "Có báo cáo    " : "Không         ") << setw(14)
+            << (long long)(seconds > 0 ? all.size() / seconds : 0) << fixed << setprecision(1) << setw(10) << at(0.5)
+            << setw(10) << at(0.99) << setw(12) << (all.empty() ? 0 : all.back());
+        if (with_report) {
+            cout << reports << " lần, " << (reports ? report_ms / reports : 0) << " ms/lần, " << torn << " bị xé";
         }
+        cout << endl;
+        if (torn) throw runtime_error("Báo cáo thấy trạng thái không nhất quán");
+    };
+
+    cout << "Số lõi: " << thread::hardware_concurrency() << ", " << writers << " luồng dời lịch, "
+        << total_ops << " lần dời lịch mỗi lần đo." << endl;
+    // setw đếm byte nên tiêu đề và nhãn tiếng Việt được căn sẵn
+    cout << "Báo cáo       Ghi (tt/giây) p50 (µs)  p99 (µs)  max (µs)    Báo cáo cả quý" << endl;
+    run(false);
+    run(true);
+}
+
+#ifdef __linux__
+// Khách đo tải cho chế độ máy chủ: connections kết nối song song, mỗi kết nối giữ tối đa depth yêu cầu
+// chưa có trả lời (pipelining), tổng cộng total yêu cầu. Trên mỗi kết nối: 10% thêm lịch hẹn với ID riêng
+// của lần đo, 5% dời lịch và 50% tìm một lịch hẹn chính kết nối đó đã thêm, 15% lịch của bệnh nhân, 10%
+// lịch trong 1 giờ, 10% 20 lịch hẹn đầu của bác sĩ. Độ trễ tính từ lúc gửi yêu cầu tới lúc nhận trả lời.
+void ChayTaiThu(const string& address, int total, int connections, int depth) {
+    const int doctors = 1000;
+    const int patients = 20000;
+    // Thời gian trên dây là epoch: các ô 30 phút trong 90 ngày, bắt đầu từ 30 ngày sau
+    const int64_t base = ((int64_t)getCurrentTime() / 86400 + 30) * 86400;
+    const string tag = "T" + to_string((long long)(chrono::system_clock::now().time_since_epoch().count() % 100000000));
+    vector<vector<double>> latencies(connections);
+    vector<vector<long long>> codes(connections, vector<long long>((int)MaLoi::HeThong + 1));
+    vector<string> errors(connections);
+    atomic<int> connected(0);
+    atomic<bool> go(false);
+    vector<thread> workers;
+    for (int c = 0; c < connections; c++) {
+        workers.emplace_back([&, c]() {
+            unique_ptr<RequestClient> client;
+            try {
+                client.reset(new RequestClient(address));
+            }
+            catch (const exception& e) {
+                errors[c] = e.what();
+            }
+            connected++;
+            if (!client) return;
+            while (!go) this_thread::yield();
+            try {
+                mt19937 rng(c + 1);
+                int quota = total / connections + (c < total % connections ? 1 : 0);
+                latencies[c].reserve(quota);
+                vector<chrono::steady_clock::time_point> started(depth);
+                vector<string> added;
+                int sent = 0, received = 0;
+                string frames;
+                ByteWriter body;
+                auto fill = [&]() {
+                    frames.clear();
+                    auto now = chrono::steady_clock::now();
+                    while (sent < quota && sent - received < depth) {
+                        YeuCau q;
+                        q.request_id = (uint32_t)sent;
+                        int pick = rng() % 100;
+                        if (pick < 10 || added.empty()) {
+                            q.type = LoaiYeuCau::ThemLichHen;
+                            q.appointment_id = tag + "C" + to_string(c) + "N" + to_string(sent);
+                            q.patient_id = tag + "P" + to_string(rng() % patients);
+                            q.doctor_id = tag + "D" + to_string(rng() % doctors);
+                            q.time = base + (int64_t)(rng() % 4320) * 1800;
+                            added.push_back(q.appointment_id);
+                        }
+                        else if (pick < 15) {
+                            q.type = LoaiYeuCau::ChinhSuaLichHen;
+                            q.appointment_id = added[rng() % added.size()];
+                            q.doctor_id = tag + "D" + to_string(rng() % doctors);
+                            q.time = base + (int64_t)(rng() % 4320) * 1800;
+                        }
+                        else if (pick < 65) {
+                            q.type = LoaiYeuCau::TimTheoID;
+                            q.appointment_id = added[rng() % added.size()];
+                        }
+                        else if (pick < 80) {
+                            q.type = LoaiYeuCau::TheoBenhNhan;
+                            q.patient_id = tag + "P" + to_string(rng() % patients);
+                        }
+                        else if (pick < 90) {
+                            q.type = LoaiYeuCau::TheoThoiGian;
+                            q.time = base + (int64_t)(rng() % 4320) * 1800;
+                            q.end = q.time + 3600;
+                        }
+                        else {
+                            q.type = LoaiYeuCau::TheoBacSi;
+                            q.doctor_id = tag + "D" + to_string(rng() % doctors);
+                            q.limit = 20;
+                        }
+                        body.bytes.clear();
+                        GhiYeuCau(body, q);
+                        AppendFrame(frames, body.bytes);
+                        started[sent % depth] = now;
+                        sent++;
+                    }
+                    if (!frames.empty()) client->Send(frames);
+                };
+                fill();
+                while (received < quota) {
+                    ByteReader reply = client->Receive();
+                    auto now = chrono::steady_clock::now();
+                    uint32_t id = reply.U32();
+                    uint8_t code = reply.U8();
+                    if (id != (uint32_t)received) throw runtime_error("Trả lời không đúng thứ tự yêu cầu");
+                    latencies[c].push_back(chrono::duration<double, micro>(now - started[received % depth]).count());
+                    codes[c][min<size_t>(code, codes[c].size() - 1)]++;
+                    received++;
+                    // Gửi bù một lần cho cả loạt trả lời đã về
+                    if (!client->Buffered()) fill();
+                }
+            }
+            catch (const exception& e) {
+                errors[c] = e.what();
+            }
+        });
+    }
+    while (connected < connections) this_thread::yield();
+    auto started = chrono::steady_clock::now();
+    go = true;
+    for (thread& worker : workers) worker.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    for (const string& error : errors) {
+        if (!error.empty()) throw runtime_error(error);
     }
 
-    bool KiemTraIDTonTai(const string& aid) {
-        shared_ptr<Appointment>* app = appointments.Find(aid);
-        return app && *app && (*app)->is_valid;
+    vector<double> all;
+    vector<long long> totals(codes[0].size());
+    for (int c = 0; c < connections; c++) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        for (size_t k = 0; k < totals.size(); k++) totals[k] += codes[c][k];
     }
-};
+    sort(all.begin(), all.end());
+    auto at = [&all](double q) { return all.empty() ? 0 : all[min(all.size() - 1, (size_t)(q * all.size()))]; };
+    cout << "Số lõi: " << thread::hardware_concurrency() << ", " << connections << " kết nối, tối đa " << depth
+        << " yêu cầu chờ trên mỗi kết nối, máy chủ " << address << "." << endl;
+    cout << "Đã nhận " << all.size() << " trả lời trong " << (long long)(seconds * 1000) << " ms: "
+        << (long long)(seconds > 0 ? all.size() / seconds : 0) << " yêu cầu/giây." << endl;
+    cout << fixed << setprecision(1) << "Độ trễ (µs): p50 " << at(0.5) << ", p99 " << at(0.99) << ", p999 "
+        << at(0.999) << ", max " << (all.empty() ? 0 : all.back()) << endl;
+    cout << "Mã trả lời:";
+    for (size_t k = 0; k < totals.size(); k++) {
+        if (totals[k]) cout << ' ' << KyHieuMaLoi((MaLoi)k) << ' ' << totals[k];
+    }
+    cout << endl;
+    // Xung đột lịch là một phần của tải; lịch hẹn thêm không được vì xung đột thì sau đó không tìm thấy
+    for (size_t k = 0; k < totals.size(); k++) {
+        if (totals[k] && (MaLoi)k != MaLoi::ThanhCong && (MaLoi)k != MaLoi::XungDot && (MaLoi)k != MaLoi::KhongTimThay) {
+            throw runtime_error("Máy chủ trả về mã lỗi không mong đợi");
+        }
+    }
+}
+
+RequestServer* may_chu_dang_chay = nullptr;
+
+void DungMayChu(int) {
+    if (may_chu_dang_chay) may_chu_dang_chay->Stop();
+}
+#endif
 
 void clearInputBuffer() {
     cin.clear();
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
 }
 
-int main() {
+// Ảnh chụp kèm LSN của thao tác kế tiếp trong nhật ký. AppointmentSystem chỉ được chụp giữa hai lệnh nên
+// đọc LSN lúc nào cũng khớp; hệ thống phân vùng tự đọc LSN khi đã chặn mọi thao tác ghi.
+SnapshotData ChupAnhHeThong(AppointmentSystem& system, WriteAheadLog& wal) {
+    return system.ChupAnh(wal.NextLsn());
+}
+
+SnapshotData ChupAnhHeThong(ConcurrentAppointmentSystem& system, WriteAheadLog&) {
+    return system.ChupAnh();
+}
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
     SetConsoleOutputCP(CP_UTF8);
     SetConsoleCP(CP_UTF8);
+#endif
 
+    // --nhac-nho <tệp|->   nơi nhận nhắc nhở tự động (mặc định nhac_nho.txt)
+    // --nhac-truoc <phút,...> các mốc nhắc trước giờ hẹn (mặc định 60,1440)
+    // --thoi-luong <phút>     thời lượng mặc định của một lịch hẹn (mặc định 30)
+    // --nhat-ky <tệp>         nhật ký ghi trước để khôi phục khi khởi động lại (mặc định lich_hen.wal)
+    // --khong-nhat-ky         chỉ giữ dữ liệu trong bộ nhớ
+    // --dong-bo <moi-lenh|nhom|khong-doi>  fsync mỗi thao tác, gom nhóm, hoặc không chờ (mặc định nhom)
+    // --cua-so <ms>           cửa sổ gom nhóm / chu kỳ fsync nền (mặc định 5)
+    // --anh-chup <tệp>        ảnh chụp để khởi động nhanh và cắt ngắn nhật ký (mặc định lich_hen.snap)
+    // --khong-anh-chup        chỉ khôi phục từ nhật ký
+    // --chu-ky-anh-chup <n>   chụp lại ở nền sau mỗi n thao tác ghi nhật ký (mặc định 10000)
+    // --nhap <tệp>            nhập hàng loạt tệp CSV hoặc NDJSON vào hệ thống còn rỗng khi khởi động
+    // --bao-cao-nhap <tệp>    nơi ghi các dòng nhập bị loại và lý do (mặc định bao_cao_nhap.txt)
+    // --luong-nhap <n>        số luồng đọc tệp nhập (mặc định bằng số lõi)
+    // --lenh <tệp|->          chạy lô lệnh từ tệp hoặc stdin thay cho menu (xem ThucHienLenh); đồng bộ
+    //                         mặc định là khong-doi, kết quả chỉ được ghi ra sau khi nhật ký đã bền vững
+    // --thu-dong-thoi <n>     đo thông lượng chế độ đồng thời với n thao tác mỗi lần đo rồi thoát
+    // --thu-bang-bam <n>      đo tra cứu ID trên bảng băm đồng thời với n lần tra mỗi lần đo rồi thoát
+    // --thu-bao-cao <n>       đo n lần dời lịch khi có và không có báo cáo cả quý chạy song song rồi thoát
+    // --may-chu <địa chỉ>     phục vụ giao thức nhị phân (xem YeuCau) tại đường dẫn socket Unix hoặc host:port
+    //                         thay cho menu, Ctrl+C để dừng; đồng bộ mặc định là khong-doi, trả lời chỉ được
+    //                         gửi sau khi nhật ký đã bền vững
+    // --luong-may-chu <n>     số luồng xử lý yêu cầu của máy chủ (mặc định bằng số lõi)
+    // --tai-thu <địa chỉ> <n> gửi n yêu cầu tới máy chủ, đo thông lượng và độ trễ rồi thoát (xem ChayTaiThu)
+    // --ket-noi <n>           số kết nối của --tai-thu (mặc định 8)
+    // --do-sau <n>            số yêu cầu chưa có trả lời tối đa trên mỗi kết nối của --tai-thu (mặc định 16)
+    string reminder_path = "nhac_nho.txt";
+    vector<int> reminder_leads = { 60, 1440 };
+    int duration = DEFAULT_APPOINTMENT_MINUTES;
+    string wal_path = "lich_hen.wal";
+    SyncMode sync_mode = SyncMode::Group;
+    bool sync_given = false;
+    int window_ms = 5;
+    string snapshot_path = "lich_hen.snap";
+    int snapshot_every = 10000;
+    string import_path;
+    string report_path = "bao_cao_nhap.txt";
+    int import_threads = max(1, (int)thread::hardware_concurrency());
+    string command_path;
+    string server_address;
+    int server_threads = max(1, (int)thread::hardware_concurrency());
+    string load_address;
+    int load_requests = 0;
+    int load_connections = 8;
+    int load_depth = 16;
+    unique_ptr<ReminderScheduler> reminder_scheduler;
+    unique_ptr<WriteAheadLog> wal;
+    unique_ptr<SnapshotWriter> snapshots;
     AppointmentSystem system;
+    unique_ptr<ConcurrentAppointmentSystem> shared_system; // chỉ ở chế độ máy chủ, thay cho system
+    // action nhận hệ thống đang dùng
+    auto with_system = [&](auto action) {
+        if (shared_system) action(*shared_system);
+        else action(system);
+    };
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--nhac-nho" && i + 1 < argc) reminder_path = argv[++i];
+            else if (arg == "--nhac-truoc" && i + 1 < argc) reminder_leads = DocMocNhacNho(argv[++i]);
+            else if (arg == "--thoi-luong" && i + 1 < argc) duration = DocSoPhut(argv[++i]);
+            else if (arg == "--nhat-ky" && i + 1 < argc) wal_path = argv[++i];
+            else if (arg == "--khong-nhat-ky") wal_path.clear();
+            else if (arg == "--cua-so" && i + 1 < argc) window_ms = DocSoPhut(argv[++i]);
+            else if (arg == "--anh-chup" && i + 1 < argc) snapshot_path = argv[++i];
+            else if (arg == "--khong-anh-chup") snapshot_path.clear();
+            else if (arg == "--chu-ky-anh-chup" && i + 1 < argc) snapshot_every = DocSoThaoTac(argv[++i]);
+            else if (arg == "--nhap" && i + 1 < argc) import_path = argv[++i];
+            else if (arg == "--bao-cao-nhap" && i + 1 < argc) report_path = argv[++i];
+            else if (arg == "--luong-nhap" && i + 1 < argc) import_threads = DocSoLuong(argv[++i]);
+            else if (arg == "--lenh" && i + 1 < argc) command_path = argv[++i];
+            else if (arg == "--may-chu" && i + 1 < argc) server_address = argv[++i];
+            else if (arg == "--luong-may-chu" && i + 1 < argc) server_threads = DocSoLuong(argv[++i]);
+            else if (arg == "--tai-thu" && i + 2 < argc) {
+                load_address = argv[++i];
+                load_requests = DocSoThaoTac(argv[++i]);
+            }
+            else if (arg == "--ket-noi" && i + 1 < argc) load_connections = DocSoLuong(argv[++i]);
+            else if (arg == "--do-sau" && i + 1 < argc) load_depth = DocSoLuong(argv[++i]);
+            else if (arg == "--thu-dong-thoi" && i + 1 < argc) {
+                ChayThuDongThoi(DocSoThaoTac(argv[++i]));
+                return 0;
+            }
+            else if (arg == "--thu-bang-bam" && i + 1 < argc) {
+                ChayThuBangBam(DocSoThaoTac(argv[++i]));
+                return 0;
+            }
+            else if (arg == "--thu-bao-cao" && i + 1 < argc) {
+                ChayThuBaoCao(DocSoThaoTac(argv[++i]));
+                return 0;
+            }
+            else if (arg == "--dong-bo" && i + 1 < argc) {
+                string mode = argv[++i];
+                if (mode == "moi-lenh") sync_mode = SyncMode::PerOp;
+                else if (mode == "nhom") sync_mode = SyncMode::Group;
+                else if (mode == "khong-doi") sync_mode = SyncMode::Async;
+                else throw runtime_error("Chế độ đồng bộ không hợp lệ: " + mode);
+                sync_given = true;
+            }
+            else throw runtime_error("Tham số không hợp lệ: " + arg);
+        }
+        if (!load_address.empty()) {
+#ifdef __linux__
+            ChayTaiThu(load_address, load_requests, load_connections, load_depth);
+            return 0;
+#else
+            throw runtime_error("Khách đo tải chỉ có trên Linux");
+#endif
+        }
+#ifndef __linux__
+        if (!server_address.empty()) throw runtime_error("Chế độ máy chủ chỉ có trên Linux");
+#endif
+        // Chạy lô và máy chủ không chờ fsync từng lệnh: rào bền vững đặt ở chỗ ghi kết quả ra ngoài
+        if ((!command_path.empty() || !server_address.empty()) && !sync_given) sync_mode = SyncMode::Async;
+        // Nhiều quầy dùng chung máy chủ: lịch hẹn chia theo phân vùng để thao tác của các bác sĩ khác nhau chạy song song
+        if (!server_address.empty()) shared_system.reset(new ConcurrentAppointmentSystem());
+        with_system([&](auto& target) {
+            target.DatThoiLuongMacDinh(duration);
+            reminder_scheduler.reset(new ReminderScheduler(reminder_leads, TaoSinkTapTin(reminder_path)));
+            target.GanBoNhacNho(reminder_scheduler.get());
+            if (!wal_path.empty()) {
+                uint64_t snapshot_lsn = 0;
+                SnapshotFile snapshot;
+                if (!snapshot_path.empty() && snapshot.Open(snapshot_path)) {
+                    auto started = chrono::steady_clock::now();
+                    size_t loaded = target.NapAnhChup(snapshot);
+                    snapshot_lsn = snapshot.WalLsn();
+                    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started);
+                    cout << "Đã nạp " << loaded << " lịch hẹn từ ảnh chụp " << snapshot_path
+                        << " trong " << elapsed.count() << " ms." << endl;
+                }
+                wal.reset(new WriteAheadLog(wal_path, sync_mode, window_ms));
+                size_t failed = 0;
+                size_t applied = target.GanNhatKy(wal.get(), snapshot_lsn, &failed);
+                if (applied) {
+                    cout << "Đã khôi phục " << applied << " thao tác từ nhật ký " << wal_path;
+                    if (failed) cout << " (" << failed << " thao tác không áp dụng được)";
+                    cout << "." << endl;
+                }
+                if (!snapshot_path.empty()) snapshots.reset(new SnapshotWriter(snapshot_path, wal.get(), snapshot_lsn));
+            }
+            if (!import_path.empty()) {
+                auto started = chrono::steady_clock::now();
+                ImportConverter convert = [duration](const ImportFields& fields) { return DocDongNhap(fields, duration); };
+                ImportResult input = BulkImporter(convert).Read(import_path, import_threads);
+                size_t imported = target.NhapHangLoat(input);
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+                cout << "Đã nhập " << imported << "/" << input.lines << " dòng từ " << import_path << " trong "
+                    << (long long)(seconds * 1000) << " ms (" << (long long)(seconds > 0 ? input.lines / seconds : 0) << " bản ghi/giây)";
+                if (!input.rejects.empty()) cout << ", " << input.rejects.size() << " dòng bị loại, xem " << report_path;
+                cout << "." << endl;
+                GhiBaoCaoNhap(report_path, input.rejects);
+                // Ghi bền vững một lần cho cả lô: ảnh chụp nếu có, nếu không thì một lô bản ghi nhật ký
+                if (snapshots) {
+                    snapshots->Start(ChupAnhHeThong(target, *wal));
+                    snapshots->Wait();
+                    string error = snapshots->TakeError();
+                    if (!error.empty()) throw runtime_error("Lỗi ghi ảnh chụp: " + error);
+                }
+                else if (wal) {
+                    wal->AppendBatch(target.BanGhiTaoLai());
+                }
+            }
+        });
+    }
+    catch (const exception& e) {
+        cout << "Lỗi: " << e.what() << endl;
+        return 1;
+    }
+
+    // Việc nền sau mỗi lệnh: thu gọn từng bước và chụp ảnh theo chu kỳ. Lỗi chỉ được báo chứ không
+    // ném ra: lệnh đã xong, bước thu gọn hay lần chụp hỏng sẽ được thử lại sau lệnh kế tiếp.
+    // Máy chủ gọi từ nhiều luồng: luồng nào đang giữ snapshot_lock thì các luồng khác bỏ qua phần chụp.
+    mutex snapshot_lock;
+    auto after_command = [&]() {
+        with_system([&](auto& target) {
+            try {
+                target.DonDep(COMPACT_STEPS_PER_COMMAND);
+                unique_lock<mutex> guard(snapshot_lock, try_to_lock);
+                if (snapshots && guard.owns_lock()) {
+                    uint64_t lsn = wal->NextLsn();
+                    if (lsn - snapshots->StartedLsn() >= (uint64_t)snapshot_every && !snapshots->Busy()) {
+                        snapshots->Start(ChupAnhHeThong(target, *wal));
+                    }
+                    string error = snapshots->TakeError();
+                    if (!error.empty()) cerr << "Lỗi ghi ảnh chụp: " << error << endl;
+                }
+            }
+            catch (const exception& e) {
+                cerr << "Lỗi dọn dẹp sau lệnh: " << e.what() << endl;
+            }
+        });
+    };
+
+    // Chụp lần cuối để lần khởi động sau không phải áp dụng lại nhật ký
+    auto final_snapshot = [&]() {
+        if (!snapshots) return;
+        snapshots->Wait();
+        if (wal->NextLsn() != snapshots->StartedLsn()) {
+            with_system([&](auto& target) { snapshots->Start(ChupAnhHeThong(target, *wal)); });
+            snapshots->Wait();
+        }
+        string error = snapshots->TakeError();
+        if (!error.empty()) cerr << "Lỗi ghi ảnh chụp: " << error << endl;
+    };
+
+#ifdef __linux__
+    if (!server_address.empty()) {
+        try {
+            MayChuLichHen handler(*shared_system, after_command);
+            RequestServer server(server_address, server_threads,
+                [&handler](ByteReader& request, ByteWriter& response) { return handler.XuLy(request, response); },
+                [&wal]() {
+                    if (wal) wal->Sync();
+                });
+            may_chu_dang_chay = &server;
+            signal(SIGINT, DungMayChu);
+            signal(SIGTERM, DungMayChu);
+            cout << "Máy chủ đang lắng nghe tại " << server_address << " với " << server_threads
+                << " luồng xử lý, Ctrl+C để dừng." << endl;
+            server.Run();
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            may_chu_dang_chay = nullptr;
+            cout << "Đã dừng máy chủ sau " << server.Served() << " yêu cầu." << endl;
+        }
+        catch (const exception& e) {
+            may_chu_dang_chay = nullptr;
+            cout << "Lỗi: " << e.what() << endl;
+            return 1;
+        }
+        final_snapshot();
+        return 0;
+    }
+#endif
+
+    if (!command_path.empty()) {
+        FILE* input = command_path == "-" ? stdin : fopen(command_path.c_str(), "rb");
+        if (!input) {
+            cout << "Lỗi: Không mở được tệp lệnh: " << command_path << endl;
+            return 1;
+        }
+        size_t executed = 0;
+        size_t failures = 0;
+        auto started = chrono::steady_clock::now();
+        try {
+            OutputBuffer buffer(stdout, [&wal]() {
+                if (wal) wal->Sync();
+            });
+            ostream output(&buffer);
+            output.exceptions(ios::badbit); // Lỗi ghi nhật ký khi xả kết quả là lỗi dừng
+            system.DatDauRa(output);
+            LineReader reader(input);
+            failures = ChayLoLenh(system, reader, output, after_command, executed);
+            buffer.Flush();
+            system.DatDauRa(cout);
+        }
+        catch (const exception& e) {
+            system.DatDauRa(cout);
+            if (input != stdin) fclose(input);
+            cerr << "Lỗi: " << e.what() << endl;
+            return 1;
+        }
+        if (input != stdin) fclose(input);
+        final_snapshot();
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started);
+        cerr << "Đã chạy " << executed << " lệnh trong " << elapsed.count() << " ms (" << failures << " lệnh lỗi)." << endl;
+        return failures ? 2 : 0;
+    }
+
+    DinhDangKetQua format(system, cout);
     int choice;
 
     do {
@@ -415,7 +2819,7 @@ int main() {
                     cout << "Nhập ID lịch hẹn: ";
                     getline(cin, aid);
                     if (!isAlphanumeric(aid)) {
-                        cout << "Lỗi: ID chỉ được chứa chữ cái và số, không rỗng. Nhập lại.\n";
+                        cout << "Lỗi: ID chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự. Nhập lại.\n";
                         continue;
                     }
                     if (system.KiemTraIDTonTai(aid)) {
@@ -429,7 +2833,7 @@ int main() {
                     cout << "Nhập ID bệnh nhân: ";
                     getline(cin, pid);
                     if (!isAlphanumeric(pid)) {
-                        cout << "Lỗi: ID bệnh nhân chỉ được chứa chữ cái và số, không rỗng. Nhập lại.\n";
+                        cout << "Lỗi: ID bệnh nhân chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự. Nhập lại.\n";
                         continue;
                     }
                     break;
@@ -439,7 +2843,7 @@ int main() {
                     cout << "Nhập ID bác sĩ: ";
                     getline(cin, did);
                     if (!isAlphanumeric(did)) {
-                        cout << "Lỗi: ID bác sĩ chỉ được chứa chữ cái và số, không rỗng. Nhập lại.\n";
+                        cout << "Lỗi: ID bác sĩ chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự. Nhập lại.\n";
                         continue;
                     }
                     break;
@@ -506,7 +2910,7 @@ int main() {
                     cout << "Nhập ID lịch hẹn cần chỉnh sửa: ";
                     getline(cin, aid);
                     if (!isAlphanumeric(aid)) {
-                        cout << "Lỗi: ID chỉ được chứa chữ cái và số, không rỗng. Nhập lại.\n";
+                        cout << "Lỗi: ID chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự. Nhập lại.\n";
                         continue;
                     }
                     if (!system.KiemTraIDTonTai(aid)) {
@@ -520,7 +2924,7 @@ int main() {
                     cout << "Nhập ID bác sĩ mới: ";
                     getline(cin, new_did);
                     if (!isAlphanumeric(new_did)) {
-                        cout << "Lỗi: ID bác sĩ chỉ được chứa chữ cái và số, không rỗng. Nhập lại.\n";
+                        cout << "Lỗi: ID bác sĩ chỉ được chứa chữ cái và số, không rỗng, tối đa 65535 ký tự. Nhập lại.\n";
                         continue;
                     }
                     break;
@@ -549,27 +2953,21 @@ int main() {
                 string aid;
                 cout << "Nhập ID lịch hẹn cần tìm: ";
                 getline(cin, aid);
-                auto app = system.TimLichHen(aid);
-                if (app) {
-                    cout << "Tìm thấy: Lịch hẹn " << app->appointment_id
-                        << " với bác sĩ " << app->doctor_id
-                        << " vào lúc " << toVietnamTime(app->time)
-                        << ", trạng thái: " << app->status << endl;
-                }
+                format.InLichHen(aid);
                 break;
             }
             case 5: {
                 string pid;
                 cout << "Nhập ID bệnh nhân: ";
                 getline(cin, pid);
-                system.TimLichHenTheoBenhNhan(pid);
+                format.InTheoBenhNhan(pid);
                 break;
             }
             case 6: {
                 string did;
                 cout << "Nhập ID bác sĩ: ";
                 getline(cin, did);
-                system.TimLichHenTheoBacSi(did);
+                format.InTheoBacSi(did);
                 break;
             }
             case 7: {
@@ -578,7 +2976,7 @@ int main() {
                 getline(cin, start_datetime);
                 cout << "Nhập thời gian kết thúc (DD-MM-YYYY HH:MM): ";
                 getline(cin, end_datetime);
-                system.TimLichHenTheoThoiGian(start_datetime, end_datetime);
+                format.InTheoThoiGian(start_datetime, end_datetime);
                 break;
             }
             case 8: {
@@ -614,11 +3012,11 @@ int main() {
                     if (hours_before == 1 || hours_before == 24) break;
                     cout << "Lỗi: Vui lòng nhập 1 hoặc 24. Nhập lại.\n";
                 }
-                system.GuiNhacNho(hours_before);
+                format.InNhacNho(hours_before);
                 break;
             }
             case 10: {
-                system.LietKeLichHenTrongNgay();
+                format.InTrongNgay();
                 break;
             }
             case 11: {
@@ -634,7 +3032,10 @@ int main() {
         catch (const runtime_error& e) {
             cerr << "Lỗi: " << e.what() << endl;
         }
+        after_command();
     } while (choice != 11);
 
+    final_snapshot();
+
     return 0;
 }
\ No newline at end of file
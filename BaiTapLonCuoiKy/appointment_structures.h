@@ -7,129 +7,583 @@
 #include <algorithm>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <climits>
+#include <new>
+#include <type_traits>
+#include <utility>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace std;
 
+enum class TrangThai : uint8_t {
+    DangCho,
+    DaXacNhan,
+    BiTuChoi
+};
+
+inline const char* TenTrangThai(TrangThai status) {
+    switch (status) {
+    case TrangThai::DaXacNhan: return "đã xác nhận";
+    case TrangThai::BiTuChoi: return "bị từ chối";
+    default: return "đang chờ";
+    }
+}
+
+inline TrangThai DocTrangThai(const string& status) {
+    if (status == "đang chờ") return TrangThai::DangCho;
+    if (status == "đã xác nhận") return TrangThai::DaXacNhan;
+    if (status == "bị từ chối") return TrangThai::BiTuChoi;
+    throw runtime_error("Trạng thái không hợp lệ: " + status);
+}
+
+#define DEFAULT_APPOINTMENT_MINUTES 30
+
+// Bản ghi gọn 24 byte, nằm liên tiếp trong AppointmentSlab
 struct Appointment {
-    string appointment_id;
-    string patient_id;
-    string doctor_id;
     time_t time;
-    string status; 
-    bool is_valid;
-    Appointment(string aid, string pid, string did, time_t t, string s)
-        : appointment_id(aid), patient_id(pid), doctor_id(did), time(t), status(s), is_valid(true) {};
+    uint32_t appointment_id; // chỉ số trong IdTable, chuỗi gốc chỉ dùng khi hiển thị
+    uint32_t patient_id;
+    uint32_t doctor_id;
+    uint16_t duration; // phút, lịch hẹn chiếm đoạn [time, time + duration)
+    TrangThai status;
+    uint8_t is_valid : 1;
+    uint8_t reserved : 7;
+    Appointment(uint32_t aid, uint32_t pid, uint32_t did, time_t t, TrangThai s, uint16_t minutes = DEFAULT_APPOINTMENT_MINUTES)
+        : time(t), appointment_id(aid), patient_id(pid), doctor_id(did), duration(minutes), status(s), is_valid(1), reserved(0) {};
+
+    time_t EndTime() const {
+        return time + (time_t)duration * 60;
+    }
+};
+
+struct AppointmentHandle {
+    uint32_t index;
+    uint32_t generation;
+    AppointmentHandle() : index(UINT32_MAX), generation(0) {}
+    AppointmentHandle(uint32_t i, uint32_t g) : index(i), generation(g) {}
+    bool operator==(const AppointmentHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+};
+
+// Lưu mọi lịch hẹn trong một mảng liên tục. Ô đã giải phóng được dùng lại,
+// mỗi lần giải phóng tăng thế hệ của ô để các handle cũ tự động vô hiệu.
+struct AppointmentSlab {
+private:
+    vector<Appointment> records;
+    vector<uint32_t> generations;
+    vector<uint32_t> free_slots;
+
+public:
+    AppointmentHandle Allocate(const Appointment& app) {
+        if (!free_slots.empty()) {
+            uint32_t index = free_slots.back();
+            free_slots.pop_back();
+            records[index] = app;
+            return AppointmentHandle(index, generations[index]);
+        }
+        records.push_back(app);
+        generations.push_back(0);
+        return AppointmentHandle((uint32_t)records.size() - 1, 0);
+    }
+
+    void Reserve(size_t count) {
+        records.reserve(count);
+        generations.reserve(count);
+    }
+
+    void Free(AppointmentHandle handle) {
+        if (!Get(handle)) return;
+        generations[handle.index]++;
+        free_slots.push_back(handle.index);
+    }
+
+    // Con trỏ chỉ hợp lệ tới lần Allocate kế tiếp; trả về nullptr nếu handle đã cũ
+    Appointment* Get(AppointmentHandle handle) {
+        if (handle.index >= records.size() || generations[handle.index] != handle.generation) return nullptr;
+        return &records[handle.index];
+    }
+
+    const Appointment* Get(AppointmentHandle handle) const {
+        if (handle.index >= records.size() || generations[handle.index] != handle.generation) return nullptr;
+        return &records[handle.index];
+    }
+
+    bool IsLive(AppointmentHandle handle) const {
+        const Appointment* app = Get(handle);
+        return app && app->is_valid;
+    }
+
+    size_t Size() const {
+        return records.size() - free_slots.size();
+    }
 };
 
-template <typename TValue>
+inline uint64_t HashKey(const string& key) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a 64 bit
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    // Trộn bit cao xuống bit thấp vì chỉ số ô chỉ lấy các bit thấp
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+inline uint64_t HashKey(uint64_t key) {
+    uint64_t hash = key + 0x9e3779b97f4a7c15ULL; // splitmix64
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+inline uint64_t HashKey(uint32_t key) {
+    return HashKey((uint64_t)key);
+}
+
+inline string KeyToString(const string& key) { return key; }
+inline string KeyToString(uint32_t key) { return to_string(key); }
+inline string KeyToString(uint64_t key) { return to_string(key); }
+
+template <typename TValue, typename TKey = string>
 struct Hashmap {
 private:
-    struct ListNode {
-        string key;
+    // Bảng băm địa chỉ mở kiểu Robin Hood, dung lượng luôn là lũy thừa của 2.
+    // Khi vượt ngưỡng tải, bảng mới gấp đôi được tạo và các phần tử của bảng cũ
+    // được chuyển dần sang sau mỗi lần Insert/Remove thay vì chuyển một lần.
+    struct Slot {
+        TKey key;
         TValue value;
-        ListNode* next;
-        ListNode(string k, TValue v, ListNode* n = nullptr) : key(k), value(v), next(n) {}
+        uint64_t hash;
+        uint32_t dist; // khoảng cách dò + 1, 0 là ô trống
+        Slot() : key(), value(), hash(0), dist(0) {}
     };
-    ListNode** table;
-    int size;
 
-    int GetHashCode(string key) {
-        int hash = 0;
-        for (char c : key) {
-            hash = hash * 31 + c;
+    vector<Slot> table;
+    vector<Slot> old_table;
+    size_t count;
+    size_t old_count;
+    size_t migrate_pos;
+
+    static uint64_t GetHashCode(const TKey& key) {
+        return HashKey(key);
+    }
+
+    static size_t FindIndex(const vector<Slot>& t, const TKey& key, uint64_t hash) {
+        if (t.empty()) return SIZE_MAX;
+        size_t mask = t.size() - 1;
+        size_t i = hash & mask;
+        for (uint32_t dist = 1;; dist++) {
+            const Slot& slot = t[i];
+            if (slot.dist < dist) return SIZE_MAX; // ô trống hoặc phần tử "giàu" hơn: khóa không tồn tại
+            if (slot.hash == hash && slot.key == key) return i;
+            i = (i + 1) & mask;
         }
-        return hash % size;
     }
 
-public:
-    Hashmap(int s = 100) : size(s) {
-        table = new ListNode * [size]();
+    static void Place(vector<Slot>& t, Slot&& item) {
+        size_t mask = t.size() - 1;
+        size_t i = item.hash & mask;
+        item.dist = 1;
+        while (true) {
+            Slot& slot = t[i];
+            if (slot.dist == 0) {
+                slot = move(item);
+                return;
+            }
+            if (slot.dist < item.dist) swap(slot, item);
+            i = (i + 1) & mask;
+            item.dist++;
+        }
     }
 
-    void Insert(string key, TValue value) {
-        int index = GetHashCode(key);
-        ListNode* head = table[index];
-        if (!head) {
-            table[index] = new ListNode(key, value);
-            return;
+    // Xóa ô i rồi dịch lùi các phần tử phía sau, không để lại bia mộ
+    static void EraseAt(vector<Slot>& t, size_t i) {
+        size_t mask = t.size() - 1;
+        size_t next = (i + 1) & mask;
+        while (t[next].dist > 1) {
+            t[i] = move(t[next]);
+            t[i].dist--;
+            i = next;
+            next = (next + 1) & mask;
         }
-        while (head) {
-            if (head->key == key) {
-                throw runtime_error("ID lịch hẹn trùng lặp: " + key);
+        t[i] = Slot();
+    }
+
+    void MigrateSome() {
+        if (old_table.empty()) return;
+        for (int step = 0; step < 16 && migrate_pos < old_table.size(); step++) {
+            if (old_table[migrate_pos].dist == 0) {
+                migrate_pos++;
+                continue;
             }
-            if (!head->next) break;
-            head = head->next;
+            Place(table, move(old_table[migrate_pos]));
+            EraseAt(old_table, migrate_pos); // có thể kéo phần tử kế tiếp về migrate_pos
+            count++;
+            old_count--;
+        }
+        if (migrate_pos >= old_table.size() || old_count == 0) {
+            vector<Slot>().swap(old_table);
+            migrate_pos = 0;
         }
-        head->next = new ListNode(key, value);
     }
 
-    TValue* Find(string key) {
-        int index = GetHashCode(key);
-        ListNode* head = table[index];
-        while (head) {
-            if (head->key == key) return &head->value;
-            head = head->next;
+    void Grow() {
+        while (!old_table.empty()) MigrateSome();
+        old_table.swap(table);
+        old_count = count;
+        count = 0;
+        migrate_pos = 0;
+        table = vector<Slot>(old_table.size() * 2);
+    }
+
+public:
+    Hashmap(int s = 100) : count(0), old_count(0), migrate_pos(0) {
+        size_t capacity = 16;
+        while (capacity < (size_t)max(s, 1)) capacity <<= 1;
+        table = vector<Slot>(capacity);
+    }
+
+    void Insert(const TKey& key, TValue value) {
+        MigrateSome();
+        uint64_t hash = GetHashCode(key);
+        if (FindIndex(table, key, hash) != SIZE_MAX || FindIndex(old_table, key, hash) != SIZE_MAX) {
+            throw runtime_error("Khóa đã tồn tại: " + KeyToString(key));
         }
+        if ((count + old_count + 1) * 8 > table.size() * 7) Grow(); // ngưỡng tải 7/8
+        Slot item;
+        item.key = key;
+        item.value = move(value);
+        item.hash = hash;
+        Place(table, move(item));
+        count++;
+    }
+
+    // Con trỏ trả về chỉ hợp lệ tới lần Insert/Remove kế tiếp
+    TValue* Find(const TKey& key) {
+        uint64_t hash = GetHashCode(key);
+        size_t i = FindIndex(table, key, hash);
+        if (i != SIZE_MAX) return &table[i].value;
+        i = FindIndex(old_table, key, hash);
+        if (i != SIZE_MAX) return &old_table[i].value;
         return nullptr;
     }
 
-    void Remove(string key) {
-        int index = GetHashCode(key);
-        ListNode* head = table[index];
-        ListNode* prev = nullptr;
-        while (head) {
-            if (head->key == key) {
-                if (prev) prev->next = head->next;
-                else table[index] = head->next;
-                delete head;
-                return;
-            }
-            prev = head;
-            head = head->next;
+    void Remove(const TKey& key) {
+        MigrateSome();
+        uint64_t hash = GetHashCode(key);
+        size_t i = FindIndex(table, key, hash);
+        if (i != SIZE_MAX) {
+            EraseAt(table, i);
+            count--;
+            return;
+        }
+        i = FindIndex(old_table, key, hash);
+        if (i != SIZE_MAX) {
+            EraseAt(old_table, i);
+            old_count--;
         }
     }
 
     vector<TValue*> GetAllValues() {
         vector<TValue*> result;
-        for (int i = 0; i < size; i++) {
-            ListNode* head = table[i];
-            while (head) {
-                result.push_back(&head->value);
-                head = head->next;
-            }
+        result.reserve(count + old_count);
+        for (Slot& slot : table) {
+            if (slot.dist) result.push_back(&slot.value);
+        }
+        for (Slot& slot : old_table) {
+            if (slot.dist) result.push_back(&slot.value);
         }
         return result;
     }
 
-    ~Hashmap() {
-        for (int i = 0; i < size; i++) {
-            ListNode* head = table[i];
-            while (head) {
-                ListNode* temp = head;
-                head = head->next;
-                delete temp;
+    size_t Size() const {
+        return count + old_count;
+    }
+
+    size_t Capacity() const {
+        return table.size() + old_table.size();
+    }
+
+    // Cấp sẵn bảng đủ cho count phần tử để nạp hàng loạt không phải mở rộng nhiều lần
+    void Reserve(size_t count) {
+        size_t capacity = table.size();
+        while (count * 8 > capacity * 7) capacity <<= 1;
+        if (capacity == table.size()) return;
+        while (!old_table.empty()) MigrateSome();
+        vector<Slot> bigger(capacity);
+        for (Slot& slot : table) {
+            if (slot.dist) Place(bigger, move(slot));
+        }
+        table.swap(bigger);
+    }
+
+    // Chèn total phần tử vào bảng rỗng, phần tử thứ i là (key_at(i), value_at(i)). Các khóa được
+    // chia theo ô gốc (sắp xếp đếm trên các bit cao của chỉ số ô) rồi chèn theo thứ tự đó, nên bảng
+    // được ghi gần như tuần tự thay vì mỗi lần chèn một lần trượt cache. Khóa trùng vẫn bị từ chối.
+    template <typename TKeyAt, typename TValueAt>
+    void InsertBulk(size_t total, TKeyAt key_at, TValueAt value_at) {
+        if (Size()) throw runtime_error("Chỉ chèn hàng loạt vào bảng rỗng");
+        Reserve(total);
+        size_t mask = table.size() - 1;
+        int shift = 0;
+        while ((table.size() >> shift) > 65536) shift++;
+        vector<uint64_t> hashes(total);
+        vector<uint32_t> starts((table.size() >> shift) + 1, 0);
+        for (size_t i = 0; i < total; i++) {
+            hashes[i] = GetHashCode(key_at(i));
+            starts[((hashes[i] & mask) >> shift) + 1]++;
+        }
+        for (size_t b = 1; b < starts.size(); b++) starts[b] += starts[b - 1];
+        vector<uint32_t> order(total);
+        for (size_t i = 0; i < total; i++) order[starts[(hashes[i] & mask) >> shift]++] = (uint32_t)i;
+        for (uint32_t i : order) {
+            const TKey& key = key_at(i);
+            if (FindIndex(table, key, hashes[i]) != SIZE_MAX) throw runtime_error("Khóa đã tồn tại: " + KeyToString(key));
+            Slot item;
+            item.key = key;
+            item.value = value_at(i);
+            item.hash = hashes[i];
+            Place(table, move(item));
+            count++;
+        }
+    }
+
+    // Một bước thu gọn có giới hạn: chuyển tiếp tối đa 16 ô nếu đang di chuyển bảng, hoặc bắt đầu
+    // thu nhỏ bảng còn một nửa khi tải dưới 1/8. Trả về false nếu không còn gì để làm.
+    // Con trỏ trả về từ Find không còn hợp lệ sau khi gọi.
+    bool Compact() {
+        if (!old_table.empty()) {
+            MigrateSome();
+            return true;
+        }
+        if (table.size() <= 16 || count * 8 >= table.size()) return false;
+        old_table.swap(table);
+        old_count = count;
+        count = 0;
+        migrate_pos = 0;
+        table = vector<Slot>(old_table.size() / 2);
+        MigrateSome();
+        return true;
+    }
+};
+
+// Ánh xạ mỗi ID dạng chuỗi sang một số nguyên 32 bit liên tục (0, 1, 2, ...).
+// Chuỗi chỉ được băm một lần ở biên hệ thống, các chỉ mục bên trong so sánh số nguyên.
+struct IdTable {
+private:
+    Hashmap<uint32_t> ids;
+    vector<string> names;
+    vector<uint32_t> free_ids; // ID đã trả lại, được cấp lại trước khi mở rộng names
+
+public:
+    uint32_t Intern(const string& name) {
+        uint32_t* id = ids.Find(name);
+        if (id) return *id;
+        uint32_t new_id;
+        if (!free_ids.empty()) {
+            new_id = free_ids.back();
+            ids.Insert(name, new_id);
+            free_ids.pop_back();
+            names[new_id] = name;
+        }
+        else {
+            new_id = (uint32_t)names.size();
+            ids.Insert(name, new_id);
+            names.push_back(name);
+        }
+        return new_id;
+    }
+
+    // Trả ID lại khi không còn cấu trúc nào tham chiếu tới nó
+    void Release(uint32_t id) {
+        ids.Remove(names[id]);
+        string().swap(names[id]);
+        free_ids.push_back(id);
+    }
+
+    bool Compact() {
+        return ids.Compact();
+    }
+
+    // Cấp trước chỗ cho count chuỗi để các lần Intern sau không phải mở rộng bảng
+    void Reserve(size_t count) {
+        ids.Reserve(count);
+        names.reserve(count);
+    }
+
+    // Nạp hàng loạt vào bảng rỗng: chuỗi thứ i nhận ID i
+    void Load(vector<string>&& all) {
+        if (!names.empty()) throw runtime_error("Chỉ nạp hàng loạt vào bảng ID rỗng");
+        names = move(all);
+        ids.InsertBulk(names.size(), [this](size_t i) -> const string& { return names[i]; },
+            [](size_t i) { return (uint32_t)i; });
+    }
+
+    // Không tạo ID mới; trả về nullptr nếu chuỗi chưa từng xuất hiện
+    const uint32_t* Find(const string& name) {
+        return ids.Find(name);
+    }
+
+    const string& Name(uint32_t id) const {
+        return names[id];
+    }
+
+    // Chỉ số là ID; ID đã trả lại ứng với chuỗi rỗng
+    const vector<string>& Names() const {
+        return names;
+    }
+
+    size_t Size() const {
+        return names.size() - free_ids.size();
+    }
+};
+
+// Cấp phát nút theo từng khối lớn. Nút bị xóa được đưa vào danh sách rỗi để dùng lại,
+// toàn bộ khối chỉ được giải phóng một lần khi pool bị hủy.
+template <typename T>
+struct NodePool {
+private:
+    union Cell {
+        Cell* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+    vector<Cell*> blocks;
+    Cell* free_list;
+    size_t block_capacity; // số ô của khối cuối cùng
+    size_t block_used;
+    size_t grow_capacity; // số ô của khối cấp thêm kế tiếp, không bị Reserve đặt lại
+    size_t live;
+
+public:
+    static const bool kBulkRelease = true;
+
+    NodePool() : free_list(nullptr), block_capacity(0), block_used(0), grow_capacity(0), live(0) {}
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    template <typename... Args>
+    T* Create(Args&&... args) {
+        Cell* cell;
+        if (free_list) {
+            cell = free_list;
+            free_list = cell->next;
+        }
+        else {
+            if (block_used == block_capacity) {
+                // Khối đầu nhỏ để cây/danh sách ít nút không tốn bộ nhớ, sau đó gấp đôi tới 4096 ô
+                grow_capacity = grow_capacity ? min(grow_capacity * 2, (size_t)4096) : 32;
+                block_capacity = grow_capacity;
+                blocks.push_back(new Cell[block_capacity]);
+                block_used = 0;
             }
+            cell = blocks.back() + block_used++;
+        }
+        live++;
+        return new (cell->storage) T(forward<Args>(args)...);
+    }
+
+    // Bảo đảm count lần Create kế tiếp không phải cấp thêm khối. Ô còn lại của khối hiện tại được
+    // chuyển vào danh sách rỗi, khối mới chỉ có phần còn thiếu để các chỉ mục nhỏ dựng hàng loạt
+    // không chiếm cả khối 32 ô
+    void Reserve(size_t count) {
+        size_t spare = block_capacity - block_used;
+        if (spare >= count) return;
+        // Đẩy từ cuối để Create lấy lại theo đúng thứ tự địa chỉ
+        for (size_t i = block_capacity; i > block_used; i--) {
+            Cell* cell = blocks.back() + i - 1;
+            cell->next = free_list;
+            free_list = cell;
         }
-        delete[] table;
+        block_capacity = count - spare;
+        blocks.push_back(new Cell[block_capacity]);
+        block_used = 0;
+    }
+
+    void Destroy(T* node) {
+        node->~T();
+        Cell* cell = reinterpret_cast<Cell*>(node);
+        cell->next = free_list;
+        free_list = cell;
+        live--;
+    }
+
+    size_t Live() const {
+        return live;
+    }
+
+    ~NodePool() {
+        static_assert(is_trivially_destructible<T>::value, "NodePool giải phóng theo khối, nút không được có hàm hủy");
+        for (Cell* block : blocks) delete[] block;
+    }
+};
+
+// Cấp phát từng nút bằng new/delete, cùng giao diện với NodePool để đo so sánh
+template <typename T>
+struct HeapAllocator {
+    static const bool kBulkRelease = false;
+
+    template <typename... Args>
+    T* Create(Args&&... args) {
+        return new T(forward<Args>(args)...);
+    }
+
+    void Reserve(size_t) {}
+
+    void Destroy(T* node) {
+        delete node;
     }
 };
 
+// Duyệt lười một khoảng thời gian: for (AppointmentHandle h : index.Range(start, end)) {...}
+template <typename TIterator>
+struct TimeRange {
+    TIterator first;
+    TimeRange(const TIterator& it) : first(it) {}
+    TIterator begin() const { return first; }
+    TIterator end() const { return TIterator(); }
+    bool Empty() const { return first.Done(); }
+};
+
 struct AVLNode {
-    shared_ptr<Appointment> appointment;
+    // Khóa (time, appointment_id) được sao chép từ bản ghi để khi duyệt cây không phải đọc slab
+    time_t time;
+    uint32_t appointment_id;
+    AppointmentHandle handle;
     int height;
+    int size; // số nút của cây con, dùng cho đếm và truy vấn thứ k
     AVLNode* left;
     AVLNode* right;
-    AVLNode(shared_ptr<Appointment> app) : appointment(app), height(1), left(nullptr), right(nullptr) {}
+    AVLNode(AppointmentHandle h, time_t t, uint32_t aid)
+        : time(t), appointment_id(aid), handle(h), height(1), size(1), left(nullptr), right(nullptr) {}
 };
 
+// Cây AVL theo khóa ghép (time, appointment_id): mọi khóa đều phân biệt nên xóa theo bản ghi
+// là một lần đi xuống O(log n). Kích thước cây con cho phép đếm/chọn thứ k trong O(log n).
+template <typename TAllocator = NodePool<AVLNode>>
 struct AVLTree {
 private:
     AVLNode* root;
+    const AppointmentSlab& records;
+    TAllocator nodes;
+
+    static bool Less(time_t t1, uint32_t id1, time_t t2, uint32_t id2) {
+        return t1 < t2 || (t1 == t2 && id1 < id2);
+    }
 
     int Height(AVLNode* node) {
         return node ? node->height : 0;
     }
 
+    int Size(AVLNode* node) {
+        return node ? node->size : 0;
+    }
+
     int BalanceFactor(AVLNode* node) {
         return node ? Height(node->left) - Height(node->right) : 0;
     }
@@ -137,6 +591,7 @@ private:
     void UpdateHeight(AVLNode* node) {
         if (node) {
             node->height = max(Height(node->left), Height(node->right)) + 1;
+            node->size = Size(node->left) + Size(node->right) + 1;
         }
     }
 
@@ -158,84 +613,83 @@ private:
         return y;
     }
 
-    AVLNode* Insert(AVLNode* node, shared_ptr<Appointment> app) {
-        if (!node) return new AVLNode(app);
-        if (app->time < node->appointment->time)
-            node->left = Insert(node->left, app);
-        else if (app->time > node->appointment->time)
-            node->right = Insert(node->right, app);
-        else if (app->patient_id == node->appointment->patient_id &&
-            app->doctor_id == node->appointment->doctor_id)
-            throw runtime_error("Xung đột thời gian lịch hẹn cho cùng bệnh nhân và bác sĩ");
-        else
-            node->right = Insert(node->right, app);
-
+    AVLNode* Rebalance(AVLNode* node) {
         UpdateHeight(node);
         int balance = BalanceFactor(node);
 
-        if (balance > 1 && app->time < node->left->appointment->time)
+        if (balance > 1 && BalanceFactor(node->left) >= 0)
             return RotateRight(node);
-        if (balance < -1 && app->time > node->right->appointment->time)
-            return RotateLeft(node);
-        if (balance > 1 && app->time > node->left->appointment->time) {
+        if (balance > 1 && BalanceFactor(node->left) < 0) {
             node->left = RotateLeft(node->left);
             return RotateRight(node);
         }
-        if (balance < -1 && app->time < node->right->appointment->time) {
+        if (balance < -1 && BalanceFactor(node->right) <= 0)
+            return RotateLeft(node);
+        if (balance < -1 && BalanceFactor(node->right) > 0) {
             node->right = RotateRight(node->right);
             return RotateLeft(node);
         }
         return node;
     }
 
+    AVLNode* Insert(AVLNode* node, AppointmentHandle handle, const Appointment& app) {
+        if (!node) return nodes.Create(handle, app.time, app.appointment_id);
+        if (app.time == node->time) {
+            const Appointment* other = records.Get(node->handle);
+            if (other && app.patient_id == other->patient_id && app.doctor_id == other->doctor_id)
+                throw runtime_error("Xung đột thời gian lịch hẹn cho cùng bệnh nhân và bác sĩ");
+        }
+        if (Less(app.time, app.appointment_id, node->time, node->appointment_id))
+            node->left = Insert(node->left, handle, app);
+        else
+            node->right = Insert(node->right, handle, app);
+        return Rebalance(node);
+    }
+
     AVLNode* FindMin(AVLNode* node) {
         while (node && node->left) node = node->left;
         return node;
     }
 
-    AVLNode* Remove(AVLNode* node, string aid) {
+    AVLNode* Remove(AVLNode* node, time_t time, uint32_t aid) {
         if (!node) return nullptr;
 
-        if (node->appointment->appointment_id == aid) {
+        if (node->time == time && node->appointment_id == aid) {
             if (!node->left) {
                 AVLNode* temp = node->right;
-                delete node;
+                nodes.Destroy(node);
                 return temp;
             }
             if (!node->right) {
                 AVLNode* temp = node->left;
-                delete node;
+                nodes.Destroy(node);
                 return temp;
             }
             AVLNode* minNode = FindMin(node->right);
-            node->appointment = minNode->appointment;
-            node->right = Remove(node->right, minNode->appointment->appointment_id);
+            node->time = minNode->time;
+            node->appointment_id = minNode->appointment_id;
+            node->handle = minNode->handle;
+            node->right = Remove(node->right, minNode->time, minNode->appointment_id);
         }
-        else if (aid < node->appointment->appointment_id) {
-            node->left = Remove(node->left, aid);
+        else if (Less(time, aid, node->time, node->appointment_id)) {
+            node->left = Remove(node->left, time, aid);
         }
         else {
-            node->right = Remove(node->right, aid);
+            node->right = Remove(node->right, time, aid);
         }
 
-        if (!node) return node;
+        return Rebalance(node);
+    }
 
+    // Nút giữa làm gốc, hai nửa làm cây con: kích thước hai bên lệch nhau tối đa 1 nên cây cân bằng
+    AVLNode* Build(const AppointmentHandle* handles, int first, int last) {
+        if (first >= last) return nullptr;
+        int mid = first + (last - first) / 2;
+        const Appointment* app = records.Get(handles[mid]);
+        AVLNode* node = nodes.Create(handles[mid], app->time, app->appointment_id);
+        node->left = Build(handles, first, mid);
+        node->right = Build(handles, mid + 1, last);
         UpdateHeight(node);
-        int balance = BalanceFactor(node);
-
-        if (balance > 1 && BalanceFactor(node->left) >= 0)
-            return RotateRight(node);
-        if (balance > 1 && BalanceFactor(node->left) < 0) {
-            node->left = RotateLeft(node->left);
-            return RotateRight(node);
-        }
-        if (balance < -1 && BalanceFactor(node->right) <= 0)
-            return RotateLeft(node);
-        if (balance < -1 && BalanceFactor(node->right) > 0) {
-            node->right = RotateRight(node->right);
-            return RotateLeft(node);
-        }
-
         return node;
     }
 
@@ -243,180 +697,846 @@ private:
         if (node) {
             Destroy(node->left);
             Destroy(node->right);
-            delete node;
+            nodes.Destroy(node);
         }
     }
 
-    void FindByTimeRange(AVLNode* node, time_t start, time_t end, vector<shared_ptr<Appointment>>& result) {
+    void FindByTimeRange(AVLNode* node, time_t start, time_t end, vector<AppointmentHandle>& result) {
         if (!node) return;
-        if (node->appointment->time >= start && node->appointment->time <= end && node->appointment->is_valid) {
-            result.push_back(node->appointment);
-        }
-        if (node->appointment->time > start) {
+        // Khóa bằng nhau về thời gian có thể nằm ở cả hai cây con
+        if (node->time >= start) {
             FindByTimeRange(node->left, start, end, result);
         }
-        if (node->appointment->time < end) {
+        if (node->time >= start && node->time <= end) {
+            result.push_back(node->handle);
+        }
+        if (node->time <= end) {
             FindByTimeRange(node->right, start, end, result);
         }
     }
 
 public:
-    AVLTree() : root(nullptr) {}
+    // Duyệt trung thứ tự bằng ngăn xếp tường minh; chiều cao AVL luôn nhỏ hơn 64
+    struct Iterator {
+        AVLNode* stack[64];
+        int depth;
+        time_t end_time;
+        Iterator() : depth(0), end_time(0) {}
+        Iterator(AVLNode* root, time_t start, time_t end) : depth(0), end_time(end) {
+            for (AVLNode* node = root; node;) {
+                if (node->time >= start) {
+                    stack[depth++] = node;
+                    node = node->left;
+                }
+                else {
+                    node = node->right;
+                }
+            }
+            if (depth && stack[depth - 1]->time > end_time) depth = 0;
+        }
+        bool Done() const { return depth == 0; }
+        AppointmentHandle operator*() const { return stack[depth - 1]->handle; }
+        time_t Time() const { return stack[depth - 1]->time; }
+        Iterator& operator++() {
+            AVLNode* node = stack[--depth]->right;
+            while (node) {
+                stack[depth++] = node;
+                node = node->left;
+            }
+            if (depth && stack[depth - 1]->time > end_time) depth = 0;
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const {
+            return depth != other.depth || (depth && stack[depth - 1] != other.stack[depth - 1]);
+        }
+    };
+
+    AVLTree(const AppointmentSlab& slab) : root(nullptr), records(slab) {}
+    AVLTree(const AVLTree&) = delete;
+    AVLTree& operator=(const AVLTree&) = delete;
+
+    void Insert(AppointmentHandle handle) {
+        root = Insert(root, handle, *records.Get(handle));
+    }
 
-    void Insert(shared_ptr<Appointment> app) {
-        root = Insert(root, app);
+    // Dựng cây từ count handle đã sắp theo (time, appointment_id) trong O(n), thay cho n lần Insert
+    void BuildSorted(const AppointmentHandle* handles, int count) {
+        if (root) throw runtime_error("Chỉ dựng hàng loạt khi chỉ mục còn rỗng");
+        nodes.Reserve(count);
+        root = Build(handles, 0, count);
     }
 
-    void Remove(string aid) {
-        root = Remove(root, aid);
+    // Truyền khóa hiện tại của bản ghi (trước khi sửa thời gian)
+    void Remove(time_t time, uint32_t aid) {
+        root = Remove(root, time, aid);
     }
 
-    vector<shared_ptr<Appointment>> FindByTimeRange(time_t start, time_t end) {
-        vector<shared_ptr<Appointment>> result;
+    vector<AppointmentHandle> FindByTimeRange(time_t start, time_t end) {
+        vector<AppointmentHandle> result;
         FindByTimeRange(root, start, end, result);
         return result;
     }
 
+    TimeRange<Iterator> Range(time_t start, time_t end) {
+        return TimeRange<Iterator>(Iterator(root, start, end));
+    }
+
+    // Số nút có thời gian nhỏ hơn time
+    int Rank(time_t time) {
+        int rank = 0;
+        AVLNode* node = root;
+        while (node) {
+            if (node->time < time) {
+                rank += Size(node->left) + 1;
+                node = node->right;
+            }
+            else {
+                node = node->left;
+            }
+        }
+        return rank;
+    }
+
+    // Nút thứ k (bắt đầu từ 0) theo thứ tự thời gian; handle rỗng nếu k vượt quá
+    AppointmentHandle Select(int k) {
+        AVLNode* node = root;
+        while (node) {
+            int left = Size(node->left);
+            if (k < left) {
+                node = node->left;
+            }
+            else if (k == left) {
+                return node->handle;
+            }
+            else {
+                k -= left + 1;
+                node = node->right;
+            }
+        }
+        return AppointmentHandle();
+    }
+
+    // Số lịch hẹn trong [start, end], không cần dựng vector kết quả
+    int CountInRange(time_t start, time_t end) {
+        if (end < start) return 0;
+        return Rank(end + 1) - Rank(start);
+    }
+
+    // Lịch hẹn thứ k (từ 0) trong [start, end]; handle rỗng nếu không có
+    AppointmentHandle KthInRange(time_t start, time_t end, int k) {
+        if (k < 0 || k >= CountInRange(start, end)) return AppointmentHandle();
+        return Select(Rank(start) + k);
+    }
+
+    int Size() {
+        return Size(root);
+    }
+
     ~AVLTree() {
-        Destroy(root);
+        if (!TAllocator::kBulkRelease) Destroy(root);
+    }
+};
+
+#define BPLUS_FANOUT 16
+
+// Nút dùng chung cho lá và nút trong. Khóa ghép (time, appointment_id) lưu theo mảng riêng
+// để việc dò khóa chỉ quét 128 byte thời gian liên tiếp (hai dòng cache).
+struct BPlusNode {
+    int count;   // lá: số phần tử; nút trong: số con
+    bool is_leaf;
+    time_t times[BPLUS_FANOUT];   // nút trong: khóa nhỏ nhất của con thứ i
+    uint32_t ids[BPLUS_FANOUT];
+    union Payload {
+        struct {
+            AppointmentHandle handles[BPLUS_FANOUT];
+            BPlusNode* prev;
+            BPlusNode* next;
+        } leaf;
+        struct {
+            BPlusNode* children[BPLUS_FANOUT];
+            int sizes[BPLUS_FANOUT]; // số phần tử của cây con thứ i
+        } inner;
+        Payload() {}
+    } data;
+    BPlusNode(bool leaf_node) : count(0), is_leaf(leaf_node) {
+        if (leaf_node) {
+            data.leaf.prev = nullptr;
+            data.leaf.next = nullptr;
+        }
+    }
+};
+
+// Chỉ mục thời gian dạng B+-tree: nút rộng, các lá nối với nhau nên duyệt khoảng chỉ đi
+// tuần tự qua lá. Cùng giao diện với AVLTree để có thể thay thế và đo so sánh.
+template <typename TAllocator = NodePool<BPlusNode>>
+struct BPlusTree {
+private:
+    BPlusNode* root;
+    const AppointmentSlab& records;
+    TAllocator nodes;
+
+    static const int kMinFill = BPLUS_FANOUT / 4;
+
+    static bool Less(time_t t1, uint32_t id1, time_t t2, uint32_t id2) {
+        return t1 < t2 || (t1 == t2 && id1 < id2);
+    }
+
+    static int Total(BPlusNode* node) {
+        if (node->is_leaf) return node->count;
+        int total = 0;
+        for (int i = 0; i < node->count; i++) total += node->data.inner.sizes[i];
+        return total;
+    }
+
+    // Con cuối cùng có khóa nhỏ nhất <= (time, id); con 0 nếu không có
+    static int ChildFor(BPlusNode* node, time_t time, uint32_t id) {
+        int i = 1;
+        while (i < node->count && !Less(time, id, node->times[i], node->ids[i])) i++;
+        return i - 1;
+    }
+
+    // Con cuối cùng có khóa nhỏ nhất < (time, id); con 0 nếu không có
+    static int ChildBefore(BPlusNode* node, time_t time, uint32_t id) {
+        int i = 1;
+        while (i < node->count && Less(node->times[i], node->ids[i], time, id)) i++;
+        return i - 1;
+    }
+
+    static void CopyEntry(BPlusNode* to, int j, BPlusNode* from, int i) {
+        to->times[j] = from->times[i];
+        to->ids[j] = from->ids[i];
+        if (from->is_leaf) {
+            to->data.leaf.handles[j] = from->data.leaf.handles[i];
+        }
+        else {
+            to->data.inner.children[j] = from->data.inner.children[i];
+            to->data.inner.sizes[j] = from->data.inner.sizes[i];
+        }
+    }
+
+    static void ShiftRight(BPlusNode* node, int from) {
+        for (int i = node->count; i > from; i--) CopyEntry(node, i, node, i - 1);
+        node->count++;
+    }
+
+    static void ShiftLeft(BPlusNode* node, int from) {
+        for (int i = from; i + 1 < node->count; i++) CopyEntry(node, i, node, i + 1);
+        node->count--;
+    }
+
+    static void RefreshKey(BPlusNode* parent, int i) {
+        BPlusNode* child = parent->data.inner.children[i];
+        parent->times[i] = child->times[0];
+        parent->ids[i] = child->ids[0];
+    }
+
+    // Tách nửa sau của node sang nút mới và trả về nút mới
+    BPlusNode* Split(BPlusNode* node) {
+        BPlusNode* sibling = nodes.Create(node->is_leaf);
+        int half = node->count / 2;
+        for (int i = half; i < node->count; i++) CopyEntry(sibling, i - half, node, i);
+        sibling->count = node->count - half;
+        node->count = half;
+        if (node->is_leaf) {
+            sibling->data.leaf.next = node->data.leaf.next;
+            sibling->data.leaf.prev = node;
+            if (node->data.leaf.next) node->data.leaf.next->data.leaf.prev = sibling;
+            node->data.leaf.next = sibling;
+        }
+        return sibling;
+    }
+
+    void InsertChild(BPlusNode* parent, int i, BPlusNode* child) {
+        ShiftRight(parent, i);
+        parent->data.inner.children[i] = child;
+        parent->data.inner.sizes[i] = Total(child);
+        RefreshKey(parent, i);
+    }
+
+    // Trả về nút anh em mới nếu node bị tách
+    BPlusNode* Insert(BPlusNode* node, time_t time, uint32_t id, AppointmentHandle handle) {
+        if (node->is_leaf) {
+            BPlusNode* sibling = nullptr;
+            BPlusNode* target = node;
+            if (node->count == BPLUS_FANOUT) {
+                sibling = Split(node);
+                if (!Less(time, id, sibling->times[0], sibling->ids[0])) target = sibling;
+            }
+            int pos = 0;
+            while (pos < target->count && Less(target->times[pos], target->ids[pos], time, id)) pos++;
+            ShiftRight(target, pos);
+            target->times[pos] = time;
+            target->ids[pos] = id;
+            target->data.leaf.handles[pos] = handle;
+            return sibling;
+        }
+
+        int i = ChildFor(node, time, id);
+        BPlusNode* child = node->data.inner.children[i];
+        BPlusNode* split = Insert(child, time, id, handle);
+        node->data.inner.sizes[i]++;
+        RefreshKey(node, i);
+        if (!split) return nullptr;
+
+        node->data.inner.sizes[i] = Total(child);
+        BPlusNode* sibling = nullptr;
+        BPlusNode* target = node;
+        int pos = i + 1;
+        if (node->count == BPLUS_FANOUT) {
+            sibling = Split(node);
+            if (pos >= node->count) {
+                target = sibling;
+                pos -= node->count;
+            }
+        }
+        InsertChild(target, pos, split);
+        return sibling;
+    }
+
+    // Sửa con thứ i của parent khi con bị thiếu phần tử: mượn từ anh em hoặc gộp
+    void FixUnderflow(BPlusNode* parent, int i) {
+        BPlusNode* child = parent->data.inner.children[i];
+        BPlusNode* left = i > 0 ? parent->data.inner.children[i - 1] : nullptr;
+        BPlusNode* right = i + 1 < parent->count ? parent->data.inner.children[i + 1] : nullptr;
+
+        if (left && left->count > kMinFill) {
+            ShiftRight(child, 0);
+            CopyEntry(child, 0, left, left->count - 1);
+            int moved = child->is_leaf ? 1 : child->data.inner.sizes[0];
+            left->count--;
+            parent->data.inner.sizes[i - 1] -= moved;
+            parent->data.inner.sizes[i] += moved;
+            RefreshKey(parent, i);
+            return;
+        }
+        if (right && right->count > kMinFill) {
+            CopyEntry(child, child->count, right, 0);
+            child->count++;
+            int moved = child->is_leaf ? 1 : child->data.inner.sizes[child->count - 1];
+            ShiftLeft(right, 0);
+            parent->data.inner.sizes[i + 1] -= moved;
+            parent->data.inner.sizes[i] += moved;
+            RefreshKey(parent, i);
+            RefreshKey(parent, i + 1);
+            return;
+        }
+
+        // Gộp con phải vào con trái rồi bỏ con phải khỏi parent
+        int keep = left ? i - 1 : i;
+        BPlusNode* into = parent->data.inner.children[keep];
+        BPlusNode* from = parent->data.inner.children[keep + 1];
+        for (int j = 0; j < from->count; j++) CopyEntry(into, into->count + j, from, j);
+        into->count += from->count;
+        if (into->is_leaf) {
+            into->data.leaf.next = from->data.leaf.next;
+            if (from->data.leaf.next) from->data.leaf.next->data.leaf.prev = into;
+        }
+        parent->data.inner.sizes[keep] += parent->data.inner.sizes[keep + 1];
+        ShiftLeft(parent, keep + 1);
+        nodes.Destroy(from);
+        if (into->count) RefreshKey(parent, keep);
+    }
+
+    bool Remove(BPlusNode* node, time_t time, uint32_t id) {
+        if (node->is_leaf) {
+            for (int pos = 0; pos < node->count; pos++) {
+                if (node->times[pos] == time && node->ids[pos] == id) {
+                    ShiftLeft(node, pos);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        int i = ChildFor(node, time, id);
+        BPlusNode* child = node->data.inner.children[i];
+        if (!Remove(child, time, id)) return false;
+        node->data.inner.sizes[i]--;
+        if (child->count) RefreshKey(node, i);
+        if (child->count < kMinFill && node->count > 1) FixUnderflow(node, i);
+        return true;
+    }
+
+    void Destroy(BPlusNode* node) {
+        if (!node->is_leaf) {
+            for (int i = 0; i < node->count; i++) Destroy(node->data.inner.children[i]);
+        }
+        nodes.Destroy(node);
+    }
+
+    // Chia count phần tử thành các nút đầy; nút cuối quá thưa thì lấy bớt của nút áp chót
+    static vector<int> Chunks(int count) {
+        vector<int> sizes(count / BPLUS_FANOUT, BPLUS_FANOUT);
+        int rest = count % BPLUS_FANOUT;
+        if (rest) {
+            sizes.push_back(rest);
+            if (sizes.size() > 1 && rest < kMinFill) {
+                sizes[sizes.size() - 2] -= kMinFill - rest;
+                sizes.back() = kMinFill;
+            }
+        }
+        return sizes;
+    }
+
+    // Lá chứa phần tử đầu tiên >= (time, 0) cùng vị trí của nó
+    BPlusNode* LowerBound(time_t time, int& pos) {
+        BPlusNode* node = root;
+        while (!node->is_leaf) node = node->data.inner.children[ChildBefore(node, time, 0)];
+        pos = 0;
+        while (pos < node->count && node->times[pos] < time) pos++;
+        if (pos == node->count) {
+            node = node->data.leaf.next;
+            pos = 0;
+        }
+        return node;
+    }
+
+public:
+    struct Iterator {
+        BPlusNode* leaf;
+        int pos;
+        time_t end_time;
+        Iterator() : leaf(nullptr), pos(0), end_time(0) {}
+        Iterator(BPlusNode* node, int p, time_t end) : leaf(node), pos(p), end_time(end) {
+            if (leaf && leaf->times[pos] > end_time) {
+                leaf = nullptr;
+                pos = 0;
+            }
+        }
+        bool Done() const { return !leaf; }
+        AppointmentHandle operator*() const { return leaf->data.leaf.handles[pos]; }
+        time_t Time() const { return leaf->times[pos]; }
+        Iterator& operator++() {
+            if (++pos == leaf->count) {
+                leaf = leaf->data.leaf.next;
+                pos = 0;
+            }
+            if (leaf && leaf->times[pos] > end_time) {
+                leaf = nullptr;
+                pos = 0;
+            }
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const { return leaf != other.leaf || pos != other.pos; }
+    };
+
+    BPlusTree(const AppointmentSlab& slab) : records(slab) {
+        root = nodes.Create(true);
+    }
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    void Insert(AppointmentHandle handle) {
+        const Appointment* app = records.Get(handle);
+        BPlusNode* split = Insert(root, app->time, app->appointment_id, handle);
+        if (split) {
+            BPlusNode* new_root = nodes.Create(false);
+            InsertChild(new_root, 0, root);
+            InsertChild(new_root, 1, split);
+            root = new_root;
+        }
+    }
+
+    // Dựng cây từ dưới lên với count handle đã sắp theo (time, appointment_id): lấp đầy lá theo thứ tự,
+    // rồi mỗi tầng trên gom tối đa BPLUS_FANOUT nút của tầng dưới. O(n), thay cho n lần Insert.
+    void BuildSorted(const AppointmentHandle* handles, int count) {
+        if (Total(root)) throw runtime_error("Chỉ dựng hàng loạt khi chỉ mục còn rỗng");
+        if (count == 0) return;
+        nodes.Reserve(count / (BPLUS_FANOUT - 1) + 2); // số lá cộng các tầng trên
+        vector<BPlusNode*> level;
+        BPlusNode* prev = nullptr;
+        int pos = 0;
+        for (int size : Chunks(count)) {
+            BPlusNode* leaf = nodes.Create(true);
+            for (int i = 0; i < size; i++, pos++) {
+                const Appointment* app = records.Get(handles[pos]);
+                leaf->times[i] = app->time;
+                leaf->ids[i] = app->appointment_id;
+                leaf->data.leaf.handles[i] = handles[pos];
+            }
+            leaf->count = size;
+            leaf->data.leaf.prev = prev;
+            if (prev) prev->data.leaf.next = leaf;
+            prev = leaf;
+            level.push_back(leaf);
+        }
+        while (level.size() > 1) {
+            vector<BPlusNode*> parents;
+            size_t next = 0;
+            for (int size : Chunks((int)level.size())) {
+                BPlusNode* parent = nodes.Create(false);
+                for (int i = 0; i < size; i++) InsertChild(parent, i, level[next++]);
+                parents.push_back(parent);
+            }
+            level.swap(parents);
+        }
+        nodes.Destroy(root);
+        root = level[0];
+    }
+
+    // Truyền khóa hiện tại của bản ghi (trước khi sửa thời gian)
+    void Remove(time_t time, uint32_t aid) {
+        Remove(root, time, aid);
+        if (!root->is_leaf && root->count == 1) {
+            BPlusNode* old_root = root;
+            root = root->data.inner.children[0];
+            nodes.Destroy(old_root);
+        }
+    }
+
+    TimeRange<Iterator> Range(time_t start, time_t end) {
+        int pos;
+        BPlusNode* leaf = LowerBound(start, pos);
+        return TimeRange<Iterator>(Iterator(leaf, pos, end));
+    }
+
+    vector<AppointmentHandle> FindByTimeRange(time_t start, time_t end) {
+        vector<AppointmentHandle> result;
+        for (AppointmentHandle handle : Range(start, end)) result.push_back(handle);
+        return result;
+    }
+
+    // Số nút có thời gian nhỏ hơn time
+    int Rank(time_t time) {
+        int rank = 0;
+        BPlusNode* node = root;
+        while (!node->is_leaf) {
+            int i = ChildBefore(node, time, 0);
+            for (int j = 0; j < i; j++) rank += node->data.inner.sizes[j];
+            node = node->data.inner.children[i];
+        }
+        for (int pos = 0; pos < node->count && node->times[pos] < time; pos++) rank++;
+        return rank;
+    }
+
+    // Nút thứ k (bắt đầu từ 0) theo thứ tự thời gian; handle rỗng nếu k vượt quá
+    AppointmentHandle Select(int k) {
+        if (k < 0 || k >= Size()) return AppointmentHandle();
+        BPlusNode* node = root;
+        while (!node->is_leaf) {
+            int i = 0;
+            while (k >= node->data.inner.sizes[i]) k -= node->data.inner.sizes[i++];
+            node = node->data.inner.children[i];
+        }
+        return node->data.leaf.handles[k];
+    }
+
+    int CountInRange(time_t start, time_t end) {
+        if (end < start) return 0;
+        return Rank(end + 1) - Rank(start);
+    }
+
+    AppointmentHandle KthInRange(time_t start, time_t end, int k) {
+        if (k < 0 || k >= CountInRange(start, end)) return AppointmentHandle();
+        return Select(Rank(start) + k);
+    }
+
+    int Size() {
+        return Total(root);
+    }
+
+    ~BPlusTree() {
+        if (!TAllocator::kBulkRelease) Destroy(root);
     }
 };
 
 struct PQNode {
-    shared_ptr<Appointment> appointment;
-    PQNode(shared_ptr<Appointment> app) : appointment(app) {}
+    time_t time;
+    AppointmentHandle handle;
+    PQNode(AppointmentHandle h, time_t t) : time(t), handle(h) {}
 };
 
+// Heap 4 nhánh có chỉ mục: vị trí của từng lịch hẹn trong heap được ghi theo ô slab,
+// nên hủy hoặc đổi giờ là một lần vun đống O(log n) thay vì để lại bản sao/bia mộ.
 struct PriorityQueue {
 private:
-    PQNode** heap;
-    int capacity;
-    int size;
+    vector<PQNode> heap;
+    vector<int> positions; // theo AppointmentHandle::index, -1 nếu không có trong heap
+    const AppointmentSlab& records;
+
+    static const int kArity = 4;
 
-    int Parent(int i) { return (i - 1) / 2; }
-    int Left(int i) { return 2 * i + 1; }
-    int Right(int i) { return 2 * i + 2; }
+    int Parent(int i) { return (i - 1) / kArity; }
+    int FirstChild(int i) { return kArity * i + 1; }
 
-    void Heapify(int i) {
-        int smallest = i;
-        int left = Left(i);
-        int right = Right(i);
-        if (left < size && heap[left]->appointment->time < heap[smallest]->appointment->time)
-            smallest = left;
-        if (right < size && heap[right]->appointment->time < heap[smallest]->appointment->time)
-            smallest = right;
-        if (smallest != i) {
-            swap(heap[i], heap[smallest]);
-            Heapify(smallest);
+    void Place(int i, const PQNode& node) {
+        heap[i] = node;
+        positions[node.handle.index] = i;
+    }
+
+    void SiftUp(int i) {
+        PQNode node = heap[i];
+        while (i > 0 && heap[Parent(i)].time > node.time) {
+            Place(i, heap[Parent(i)]);
+            i = Parent(i);
         }
+        Place(i, node);
+    }
+
+    void SiftDown(int i) {
+        PQNode node = heap[i];
+        int size = (int)heap.size();
+        while (true) {
+            int first = FirstChild(i);
+            if (first >= size) break;
+            int smallest = first;
+            int last = min(first + kArity, size);
+            for (int c = first + 1; c < last; c++) {
+                if (heap[c].time < heap[smallest].time) smallest = c;
+            }
+            if (heap[smallest].time >= node.time) break;
+            Place(i, heap[smallest]);
+            i = smallest;
+        }
+        Place(i, node);
+    }
+
+    int PositionOf(AppointmentHandle handle) {
+        if (handle.index >= positions.size()) return -1;
+        int i = positions[handle.index];
+        return (i >= 0 && heap[i].handle == handle) ? i : -1;
+    }
+
+    void RemoveAt(int i) {
+        positions[heap[i].handle.index] = -1;
+        PQNode last = heap.back();
+        heap.pop_back();
+        if (i == (int)heap.size()) return;
+        Place(i, last);
+        SiftUp(i);
+        SiftDown(positions[last.handle.index]);
     }
 
 public:
-    PriorityQueue(int cap = 100) : capacity(cap), size(0) {
-        heap = new PQNode * [capacity];
+    PriorityQueue(const AppointmentSlab& slab, int cap = 100) : records(slab) {
+        heap.reserve(cap);
     }
 
-    void Push(shared_ptr<Appointment> app) {
-        if (size >= capacity) throw runtime_error("Hàng đợi ưu tiên đã đầy");
-        heap[size] = new PQNode(app);
-        int i = size++;
-        while (i > 0 && heap[Parent(i)]->appointment->time > heap[i]->appointment->time) {
-            swap(heap[i], heap[Parent(i)]);
-            i = Parent(i);
+    // Thêm lịch hẹn; nếu đã có trong heap thì chỉ cập nhật lại vị trí theo thời gian mới
+    void Push(AppointmentHandle handle) {
+        time_t time = records.Get(handle)->time;
+        int i = PositionOf(handle);
+        if (i >= 0) {
+            heap[i].time = time;
+            SiftUp(i);
+            SiftDown(positions[handle.index]);
+            return;
         }
+        if (handle.index >= positions.size()) positions.resize(handle.index + 1, -1);
+        heap.push_back(PQNode(handle, time));
+        SiftUp((int)heap.size() - 1);
     }
 
-    shared_ptr<Appointment> Pop() {
-        if (size == 0) throw runtime_error("Hàng đợi ưu tiên rỗng");
-        while (size > 0 && !heap[0]->appointment->is_valid) {
-            delete heap[0];
-            heap[0] = heap[--size];
-            Heapify(0);
+    // Mảng đã sắp tăng dần theo thời gian vốn là một heap hợp lệ nên chỉ cần chép vào; heap phải rỗng
+    void BuildSorted(const AppointmentHandle* handles, int count) {
+        if (!heap.empty()) throw runtime_error("Chỉ dựng hàng loạt khi hàng đợi còn rỗng");
+        heap.reserve(count);
+        size_t max_index = positions.size();
+        for (int i = 0; i < count; i++) max_index = max(max_index, (size_t)handles[i].index + 1);
+        positions.resize(max_index, -1);
+        for (int i = 0; i < count; i++) {
+            heap.push_back(PQNode(handles[i], records.Get(handles[i])->time));
+            positions[handles[i].index] = i;
         }
-        if (size == 0) throw runtime_error("Hàng đợi ưu tiên rỗng");
-        shared_ptr<Appointment> result = heap[0]->appointment;
-        delete heap[0];
-        heap[0] = heap[--size];
-        Heapify(0);
+    }
+
+    void Remove(AppointmentHandle handle) {
+        int i = PositionOf(handle);
+        if (i >= 0) RemoveAt(i);
+    }
+
+    bool Contains(AppointmentHandle handle) {
+        return PositionOf(handle) >= 0;
+    }
+
+    AppointmentHandle Top() {
+        if (heap.empty()) throw runtime_error("Hàng đợi ưu tiên rỗng");
+        return heap[0].handle;
+    }
+
+    AppointmentHandle Pop() {
+        if (heap.empty()) throw runtime_error("Hàng đợi ưu tiên rỗng");
+        AppointmentHandle result = heap[0].handle;
+        RemoveAt(0);
         return result;
     }
 
-    bool IsEmpty() {
-        while (size > 0 && !heap[0]->appointment->is_valid) {
-            delete heap[0];
-            heap[0] = heap[--size];
-            Heapify(0);
+    // Bỏ khỏi heap mọi lịch hẹn có thời gian <= time (đã qua, không còn cần nhắc)
+    int PopUntil(time_t time, int max_count = INT_MAX) {
+        int popped = 0;
+        while (!heap.empty() && heap[0].time <= time && popped < max_count) {
+            RemoveAt(0);
+            popped++;
         }
-        return size == 0;
+        return popped;
     }
 
-    ~PriorityQueue() {
-        for (int i = 0; i < size; i++) delete heap[i];
-        delete[] heap;
+    // Duyệt theo thứ tự thời gian mọi lịch hẹn có thời gian <= limit mà không sửa heap.
+    // Chỉ mở rộng các nút thỏa điều kiện nên chi phí là O(k log k) với k kết quả.
+    template <typename TVisitor>
+    void ForEachUntil(time_t limit, TVisitor visit) {
+        if (heap.empty() || heap[0].time > limit) return;
+        auto later = [this](int a, int b) { return heap[a].time > heap[b].time; };
+        vector<int> frontier(1, 0);
+        while (!frontier.empty()) {
+            pop_heap(frontier.begin(), frontier.end(), later);
+            int i = frontier.back();
+            frontier.pop_back();
+            visit(heap[i].handle);
+            int first = FirstChild(i);
+            int last = min(first + kArity, (int)heap.size());
+            for (int c = first; c < last; c++) {
+                if (heap[c].time <= limit) {
+                    frontier.push_back(c);
+                    push_heap(frontier.begin(), frontier.end(), later);
+                }
+            }
+        }
+    }
+
+    bool IsEmpty() {
+        return heap.empty();
+    }
+
+    int Size() {
+        return (int)heap.size();
     }
 };
 
-struct DLLNode {
-    shared_ptr<Appointment> appointment;
-    DLLNode* prev;
-    DLLNode* next;
-    DLLNode(shared_ptr<Appointment> app) : appointment(app), prev(nullptr), next(nullptr) {}
+#define SLOT_MINUTES 30
+#define SLOTS_PER_DAY (24 * 60 / SLOT_MINUTES)
+
+struct FreeSlot {
+    time_t time;
+    uint32_t doctor_id;
 };
 
-struct DoublyLinkedList {
+// Chỉ số của bit 1 thấp nhất, x khác 0
+inline int LowestBit(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// Bitmap chiếm chỗ theo ngày của từng bác sĩ: bit i = 1 nếu ô SLOT_MINUTES phút thứ i
+// trong ngày giao với một lịch hẹn còn hiệu lực. Một ngày vừa một từ 64 bit, nên một phép
+// AND/OR xét cùng lúc cả 48 ô; ngày không có lịch hẹn không được lưu.
+struct OccupancyMap {
 private:
-    DLLNode* head;
-    DLLNode* tail;
+    Hashmap<uint64_t, uint64_t> days; // khóa = (bác sĩ << 32) | ngày
+    time_t origin; // thời điểm 00:00 của ngày 0, cùng hệ quy chiếu với Appointment::time
+
+    static uint64_t Key(uint32_t doctor, int64_t day) {
+        return ((uint64_t)doctor << 32) | (uint32_t)day;
+    }
+
+    static const uint64_t kDayMask = (1ULL << SLOTS_PER_DAY) - 1;
+
+    // Các ô có [đầu ô, cuối ô) nằm trong [start, end) của ngày day
+    uint64_t SlotsWithin(int64_t day, time_t start, time_t end) const {
+        time_t day_start = DayStart(day);
+        int64_t first = max<int64_t>(0, (start - day_start + SLOT_MINUTES * 60 - 1) / (SLOT_MINUTES * 60));
+        int64_t last = min<int64_t>(SLOTS_PER_DAY, (end - day_start) / (SLOT_MINUTES * 60));
+        if (first >= last) return 0;
+        return (kDayMask >> (SLOTS_PER_DAY - (last - first))) << first;
+    }
+
+    // Các ô giao với [start, end) trong ngày day
+    uint64_t SlotsTouching(int64_t day, time_t start, time_t end) const {
+        time_t day_start = DayStart(day);
+        int64_t first = max<int64_t>(0, (start - day_start) / (SLOT_MINUTES * 60));
+        int64_t last = min<int64_t>(SLOTS_PER_DAY, (end - day_start + SLOT_MINUTES * 60 - 1) / (SLOT_MINUTES * 60));
+        if (start >= end || first >= last) return 0;
+        return (kDayMask >> (SLOTS_PER_DAY - (last - first))) << first;
+    }
+
+    void Store(uint32_t doctor, int64_t day, uint64_t bits) {
+        uint64_t* word = days.Find(Key(doctor, day));
+        if (word && bits) *word = bits;
+        else if (word) days.Remove(Key(doctor, day));
+        else if (bits) days.Insert(Key(doctor, day), bits);
+    }
 
 public:
-    DoublyLinkedList() : head(nullptr), tail(nullptr) {}
+    OccupancyMap(time_t day_origin = 0) : origin(day_origin) {}
 
-    void Append(shared_ptr<Appointment> app) {
-        DLLNode* newNode = new DLLNode(app);
-        if (!head) {
-            head = tail = newNode;
-            return;
+    int64_t DayOf(time_t t) const {
+        int64_t offset = (int64_t)(t - origin);
+        return offset >= 0 ? offset / 86400 : -((-offset + 86399) / 86400);
+    }
+
+    time_t DayStart(int64_t day) const {
+        return origin + (time_t)(day * 86400);
+    }
+
+    uint64_t Get(uint32_t doctor, int64_t day) {
+        uint64_t* word = days.Find(Key(doctor, day));
+        return word ? *word : 0;
+    }
+
+    void Mark(uint32_t doctor, time_t start, time_t end) {
+        if (end <= start) return;
+        for (int64_t day = DayOf(start); day <= DayOf(end - 1); day++) {
+            Store(doctor, day, Get(doctor, day) | SlotsTouching(day, start, end));
         }
-        tail->next = newNode;
-        newNode->prev = tail;
-        tail = newNode;
     }
 
-    void Remove(string appointment_id) {
-        DLLNode* current = head;
-        while (current) {
-            if (current->appointment->appointment_id == appointment_id) {
-                if (current->prev) current->prev->next = current->next;
-                else head = current->next;
-                if (current->next) current->next->prev = current->prev;
-                else tail = current->prev;
-                delete current;
-                return;
+    // Dựng lại các ngày mà [start, end) đi qua từ chỉ mục thời gian của bác sĩ (đã bỏ lịch hẹn cũ).
+    // Lịch hẹn của một bác sĩ không chồng nhau nên chỉ một lịch hẹn bắt đầu trước ngày có thể tràn sang.
+    template <typename TIndex>
+    void Unmark(uint32_t doctor, time_t start, time_t end, TIndex& index, const AppointmentSlab& records) {
+        if (end <= start) return;
+        for (int64_t day = DayOf(start); day <= DayOf(end - 1); day++) {
+            time_t day_start = DayStart(day);
+            time_t day_end = DayStart(day + 1);
+            uint64_t bits = 0;
+            int before = index.Rank(day_start);
+            const Appointment* app = before ? records.Get(index.Select(before - 1)) : nullptr;
+            if (app) bits |= SlotsTouching(day, app->time, app->EndTime());
+            for (AppointmentHandle handle : index.Range(day_start, day_end - 1)) {
+                app = records.Get(handle);
+                if (app) bits |= SlotsTouching(day, app->time, app->EndTime());
             }
-            current = current->next;
+            Store(doctor, day, bits);
         }
     }
 
-    vector<shared_ptr<Appointment>> FindByDoctor(string doctor_id) {
-        vector<shared_ptr<Appointment>> result;
-        DLLNode* current = head;
-        while (current) {
-            if (current->appointment->doctor_id == doctor_id && current->appointment->is_valid) {
-                result.push_back(current->appointment);
+    // Tối đa limit ô trống sớm nhất trong [from, to) theo thứ tự thời gian. Mặc định một ô là trống
+    // nếu ít nhất một bác sĩ trống (AND các bitmap chiếm chỗ); require_all đòi mọi bác sĩ cùng trống (OR).
+    vector<FreeSlot> FindFree(const vector<uint32_t>& doctors, time_t from, time_t to, int limit, bool require_all = false) {
+        vector<FreeSlot> result;
+        if (doctors.empty() || to <= from || limit <= 0) return result;
+        vector<uint64_t> words(doctors.size());
+        for (int64_t day = DayOf(from); day <= DayOf(to - 1) && (int)result.size() < limit; day++) {
+            uint64_t busy_all = kDayMask;
+            uint64_t busy_any = 0;
+            for (size_t i = 0; i < doctors.size(); i++) {
+                words[i] = Get(doctors[i], day);
+                busy_all &= words[i];
+                busy_any |= words[i];
+            }
+            uint64_t free = ~(require_all ? busy_any : busy_all) & SlotsWithin(day, from, to);
+            while (free && (int)result.size() < limit) {
+                int slot = LowestBit(free);
+                size_t i = 0;
+                while (words[i] >> slot & 1) i++; // bác sĩ đầu tiên trống ở ô này
+                FreeSlot item;
+                item.time = DayStart(day) + (time_t)slot * SLOT_MINUTES * 60;
+                item.doctor_id = doctors[i];
+                result.push_back(item);
+                free &= free - 1;
             }
-            current = current->next;
         }
         return result;
     }
 
-    ~DoublyLinkedList() {
-        DLLNode* current = head;
-        while (current) {
-            DLLNode* temp = current;
-            current = current->next;
-            delete temp;
-        }
+    size_t Size() const {
+        return days.Size();
     }
 };
 
-#endif 
\ No newline at end of file
+#endif
@@ -0,0 +1,403 @@
+#ifndef BULK_IMPORT_H
+#define BULK_IMPORT_H
+
+#include "appointment_structures.h"
+#include "snapshot.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <exception>
+#include <cstring>
+
+using namespace std;
+
+// Dưới ngưỡng này đọc bằng một luồng, chia nhỏ hơn chỉ tốn công tạo luồng
+#define IMPORT_MIN_CHUNK_BYTES (1 << 20)
+
+// Các trường của một dòng dữ liệu nhập, còn ở dạng chuỗi gốc
+struct ImportFields {
+    string appointment_id;
+    string patient_id;
+    string doctor_id;
+    string time;
+    string status;
+    string duration;
+};
+
+// Dòng đã qua kiểm tra ở luồng đọc, sẵn sàng đưa vào hệ thống
+struct ImportRow {
+    string appointment_id;
+    string patient_id;
+    string doctor_id;
+    time_t time;
+    TrangThai status;
+    uint16_t duration;
+    size_t line; // số dòng trong tệp, bắt đầu từ 1
+};
+
+struct ImportReject {
+    size_t line;
+    string reason;
+    string text; // nội dung dòng gốc để sửa rồi nhập lại
+    ImportReject(size_t l, const string& r, const string& t) : line(l), reason(r), text(t) {}
+};
+
+struct ImportResult {
+    vector<ImportRow> rows; // theo thứ tự trong tệp
+    vector<ImportReject> rejects;
+    size_t lines; // số dòng dữ liệu, không tính tiêu đề và dòng trống
+    ImportResult() : lines(0) {}
+};
+
+// Chạy song song ở các luồng đọc: kiểm tra và chuyển đổi các trường, ném lỗi nếu dòng không hợp lệ
+typedef function<ImportRow(const ImportFields&)> ImportConverter;
+
+// Thứ tự cột mặc định của CSV khi không có dòng tiêu đề; NDJSON dùng cùng các tên này làm khóa
+static const char* const IMPORT_COLUMNS[] = { "appointment_id", "patient_id", "doctor_id", "time", "status", "duration" };
+#define IMPORT_COLUMN_COUNT 6
+
+inline string* ImportField(ImportFields& fields, int column) {
+    switch (column) {
+    case 0: return &fields.appointment_id;
+    case 1: return &fields.patient_id;
+    case 2: return &fields.doctor_id;
+    case 3: return &fields.time;
+    case 4: return &fields.status;
+    case 5: return &fields.duration;
+    default: return nullptr;
+    }
+}
+
+inline int ImportColumn(const string& name) {
+    for (int i = 0; i < IMPORT_COLUMN_COUNT; i++) {
+        if (name == IMPORT_COLUMNS[i]) return i;
+    }
+    return -1;
+}
+
+// Tách một dòng CSV; trường trong ngoặc kép có thể chứa dấu phẩy, "" là một dấu ngoặc kép
+inline void SplitCsvLine(const char* p, const char* end, vector<string>& out) {
+    out.clear();
+    while (true) {
+        string field;
+        if (p < end && *p == '"') {
+            p++;
+            while (true) {
+                if (p == end) throw runtime_error("Thiếu dấu ngoặc kép đóng");
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        field += '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                field += *p++;
+            }
+            if (p < end && *p != ',') throw runtime_error("Ký tự thừa sau dấu ngoặc kép đóng");
+        }
+        else {
+            const char* start = p;
+            while (p < end && *p != ',') p++;
+            field.assign(start, p);
+        }
+        out.push_back(move(field));
+        if (p == end) return;
+        p++; // dấu phẩy
+    }
+}
+
+inline void AppendUtf8(string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += (char)code;
+    }
+    else if (code < 0x800) {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000) {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+    else {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+// Bộ đọc một đối tượng JSON phẳng trên một dòng: giá trị là chuỗi, số, true/false hoặc null
+struct JsonLineReader {
+    const char* p;
+    const char* end;
+
+    JsonLineReader(const char* begin, const char* stop) : p(begin), end(stop) {}
+
+    void SkipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+    }
+
+    void Expect(char c) {
+        SkipSpace();
+        if (p == end || *p != c) throw runtime_error(string("JSON không hợp lệ: thiếu '") + c + "'");
+        p++;
+    }
+
+    uint32_t Hex4() {
+        if (end - p < 4) throw runtime_error("JSON không hợp lệ: \\u thiếu chữ số");
+        uint32_t code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p++;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else throw runtime_error("JSON không hợp lệ: \\u thiếu chữ số");
+        }
+        return code;
+    }
+
+    string String() {
+        Expect('"');
+        string out;
+        while (true) {
+            if (p == end) throw runtime_error("JSON không hợp lệ: chuỗi chưa đóng");
+            char c = *p++;
+            if (c == '"') return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (p == end) throw runtime_error("JSON không hợp lệ: chuỗi chưa đóng");
+            c = *p++;
+            switch (c) {
+            case '"': case '\\': case '/': out += c; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code = Hex4();
+                if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    p += 2;
+                    uint32_t low = Hex4();
+                    if (low < 0xDC00 || low > 0xDFFF) throw runtime_error("JSON không hợp lệ: cặp thay thế UTF-16 sai");
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(out, code);
+                break;
+            }
+            default: throw runtime_error(string("JSON không hợp lệ: thoát chuỗi \\") + c);
+            }
+        }
+    }
+
+    // Số, true/false giữ nguyên dạng chữ; null coi như không có trường
+    string Scalar() {
+        SkipSpace();
+        if (p < end && *p == '"') return String();
+        const char* start = p;
+        while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t') p++;
+        string word(start, p);
+        if (word == "null") return "";
+        if (word.empty() || word[0] == '{' || word[0] == '[') {
+            throw runtime_error("JSON không hợp lệ: chỉ hỗ trợ giá trị chuỗi hoặc số");
+        }
+        return word;
+    }
+
+    void Read(ImportFields& fields) {
+        Expect('{');
+        SkipSpace();
+        if (p < end && *p == '}') {
+            p++;
+        }
+        else {
+            while (true) {
+                string key = String();
+                Expect(':');
+                string value = Scalar();
+                string* field = ImportField(fields, ImportColumn(key));
+                if (field) *field = move(value);
+                SkipSpace();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                Expect('}');
+                break;
+            }
+        }
+        SkipSpace();
+        if (p != end) throw runtime_error("JSON không hợp lệ: ký tự thừa sau '}'");
+    }
+};
+
+// Phần việc của một luồng đọc: các dòng nằm trọn trong [begin, end)
+struct ImportChunk {
+    const char* begin;
+    const char* end;
+    size_t first_line; // số thứ tự (từ 0) của dòng đầu khúc trong tệp
+    ImportResult result;
+};
+
+class BulkImporter {
+private:
+    bool json;
+    vector<int> columns; // CSV: cột thứ i trong dòng chứa trường nào, -1 nếu bỏ qua
+    const ImportConverter& convert;
+
+    static string Clean(const string& text) {
+        size_t first = text.find_first_not_of(" \t");
+        if (first == string::npos) return "";
+        return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    }
+
+    void ParseLine(const char* begin, const char* end, ImportFields& fields, vector<string>& cells) const {
+        if (json) {
+            JsonLineReader(begin, end).Read(fields);
+            return;
+        }
+        SplitCsvLine(begin, end, cells);
+        if (cells.size() > columns.size()) throw runtime_error("Dòng có nhiều cột hơn tiêu đề");
+        for (size_t i = 0; i < cells.size(); i++) {
+            string* field = ImportField(fields, columns[i]);
+            if (field) *field = move(cells[i]);
+        }
+    }
+
+    void Run(ImportChunk& chunk) const {
+        ImportFields fields;
+        vector<string> cells;
+        size_t line = chunk.first_line;
+        const char* p = chunk.begin;
+        while (p < chunk.end) {
+            const char* newline = (const char*)memchr(p, '\n', chunk.end - p);
+            const char* stop = newline ? newline : chunk.end;
+            const char* next = newline ? newline + 1 : chunk.end;
+            line++;
+            const char* last = stop;
+            if (last > p && last[-1] == '\r') last--;
+            const char* first = p;
+            while (first < last && (*first == ' ' || *first == '\t')) first++;
+            p = next;
+            if (first == last) continue; // dòng trống
+            chunk.result.lines++;
+            try {
+                fields = ImportFields();
+                ParseLine(first, last, fields, cells);
+                chunk.result.rows.push_back(convert(fields));
+                chunk.result.rows.back().line = line;
+            }
+            catch (const exception& e) {
+                chunk.result.rejects.emplace_back(line, e.what(), string(first, last));
+            }
+        }
+    }
+
+public:
+    BulkImporter(const ImportConverter& converter) : json(false), convert(converter) {
+        for (int i = 0; i < IMPORT_COLUMN_COUNT; i++) columns.push_back(i);
+    }
+
+    // Đọc cả tệp bằng tối đa threads luồng, mỗi luồng một khúc liền các dòng. Định dạng NDJSON nếu
+    // ký tự đầu tiên là '{', ngược lại là CSV; dòng CSV đầu tiên là tiêu đề nếu có cột appointment_id.
+    ImportResult Read(const string& path, int threads) {
+        MappedFile file;
+        if (!file.Open(path)) throw runtime_error("Không tìm thấy tệp nhập: " + path);
+        const char* begin = file.data;
+        const char* end = file.data + file.size;
+        if (end - begin >= 3 && memcmp(begin, "\xEF\xBB\xBF", 3) == 0) begin += 3; // BOM UTF-8
+        const char* first = begin;
+        while (first < end && (*first == ' ' || *first == '\t' || *first == '\r' || *first == '\n')) first++;
+        json = first < end && *first == '{';
+
+        size_t header_lines = 0;
+        if (!json && begin < end) {
+            const char* newline = (const char*)memchr(begin, '\n', end - begin);
+            const char* stop = newline ? newline : end;
+            const char* last = stop > begin && stop[-1] == '\r' ? stop - 1 : stop;
+            vector<string> cells;
+            SplitCsvLine(begin, last, cells);
+            bool header = false;
+            for (string& cell : cells) header = header || Clean(cell) == "appointment_id";
+            if (header) {
+                columns.clear();
+                for (string& cell : cells) {
+                    int column = ImportColumn(Clean(cell));
+                    if (column >= 0 && find(columns.begin(), columns.end(), column) != columns.end()) {
+                        throw runtime_error("Tiêu đề CSV lặp cột " + Clean(cell));
+                    }
+                    columns.push_back(column);
+                }
+                begin = newline ? newline + 1 : end;
+                header_lines = 1;
+            }
+        }
+
+        // Chia theo số byte rồi lùi ranh giới về sau dấu xuống dòng gần nhất
+        size_t size = end - begin;
+        size_t count = max<size_t>(1, min<size_t>((size_t)max(threads, 1), size / IMPORT_MIN_CHUNK_BYTES));
+        vector<ImportChunk> chunks(count);
+        const char* start = begin;
+        for (size_t i = 0; i < count; i++) {
+            const char* stop = i + 1 == count ? end : max(start, begin + size / count * (i + 1));
+            if (stop < end) {
+                const char* newline = (const char*)memchr(stop, '\n', end - stop);
+                stop = newline ? newline + 1 : end;
+            }
+            chunks[i].begin = start;
+            chunks[i].end = stop;
+            start = stop;
+        }
+
+        // Đếm trước số dòng của từng khúc để mỗi luồng biết số dòng thật khi báo lỗi
+        size_t line = header_lines;
+        for (ImportChunk& chunk : chunks) {
+            chunk.first_line = line;
+            for (const char* p = chunk.begin; p < chunk.end; line++) {
+                const char* newline = (const char*)memchr(p, '\n', chunk.end - p);
+                p = newline ? newline + 1 : chunk.end;
+            }
+        }
+        vector<thread> workers;
+        vector<exception_ptr> failures(count);
+        for (size_t i = 1; i < count; i++) {
+            workers.emplace_back([this, &chunks, &failures, i] {
+                try {
+                    Run(chunks[i]);
+                }
+                catch (...) {
+                    failures[i] = current_exception();
+                }
+            });
+        }
+        try {
+            Run(chunks[0]);
+        }
+        catch (...) {
+            failures[0] = current_exception();
+        }
+        for (thread& worker : workers) worker.join();
+        for (exception_ptr& failure : failures) {
+            if (failure) rethrow_exception(failure);
+        }
+
+        ImportResult result = move(chunks[0].result);
+        for (size_t i = 1; i < count; i++) {
+            ImportResult& part = chunks[i].result;
+            result.lines += part.lines;
+            result.rows.insert(result.rows.end(), make_move_iterator(part.rows.begin()), make_move_iterator(part.rows.end()));
+            result.rejects.insert(result.rejects.end(), make_move_iterator(part.rejects.begin()),
+                make_move_iterator(part.rejects.end()));
+        }
+        return result;
+    }
+};
+
+#endif
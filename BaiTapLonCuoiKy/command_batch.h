@@ -0,0 +1,126 @@
+#ifndef COMMAND_BATCH_H
+#define COMMAND_BATCH_H
+
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <functional>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// Kích thước bộ đệm đọc lệnh và ghi kết quả của chế độ chạy lô
+#define BATCH_BUFFER_BYTES (1 << 20)
+
+// streambuf gom kết quả vào một bộ đệm lớn và chỉ ghi ra FILE* khi đầy hoặc khi Flush, thay cho
+// endl xả stdout sau mỗi dòng. before_write chạy trước mỗi lần ghi ra ngoài: chế độ chạy lô dùng nó
+// để chờ nhật ký bền vững, nên một dòng kết quả chỉ xuất hiện khi thao tác của nó đã được ghi chắc.
+class OutputBuffer : public streambuf {
+private:
+    FILE* file;
+    vector<char> buffer;
+    function<void()> before_write;
+
+    void WriteOut() {
+        size_t size = pptr() - pbase();
+        if (size == 0) return;
+        if (before_write) before_write();
+        if (fwrite(pbase(), 1, size, file) != size) throw runtime_error("Không ghi được kết quả");
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        WriteOut();
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+    int sync() override {
+        Flush();
+        return 0;
+    }
+
+public:
+    OutputBuffer(FILE* output, const function<void()>& before = nullptr)
+        : file(output), buffer(BATCH_BUFFER_BYTES), before_write(before) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void Flush() {
+        WriteOut();
+        fflush(file);
+    }
+};
+
+// Đọc từng dòng từ FILE* qua một bộ đệm lớn; dòng không gồm '\n' và '\r' ở cuối
+class LineReader {
+private:
+    FILE* file;
+    vector<char> buffer;
+    size_t begin;
+    size_t end;
+    bool eof;
+
+public:
+    LineReader(FILE* input) : file(input), buffer(BATCH_BUFFER_BYTES), begin(0), end(0), eof(false) {}
+
+    bool Next(string& line) {
+        line.clear();
+        while (true) {
+            const char* start = buffer.data() + begin;
+            const char* newline = (const char*)memchr(start, '\n', end - begin);
+            if (newline) {
+                line.append(start, newline);
+                begin = newline - buffer.data() + 1;
+                break;
+            }
+            line.append(start, end - begin);
+            begin = end = 0;
+            if (eof) {
+                if (line.empty()) return false;
+                break;
+            }
+            end = fread(buffer.data(), 1, buffer.size(), file);
+            if (end < buffer.size()) {
+                if (ferror(file)) throw runtime_error("Không đọc được tệp lệnh");
+                eof = true;
+            }
+        }
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    }
+};
+
+// Tách một dòng lệnh theo khoảng trắng; đoạn trong ngoặc kép (vd. "đang chờ") là một tham số
+inline vector<string> SplitCommand(const string& line) {
+    vector<string> tokens;
+    size_t i = 0;
+    while (true) {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) i++;
+        if (i == line.size()) return tokens;
+        string token;
+        if (line[i] == '"') {
+            size_t close = line.find('"', i + 1);
+            if (close == string::npos) throw runtime_error("Thiếu dấu ngoặc kép đóng");
+            token = line.substr(i + 1, close - i - 1);
+            i = close + 1;
+        }
+        else {
+            size_t stop = i;
+            while (stop < line.size() && line[stop] != ' ' && line[stop] != '\t') stop++;
+            token = line.substr(i, stop - i);
+            i = stop;
+        }
+        tokens.push_back(token);
+    }
+}
+
+#endif
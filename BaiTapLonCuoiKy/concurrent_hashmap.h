@@ -0,0 +1,339 @@
+#ifndef CONCURRENT_HASHMAP_H
+#define CONCURRENT_HASHMAP_H
+
+#include "appointment_structures.h"
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+using namespace std;
+
+#define CONCURRENT_MAP_LOCKS 64 // lũy thừa của 2, không lớn hơn số ô nhỏ nhất
+#define CONCURRENT_MAP_MIN_BUCKETS 64
+#define EPOCH_COLLECT_BATCH 64 // số đối tượng chờ giải phóng trước khi thử tăng epoch
+
+// Thu hồi bộ nhớ theo epoch cho các cấu trúc đọc không khóa. Luồng đọc "ghim" epoch hiện tại trong lúc
+// còn giữ con trỏ vào cấu trúc; đối tượng đã gỡ khỏi cấu trúc được Retire kèm epoch lúc gỡ và chỉ bị
+// giải phóng khi epoch chung đã tăng thêm 2, tức mọi luồng còn ghim đều đã ghim sau lúc gỡ.
+// Epoch chỉ tăng khi mọi luồng đang ghim đều đã thấy epoch hiện tại. Dùng một miền chung cho cả tiến trình.
+class EpochDomain {
+private:
+    struct Participant {
+        atomic<uint64_t> state; // (epoch << 1) | 1 khi đang ghim, 0 khi không
+        atomic<bool> in_use;
+        Participant* next;
+        int depth; // số Guard lồng nhau, chỉ luồng sở hữu đọc/ghi
+        Participant() : state(0), in_use(true), next(nullptr), depth(0) {}
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    // Trả ô của luồng cho luồng khác dùng lại khi luồng kết thúc
+    struct ThreadSlot {
+        Participant* participant;
+        ThreadSlot() : participant(nullptr) {}
+        ~ThreadSlot() {
+            if (participant) participant->in_use.store(false, memory_order_release);
+        }
+    };
+
+    atomic<uint64_t> epoch;
+    atomic<Participant*> participants; // chỉ thêm vào đầu, không bao giờ gỡ
+    mutex garbage_lock;
+    vector<Retired> garbage;
+
+    EpochDomain() : epoch(2), participants(nullptr) {}
+
+    Participant* Register() {
+        for (Participant* p = participants.load(memory_order_acquire); p; p = p->next) {
+            bool expected = false;
+            if (!p->in_use.load(memory_order_relaxed) && p->in_use.compare_exchange_strong(expected, true)) return p;
+        }
+        Participant* p = new Participant();
+        Participant* head = participants.load(memory_order_relaxed);
+        do {
+            p->next = head;
+        } while (!participants.compare_exchange_weak(head, p, memory_order_release, memory_order_relaxed));
+        return p;
+    }
+
+    Participant* Local() {
+        static thread_local ThreadSlot slot;
+        if (!slot.participant) slot.participant = Register();
+        return slot.participant;
+    }
+
+    // Tăng epoch nếu mọi luồng đang ghim đều ở epoch hiện tại; gọi khi đã giữ garbage_lock
+    void TryAdvance() {
+        uint64_t current = epoch.load(memory_order_seq_cst);
+        for (Participant* p = participants.load(memory_order_acquire); p; p = p->next) {
+            uint64_t state = p->state.load(memory_order_seq_cst);
+            if ((state & 1) && (state >> 1) != current) return;
+        }
+        epoch.compare_exchange_strong(current, current + 1, memory_order_seq_cst);
+    }
+
+    // Giải phóng những đối tượng đã đủ an toàn; gọi khi đã giữ garbage_lock
+    void Reclaim() {
+        uint64_t current = epoch.load(memory_order_acquire);
+        size_t kept = 0;
+        for (size_t i = 0; i < garbage.size(); i++) {
+            if (garbage[i].epoch + 2 <= current) garbage[i].destroy(garbage[i].object);
+            else garbage[kept++] = garbage[i];
+        }
+        garbage.resize(kept);
+    }
+
+public:
+    ~EpochDomain() {
+        // Chỉ chạy khi tiến trình kết thúc, không còn luồng đọc
+        for (const Retired& item : garbage) item.destroy(item.object);
+        Participant* p = participants.load();
+        while (p) {
+            Participant* next = p->next;
+            delete p;
+            p = next;
+        }
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    static EpochDomain& Global() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    // Ghim epoch trong phạm vi của đối tượng; có thể lồng nhau
+    class Guard {
+    private:
+        Participant* participant;
+
+    public:
+        Guard() : participant(Global().Local()) {
+            if (participant->depth++ > 0) return;
+            uint64_t current = Global().epoch.load(memory_order_relaxed);
+            participant->state.store((current << 1) | 1, memory_order_relaxed);
+            // Các lần đọc con trỏ sau đây không được xảy ra trước khi việc ghim hiển thị với TryAdvance
+            atomic_thread_fence(memory_order_seq_cst);
+        }
+
+        ~Guard() {
+            if (--participant->depth == 0) participant->state.store(0, memory_order_release);
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // object đã không còn truy cập được từ cấu trúc; destroy chạy khi không luồng đọc nào còn giữ nó
+    void Retire(void* object, void (*destroy)(void*)) {
+        lock_guard<mutex> guard(garbage_lock);
+        Retired item = { epoch.load(memory_order_seq_cst), object, destroy };
+        garbage.push_back(item);
+        if (garbage.size() % EPOCH_COLLECT_BATCH == 0) {
+            TryAdvance();
+            Reclaim();
+        }
+    }
+
+    template <typename T>
+    void Retire(T* object) {
+        Retire(object, [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    // Thử tăng epoch và giải phóng ngay những gì có thể, không chờ đủ lô
+    void Collect() {
+        lock_guard<mutex> guard(garbage_lock);
+        TryAdvance();
+        Reclaim();
+    }
+
+    size_t PendingCount() {
+        lock_guard<mutex> guard(garbage_lock);
+        return garbage.size();
+    }
+};
+
+// Bảng băm đồng thời thay cho Hashmap khi nhiều luồng cùng dùng: đọc không khóa, ghi khóa theo dải ô.
+// Mỗi ô là danh sách liên kết đơn các nút bất biến: thêm thì chèn nút mới vào đầu ô, sửa thì thay
+// nút bằng nút mới, xóa thì nối nút trước sang nút sau. Nút cũ giữ nguyên con trỏ next nên luồng đọc
+// đang đứng trên nó vẫn đi tiếp được; nút được Retire qua EpochDomain. Khi tải vượt 1, một bảng gấp
+// đôi được dựng từ bản sao các nút rồi công bố bằng một lần ghi nguyên tử. Luồng ghi giữ resize_lock ở
+// chế độ chia sẻ, Grow giữ nó độc quyền, nên không cần khóa cùng lúc mọi dải.
+// Dải khóa của một khóa băm là các bit thấp của mã băm, trùng với các bit thấp của chỉ số ô, nên
+// các khóa trong cùng một ô luôn cùng dải.
+template <typename TValue, typename TKey = string>
+class ConcurrentHashmap {
+private:
+    // hash và next đặt đầu nút để việc duyệt ô chỉ chạm một dòng cache mỗi nút
+    struct Node {
+        uint64_t hash;
+        atomic<Node*> next;
+        TKey key;
+        TValue value;
+        Node(const TKey& k, const TValue& v, uint64_t h, Node* n) : hash(h), next(n), key(k), value(v) {}
+    };
+
+    struct Table {
+        size_t mask;
+        unique_ptr<atomic<Node*>[]> buckets;
+        explicit Table(size_t size) : mask(size - 1), buckets(new atomic<Node*>[size]) {
+            for (size_t i = 0; i < size; i++) buckets[i].store(nullptr, memory_order_relaxed);
+        }
+    };
+
+    atomic<Table*> table;
+    shared_timed_mutex resize_lock; // luồng đọc không dùng
+    mutex locks[CONCURRENT_MAP_LOCKS];
+    atomic<size_t> count;
+
+    mutex& LockFor(uint64_t hash) {
+        return locks[hash & (CONCURRENT_MAP_LOCKS - 1)];
+    }
+
+    // Vị trí chứa con trỏ tới nút có khóa key trong ô, hoặc nullptr; gọi khi đã giữ khóa dải
+    static atomic<Node*>* FindLink(Table* t, const TKey& key, uint64_t hash) {
+        atomic<Node*>* link = &t->buckets[hash & t->mask];
+        for (Node* node = link->load(memory_order_relaxed); node; node = node->next.load(memory_order_relaxed)) {
+            if (node->hash == hash && node->key == key) return link;
+            link = &node->next;
+        }
+        return nullptr;
+    }
+
+    static void DestroyTable(Table* t, bool nodes) {
+        if (nodes) {
+            for (size_t i = 0; i <= t->mask; i++) {
+                Node* node = t->buckets[i].load(memory_order_relaxed);
+                while (node) {
+                    Node* next = node->next.load(memory_order_relaxed);
+                    delete node;
+                    node = next;
+                }
+            }
+        }
+        delete t;
+    }
+
+    void Grow() {
+        unique_lock<shared_timed_mutex> resize_guard(resize_lock);
+        Table* old_table = table.load(memory_order_relaxed);
+        if (count.load(memory_order_relaxed) > old_table->mask + 1) {
+            size_t size = (old_table->mask + 1) * 2;
+            Table* grown = new Table(size);
+            for (size_t i = 0; i <= old_table->mask; i++) {
+                for (Node* node = old_table->buckets[i].load(memory_order_relaxed); node; node = node->next.load(memory_order_relaxed)) {
+                    atomic<Node*>& head = grown->buckets[node->hash & grown->mask];
+                    head.store(new Node(node->key, node->value, node->hash, head.load(memory_order_relaxed)), memory_order_relaxed);
+                }
+            }
+            table.store(grown, memory_order_release);
+            // Luồng đọc đã nạp bảng cũ vẫn duyệt được nó cho tới khi bỏ ghim
+            EpochDomain::Global().Retire(old_table, [](void* p) { DestroyTable(static_cast<Table*>(p), true); });
+        }
+    }
+
+    void GrowIfNeeded() {
+        if (count.load(memory_order_relaxed) > table.load(memory_order_relaxed)->mask + 1) Grow();
+    }
+
+public:
+    explicit ConcurrentHashmap(size_t capacity = CONCURRENT_MAP_MIN_BUCKETS) : count(0) {
+        size_t size = CONCURRENT_MAP_MIN_BUCKETS;
+        while (size < capacity) size <<= 1;
+        table.store(new Table(size), memory_order_relaxed);
+    }
+
+    // Không được còn luồng nào dùng bảng
+    ~ConcurrentHashmap() {
+        DestroyTable(table.load(memory_order_relaxed), true);
+    }
+
+    ConcurrentHashmap(const ConcurrentHashmap&) = delete;
+    ConcurrentHashmap& operator=(const ConcurrentHashmap&) = delete;
+
+    // Như Hashmap::Insert: khóa đã có thì ném lỗi
+    void Insert(const TKey& key, const TValue& value) {
+        uint64_t hash = HashKey(key);
+        {
+            shared_lock<shared_timed_mutex> resize_guard(resize_lock);
+            lock_guard<mutex> guard(LockFor(hash));
+            Table* t = table.load(memory_order_relaxed);
+            if (FindLink(t, key, hash)) throw runtime_error("Khóa đã tồn tại: " + KeyToString(key));
+            atomic<Node*>& head = t->buckets[hash & t->mask];
+            head.store(new Node(key, value, hash, head.load(memory_order_relaxed)), memory_order_release);
+            count.fetch_add(1, memory_order_relaxed);
+        }
+        GrowIfNeeded();
+    }
+
+    // Thêm hoặc thay giá trị
+    void Assign(const TKey& key, const TValue& value) {
+        uint64_t hash = HashKey(key);
+        {
+            shared_lock<shared_timed_mutex> resize_guard(resize_lock);
+            lock_guard<mutex> guard(LockFor(hash));
+            Table* t = table.load(memory_order_relaxed);
+            atomic<Node*>* link = FindLink(t, key, hash);
+            if (link) {
+                Node* old_node = link->load(memory_order_relaxed);
+                link->store(new Node(key, value, hash, old_node->next.load(memory_order_relaxed)), memory_order_release);
+                EpochDomain::Global().Retire(old_node);
+                return;
+            }
+            atomic<Node*>& head = t->buckets[hash & t->mask];
+            head.store(new Node(key, value, hash, head.load(memory_order_relaxed)), memory_order_release);
+            count.fetch_add(1, memory_order_relaxed);
+        }
+        GrowIfNeeded();
+    }
+
+    bool Remove(const TKey& key) {
+        uint64_t hash = HashKey(key);
+        shared_lock<shared_timed_mutex> resize_guard(resize_lock);
+        lock_guard<mutex> guard(LockFor(hash));
+        atomic<Node*>* link = FindLink(table.load(memory_order_relaxed), key, hash);
+        if (!link) return false;
+        Node* node = link->load(memory_order_relaxed);
+        link->store(node->next.load(memory_order_relaxed), memory_order_release);
+        count.fetch_sub(1, memory_order_relaxed);
+        EpochDomain::Global().Retire(node);
+        return true;
+    }
+
+    // Đọc không khóa: visit(const TValue&) chạy khi còn ghim epoch, giá trị không đổi trong lúc đó.
+    // Khác Hashmap::Find, không trả con trỏ ra ngoài vì nút có thể bị thay ngay sau đó.
+    template <typename TVisitor>
+    bool Find(const TKey& key, TVisitor visit) const {
+        uint64_t hash = HashKey(key);
+        EpochDomain::Guard guard;
+        Table* t = table.load(memory_order_acquire);
+        for (Node* node = t->buckets[hash & t->mask].load(memory_order_acquire); node; node = node->next.load(memory_order_acquire)) {
+            if (node->hash == hash && node->key == key) {
+                visit(static_cast<const TValue&>(node->value));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Contains(const TKey& key) const {
+        return Find(key, [](const TValue&) {});
+    }
+
+    // Bản sao giá trị, false nếu không có
+    bool Get(const TKey& key, TValue& out) const {
+        return Find(key, [&out](const TValue& value) { out = value; });
+    }
+
+    size_t Size() const {
+        return count.load(memory_order_relaxed);
+    }
+};
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef DATE_CODEC_H
+#define DATE_CODEC_H
+
+#include <string>
+#include <ctime>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Giờ Việt Nam cố định UTC+7, không phụ thuộc múi giờ hay locale của tiến trình.
+// Quy ước lưu trữ: Appointment::time + VIETNAM_TZ_OFFSET là số giây kể từ epoch (UTC).
+#define VIETNAM_TZ_OFFSET 7 * 3600
+
+// Đủ cho "DD-MM-YYYY HH:MM" với mọi năm biểu diễn được bằng time_t 64 bit, kèm '\0'
+#define DATE_TEXT_MAX 32
+// Năm lớn nhất chấp nhận khi phân tích, để chuỗi định dạng lại luôn đúng 16 ký tự
+#define DATE_MAX_YEAR 9999
+
+struct CivilDate {
+    int64_t year;
+    unsigned month;
+    unsigned day;
+};
+
+// Số ngày từ 01-01-1970 tới ngày dương lịch đã cho (lịch Gregory đón trước)
+constexpr int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned year_of_era = (unsigned)(year - era * 400);
+    const unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+constexpr CivilDate CivilFromDays(int64_t days) {
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned day_of_era = (unsigned)(days - era * 146097);
+    const unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const unsigned shifted_month = (5 * day_of_year + 2) / 153;
+    const unsigned month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    CivilDate date = { (int64_t)year_of_era + era * 400 + (month <= 2), month,
+        day_of_year - (153 * shifted_month + 2) / 5 + 1 };
+    return date;
+}
+
+static_assert(DaysFromCivil(1970, 1, 1) == 0, "Sai mốc epoch");
+static_assert(DaysFromCivil(2000, 3, 1) == 11017, "Sai quy tắc năm nhuận");
+static_assert(CivilFromDays(11016).day == 29, "Sai quy tắc năm nhuận");
+
+inline bool isValidDate(int day, int month, int year) {
+    if (year < 1970 || month < 1 || month > 12 || day < 1) return false;
+
+    int daysInMonth[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0)) {
+        daysInMonth[1] = 29;
+    }
+    return day <= daysInMonth[month - 1];
+}
+
+// Đọc từng phần tử theo đúng ngữ nghĩa của istream >> int / >> char trong locale "C": bỏ qua khoảng
+// trắng đứng trước, số có thể có dấu, tràn int hoặc hết chuỗi thì hỏng và mọi lần đọc sau cũng hỏng.
+// Nhờ vậy bộ phân tích báo đúng những lỗi mà bản dùng stringstream trước đây báo.
+struct DateCursor {
+    const char* p;
+    const char* end;
+    bool failed;
+
+    DateCursor(const char* begin, const char* stop) : p(begin), end(stop), failed(false) {}
+
+    static bool IsSpace(char c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    bool SkipSpace() {
+        while (p < end && IsSpace(*p)) p++;
+        if (p == end) failed = true;
+        return !failed;
+    }
+
+    void Int(int& value) {
+        if (failed || !SkipSpace()) return;
+        bool negative = *p == '-';
+        if (*p == '-' || *p == '+') p++;
+        if (p == end || *p < '0' || *p > '9') {
+            failed = true;
+            return;
+        }
+        int64_t magnitude = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            // Đã vượt int thì chỉ cần giữ một giá trị chắc chắn tràn
+            magnitude = magnitude > INT32_MAX ? (int64_t)INT32_MAX + 2 : magnitude * 10 + (*p - '0');
+            p++;
+        }
+        if (negative) magnitude = -magnitude;
+        if (magnitude > INT32_MAX || magnitude < INT32_MIN) {
+            failed = true;
+            return;
+        }
+        value = (int)magnitude;
+    }
+
+    void Char(char& c) {
+        if (failed || !SkipSpace()) return;
+        c = *p++;
+    }
+
+    // Như istream::get(): không bỏ qua khoảng trắng, trả về -1 khi hết chuỗi
+    int Get() {
+        if (failed || p == end) {
+            failed = true;
+            return -1;
+        }
+        return (unsigned char)*p++;
+    }
+};
+
+// Phân tích "DD-MM-YYYY HH:MM" giờ Việt Nam trong [begin, end) mà không cấp phát. Trả về nullptr và
+// ghi kết quả (theo quy ước lưu trữ) vào out, hoặc thông báo lỗi tĩnh nếu chuỗi không hợp lệ.
+inline const char* DecodeDateTime(const char* begin, const char* end, time_t& out) {
+    while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '\r' || *begin == '\n')) begin++;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+    if (begin == end) return "Chuỗi thời gian rỗng";
+
+    DateCursor cursor(begin, end);
+    int day = 0, month = 0, year = 0, hour = 0, minute = 0;
+    char dash1 = 0, dash2 = 0, colon = 0;
+    cursor.Int(day);
+    cursor.Char(dash1);
+    cursor.Int(month);
+    cursor.Char(dash2);
+    cursor.Int(year);
+    if (cursor.Get() != ' ') return "Dấu phân tách giữa ngày và giờ phải là khoảng trắng";
+
+    cursor.Int(hour);
+    cursor.Char(colon);
+    cursor.Int(minute);
+    if (cursor.failed) return "Không thể phân tích thời gian. Đảm bảo định dạng DD-MM-YYYY HH:MM";
+
+    if (dash1 != '-' || dash2 != '-') return "Dấu phân tách ngày/tháng/năm phải là '-'";
+    if (colon != ':') return "Dấu phân tách giờ/phút phải là ':'";
+
+    // Phần còn lại tới hết dòng chỉ được là khoảng trắng (getline dừng ở '\n')
+    for (const char* p = cursor.p; p < end && *p != '\n'; p++) {
+        if (*p != ' ' && *p != '\t' && *p != '\r') return "Có ký tự thừa sau thời gian";
+    }
+
+    if (!isValidDate(day, month, year)) return "Ngày không hợp lệ (ngày 1-31, tháng 1-12, năm >= 1970)";
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59) return "Giờ/phút không hợp lệ (giờ 0-23, phút 0-59)";
+    if (year > DATE_MAX_YEAR) return "Không thể chuyển đổi thời gian";
+
+    int64_t local = DaysFromCivil(year, (unsigned)month, (unsigned)day) * 86400 + hour * 3600 + minute * 60;
+    out = (time_t)(local - VIETNAM_TZ_OFFSET - VIETNAM_TZ_OFFSET);
+    return nullptr;
+}
+
+inline char* WriteTwoDigits(char* p, unsigned value) {
+    p[0] = (char)('0' + value / 10);
+    p[1] = (char)('0' + value % 10);
+    return p + 2;
+}
+
+// Ghi phần "DD-MM-YYYY " của ngày thứ days kể từ epoch (giờ Việt Nam), trả về con trỏ sau phần đã ghi
+inline char* WriteDatePart(char* p, int64_t days) {
+    CivilDate date = CivilFromDays(days);
+    p = WriteTwoDigits(p, date.day);
+    *p++ = '-';
+    p = WriteTwoDigits(p, date.month);
+    *p++ = '-';
+    if (date.year >= 1000 && date.year <= 9999) {
+        unsigned year = (unsigned)date.year;
+        p = WriteTwoDigits(p, year / 100);
+        p = WriteTwoDigits(p, year % 100);
+    }
+    else {
+        // Như strftime %Y: không thêm số 0 đứng đầu
+        uint64_t year = date.year < 0 ? 0 - (uint64_t)date.year : (uint64_t)date.year;
+        if (date.year < 0) *p++ = '-';
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = (char)('0' + year % 10);
+            year /= 10;
+        } while (year);
+        while (count) *p++ = digits[--count];
+    }
+    *p++ = ' ';
+    return p;
+}
+
+inline int64_t FloorDiv(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    return quotient * divisor > value ? quotient - 1 : quotient;
+}
+
+// Ghi "DD-MM-YYYY HH:MM" giờ Việt Nam của time (quy ước lưu trữ) vào out, không cấp phát.
+// out cần ít nhất DATE_TEXT_MAX byte; trả về số ký tự đã ghi, không tính '\0' ở cuối.
+inline size_t EncodeDateTime(time_t time, char* out) {
+    int64_t local = (int64_t)time + VIETNAM_TZ_OFFSET + VIETNAM_TZ_OFFSET;
+    int64_t days = FloorDiv(local, 86400);
+    unsigned seconds = (unsigned)(local - days * 86400);
+    char* p = WriteDatePart(out, days);
+    p = WriteTwoDigits(p, seconds / 3600);
+    *p++ = ':';
+    p = WriteTwoDigits(p, seconds % 3600 / 60);
+    *p = '\0';
+    return p - out;
+}
+
+// 00:00 của ngày (giờ Việt Nam) chứa time, theo quy ước lưu trữ
+inline time_t VietnamDayStart(time_t time) {
+    int64_t local = (int64_t)time + VIETNAM_TZ_OFFSET + VIETNAM_TZ_OFFSET;
+    return (time_t)(FloorDiv(local, 86400) * 86400 - VIETNAM_TZ_OFFSET - VIETNAM_TZ_OFFSET);
+}
+
+struct DateText {
+    char text[DATE_TEXT_MAX];
+};
+
+// Định dạng hàng loạt. Danh sách thường đã sắp theo thời gian nên các mốc liền nhau hay cùng ngày:
+// khi đó chỉ chép lại phần ngày vừa tính và ghi giờ/phút.
+inline void EncodeDateTimes(const time_t* times, size_t count, DateText* out) {
+    int64_t last_day = INT64_MIN;
+    char date_part[DATE_TEXT_MAX];
+    size_t date_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        int64_t local = (int64_t)times[i] + VIETNAM_TZ_OFFSET + VIETNAM_TZ_OFFSET;
+        int64_t days = FloorDiv(local, 86400);
+        if (days != last_day) {
+            date_size = WriteDatePart(date_part, days) - date_part;
+            last_day = days;
+        }
+        unsigned seconds = (unsigned)(local - days * 86400);
+        char* p = out[i].text;
+        for (size_t k = 0; k < date_size; k++) *p++ = date_part[k];
+        p = WriteTwoDigits(p, seconds / 3600);
+        *p++ = ':';
+        p = WriteTwoDigits(p, seconds % 3600 / 60);
+        *p = '\0';
+    }
+}
+
+// Phân tích hàng loạt; errors[i] nhận nullptr hoặc thông báo lỗi của chuỗi thứ i (out[i] khi đó giữ
+// nguyên). Trả về số chuỗi lỗi.
+inline size_t DecodeDateTimes(const string* texts, size_t count, time_t* out, const char** errors) {
+    size_t failures = 0;
+    for (size_t i = 0; i < count; i++) {
+        errors[i] = DecodeDateTime(texts[i].data(), texts[i].data() + texts[i].size(), out[i]);
+        if (errors[i]) failures++;
+    }
+    return failures;
+}
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include "concurrent_hashmap.h"
+#include <ctime>
+
+using namespace std;
+
+// Cây AVL bền vững (sao chép đường đi) theo khóa (time, key). Mỗi lần ghi dựng một phiên bản mới từ
+// các nút mới trên đường đi từ gốc tới chỗ sửa, phần còn lại dùng chung với phiên bản cũ; nút đã tạo
+// thì không bao giờ bị sửa. Gốc mới được công bố bằng một lần ghi nguyên tử nên luồng đọc luôn thấy
+// trọn một phiên bản. Luồng đọc không khóa: Snapshot ghim epoch rồi nạp gốc, O(1). Giá trị nằm riêng
+// và được các bản sao của một nút dùng chung, nên sao chép đường đi chỉ chép khóa và con trỏ. Nút và
+// giá trị bị thay trong một lần ghi được Retire thành một gói qua EpochDomain, chỉ được giải phóng khi
+// không còn Snapshot nào có thể chạm tới. Các luồng ghi nối tiếp nhau qua một khóa riêng của cây.
+template <typename TValue, typename TKey = string>
+class PersistentAVLTree {
+private:
+    struct Node {
+        time_t time;
+        TKey key;
+        const TValue* value; // chỉ đổi khi giá trị của khóa đổi
+        int height;
+        int size; // số nút của cây con
+        const Node* left;
+        const Node* right;
+        uint64_t version; // phiên bản đã tạo ra nút
+        Node(time_t t, const TKey& k, const TValue* v, const Node* l, const Node* r, uint64_t ver)
+            : time(t), key(k), value(v), height(max(Height(l), Height(r)) + 1), size(Size(l) + Size(r) + 1),
+            left(l), right(r), version(ver) {}
+    };
+
+    // Những gì một lần ghi gỡ khỏi các phiên bản trước
+    struct Garbage {
+        vector<const Node*> nodes;
+        vector<const TValue*> values;
+        ~Garbage() {
+            for (const Node* node : nodes) delete node;
+            for (const TValue* value : values) delete value;
+        }
+    };
+
+    atomic<const Node*> root;
+    mutex write_lock;
+    uint64_t version; // phiên bản đang dựng; chỉ dùng khi giữ write_lock
+    Garbage replaced; // của lần ghi hiện tại
+
+    static int Height(const Node* node) {
+        return node ? node->height : 0;
+    }
+
+    static int Size(const Node* node) {
+        return node ? node->size : 0;
+    }
+
+    static bool Less(time_t t1, const TKey& k1, time_t t2, const TKey& k2) {
+        return t1 < t2 || (t1 == t2 && k1 < k2);
+    }
+
+    const Node* Create(const Node* from, const Node* left, const Node* right) {
+        return new Node(from->time, from->key, from->value, left, right, version);
+    }
+
+    // Nút không còn trong phiên bản đang dựng. Nút của chính lần ghi này chưa ai thấy nên xóa ngay
+    void Drop(const Node* node) {
+        if (node->version == version) delete node;
+        else replaced.nodes.push_back(node);
+    }
+
+    // Nút mang khóa của from với hai con left, right (chiều cao chênh tối đa 2), có xoay để cân bằng.
+    // from và các nút bị xoay được Drop.
+    const Node* Balance(const Node* from, const Node* left, const Node* right) {
+        const Node* result;
+        if (Height(left) > Height(right) + 1) {
+            if (Height(left->left) >= Height(left->right)) {
+                result = Create(left, left->left, Create(from, left->right, right));
+            }
+            else {
+                const Node* middle = left->right;
+                result = Create(middle, Create(left, left->left, middle->left), Create(from, middle->right, right));
+                Drop(middle);
+            }
+            Drop(left);
+        }
+        else if (Height(right) > Height(left) + 1) {
+            if (Height(right->right) >= Height(right->left)) {
+                result = Create(right, Create(from, left, right->left), right->right);
+            }
+            else {
+                const Node* middle = right->left;
+                result = Create(middle, Create(from, left, middle->left), Create(right, middle->right, right->right));
+                Drop(middle);
+            }
+            Drop(right);
+        }
+        else {
+            result = Create(from, left, right);
+        }
+        Drop(from);
+        return result;
+    }
+
+    // Khóa của item đã có thì item thay nút đó
+    const Node* Insert(const Node* node, const Node* item) {
+        if (!node) return item;
+        if (node->time == item->time && node->key == item->key) {
+            const Node* result = new Node(item->time, item->key, item->value, node->left, node->right, version);
+            replaced.values.push_back(node->value);
+            Drop(item);
+            Drop(node);
+            return result;
+        }
+        if (Less(item->time, item->key, node->time, node->key))
+            return Balance(node, Insert(node->left, item), node->right);
+        return Balance(node, node->left, Insert(node->right, item));
+    }
+
+    // Gỡ nút nhỏ nhất của cây con, trả nó qua min (chưa Drop)
+    const Node* RemoveMin(const Node* node, const Node*& min) {
+        if (!node->left) {
+            min = node;
+            return node->right;
+        }
+        return Balance(node, RemoveMin(node->left, min), node->right);
+    }
+
+    // Không có khóa thì trả về nguyên cây con, không sao chép gì
+    const Node* Remove(const Node* node, time_t time, const TKey& key) {
+        if (!node) return nullptr;
+        if (node->time == time && node->key == key) {
+            const Node* result;
+            if (!node->left) result = node->right;
+            else if (!node->right) result = node->left;
+            else {
+                const Node* min;
+                const Node* right = RemoveMin(node->right, min);
+                result = Balance(min, node->left, right);
+            }
+            replaced.values.push_back(node->value);
+            Drop(node);
+            return result;
+        }
+        if (Less(time, key, node->time, node->key)) {
+            const Node* left = Remove(node->left, time, key);
+            return left == node->left ? node : Balance(node, left, node->right);
+        }
+        const Node* right = Remove(node->right, time, key);
+        return right == node->right ? node : Balance(node, node->left, right);
+    }
+
+    static const Node* Find(const Node* node, time_t time, const TKey& key) {
+        while (node && !(node->time == time && node->key == key))
+            node = Less(time, key, node->time, node->key) ? node->left : node->right;
+        return node;
+    }
+
+    // Công bố phiên bản vừa dựng rồi mới Retire những gì nó thay thế
+    void Publish(const Node* next) {
+        root.store(next, memory_order_release);
+        if (!replaced.nodes.empty() || !replaced.values.empty()) {
+            Garbage* garbage = new Garbage();
+            swap(garbage->nodes, replaced.nodes);
+            swap(garbage->values, replaced.values);
+            EpochDomain::Global().Retire(garbage);
+        }
+        version++;
+    }
+
+    // Mỗi giá trị thuộc đúng một nút của một phiên bản
+    static void Destroy(const Node* node) {
+        if (node) {
+            Destroy(node->left);
+            Destroy(node->right);
+            delete node->value;
+            delete node;
+        }
+    }
+
+public:
+    // Duyệt trung thứ tự bằng ngăn xếp tường minh như AVLTree::Iterator; chỉ dùng khi Snapshot còn sống
+    struct Iterator {
+        const Node* stack[64];
+        int depth;
+        time_t end_time;
+        Iterator() : depth(0), end_time(0) {}
+        Iterator(const Node* root, time_t start, time_t end) : depth(0), end_time(end) {
+            for (const Node* node = root; node;) {
+                if (node->time >= start) {
+                    stack[depth++] = node;
+                    node = node->left;
+                }
+                else {
+                    node = node->right;
+                }
+            }
+            if (depth && stack[depth - 1]->time > end_time) depth = 0;
+        }
+        bool Done() const { return depth == 0; }
+        const TValue& operator*() const { return *stack[depth - 1]->value; }
+        time_t Time() const { return stack[depth - 1]->time; }
+        const TKey& Key() const { return stack[depth - 1]->key; }
+        Iterator& operator++() {
+            const Node* node = stack[--depth]->right;
+            while (node) {
+                stack[depth++] = node;
+                node = node->left;
+            }
+            if (depth && stack[depth - 1]->time > end_time) depth = 0;
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const {
+            return depth != other.depth || (depth && stack[depth - 1] != other.stack[depth - 1]);
+        }
+    };
+
+    // Một phiên bản cố định của cây, lấy trong O(1) và không khóa. Ghim epoch suốt đời sống nên phải
+    // hủy trên chính luồng đã tạo; giữ lâu thì các nút bị thay trong lúc đó chưa được giải phóng.
+    class Snapshot {
+    private:
+        EpochDomain::Guard guard;
+        const Node* root;
+
+        int Rank(time_t time) const {
+            int rank = 0;
+            const Node* node = root;
+            while (node) {
+                if (node->time < time) {
+                    rank += PersistentAVLTree::Size(node->left) + 1;
+                    node = node->right;
+                }
+                else {
+                    node = node->left;
+                }
+            }
+            return rank;
+        }
+
+    public:
+        explicit Snapshot(const PersistentAVLTree& tree) : root(tree.root.load(memory_order_acquire)) {}
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        TimeRange<Iterator> Range(time_t start, time_t end) const {
+            return TimeRange<Iterator>(Iterator(root, start, end));
+        }
+
+        // Con trỏ hợp lệ khi Snapshot còn sống; nullptr nếu không có
+        const TValue* Find(time_t time, const TKey& key) const {
+            const Node* node = PersistentAVLTree::Find(root, time, key);
+            return node ? node->value : nullptr;
+        }
+
+        int CountInRange(time_t start, time_t end) const {
+            if (end < start) return 0;
+            return Rank(end + 1) - Rank(start);
+        }
+
+        int Size() const {
+            return PersistentAVLTree::Size(root);
+        }
+    };
+
+    PersistentAVLTree() : root(nullptr), version(1) {}
+    PersistentAVLTree(const PersistentAVLTree&) = delete;
+    PersistentAVLTree& operator=(const PersistentAVLTree&) = delete;
+
+    // Không được còn Snapshot hay luồng ghi nào
+    ~PersistentAVLTree() {
+        Destroy(root.load(memory_order_relaxed));
+    }
+
+    // Khóa (time, key) đã có thì ném lỗi
+    void Insert(time_t time, const TKey& key, const TValue& value) {
+        lock_guard<mutex> guard(write_lock);
+        const Node* current = root.load(memory_order_relaxed);
+        if (Find(current, time, key)) throw runtime_error("Khóa đã có trong chỉ mục thời gian: " + KeyToString(key));
+        Publish(Insert(current, new Node(time, key, new TValue(value), nullptr, nullptr, version)));
+    }
+
+    // false nếu không có khóa
+    bool Remove(time_t time, const TKey& key) {
+        lock_guard<mutex> guard(write_lock);
+        const Node* current = root.load(memory_order_relaxed);
+        const Node* next = Remove(current, time, key);
+        if (next == current) return false;
+        Publish(next);
+        return true;
+    }
+
+    // Gỡ (old_time, key) nếu có và đặt (time, key) = value (thay giá trị cũ nếu có) trong cùng một
+    // phiên bản, nên luồng đọc không bao giờ thấy lịch hẹn đang dời giờ bị mất hoặc xuất hiện hai lần
+    void Replace(time_t old_time, const TKey& key, time_t time, const TValue& value) {
+        lock_guard<mutex> guard(write_lock);
+        const Node* current = root.load(memory_order_relaxed);
+        // Cùng thời gian thì Insert thay giá trị tại chỗ, chỉ một lần đi xuống
+        if (old_time != time) current = Remove(current, old_time, key);
+        Publish(Insert(current, new Node(time, key, new TValue(value), nullptr, nullptr, version)));
+    }
+};
+
+#endif
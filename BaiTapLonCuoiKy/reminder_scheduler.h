@@ -0,0 +1,289 @@
+#ifndef REMINDER_SCHEDULER_H
+#define REMINDER_SCHEDULER_H
+
+#include "appointment_structures.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+using namespace std;
+
+#define WHEEL_MINUTE_SLOTS 60
+#define WHEEL_HOUR_SLOTS 24
+#define WHEEL_DAY_SLOTS 512
+
+// Bánh xe thời gian phân tầng theo phút/giờ/ngày, đơn vị là phút tính từ epoch.
+// Thêm và hủy đều O(1): mỗi bộ hẹn giờ nằm trong danh sách liên kết đôi của đúng một ô,
+// khi sang giờ/ngày mới các ô của tầng trên được dồn xuống tầng dưới.
+template <typename TPayload>
+struct TimingWheel {
+private:
+    struct Timer {
+        int64_t due;
+        TPayload payload;
+        int prev;
+        int next;
+        int slot; // -1 nếu ô trống trong mảng timers
+        uint32_t generation;
+    };
+
+    enum {
+        kHourBase = WHEEL_MINUTE_SLOTS,
+        kDayBase = WHEEL_MINUTE_SLOTS + WHEEL_HOUR_SLOTS,
+        kOverflow = WHEEL_MINUTE_SLOTS + WHEEL_HOUR_SLOTS + WHEEL_DAY_SLOTS, // xa hơn tầng ngày
+        kReady = kOverflow + 1, // đã tới hạn, phát ở lần Advance kế tiếp
+        kSlotCount = kReady + 1
+    };
+
+    vector<Timer> timers;
+    vector<int> free_ids;
+    int heads[kSlotCount];
+    int64_t current;
+    size_t pending;
+
+    void Link(int id, int slot) {
+        Timer& timer = timers[id];
+        timer.slot = slot;
+        timer.prev = -1;
+        timer.next = heads[slot];
+        if (heads[slot] >= 0) timers[heads[slot]].prev = id;
+        heads[slot] = id;
+    }
+
+    void Unlink(int id) {
+        Timer& timer = timers[id];
+        if (timer.prev >= 0) timers[timer.prev].next = timer.next;
+        else heads[timer.slot] = timer.next;
+        if (timer.next >= 0) timers[timer.next].prev = timer.prev;
+    }
+
+    int SlotFor(int64_t due) const {
+        if (due <= current) return kReady;
+        if (due / 60 == current / 60) return (int)(due % WHEEL_MINUTE_SLOTS);
+        if (due / 1440 == current / 1440) return kHourBase + (int)((due / 60) % WHEEL_HOUR_SLOTS);
+        if (due / 1440 - current / 1440 < WHEEL_DAY_SLOTS) return kDayBase + (int)((due / 1440) % WHEEL_DAY_SLOTS);
+        return kOverflow;
+    }
+
+    // Chuyển toàn bộ ô sang vị trí mới theo current
+    void Cascade(int slot) {
+        int id = heads[slot];
+        heads[slot] = -1;
+        while (id >= 0) {
+            int next = timers[id].next;
+            Link(id, SlotFor(timers[id].due));
+            id = next;
+        }
+    }
+
+    template <typename TFire>
+    void FireSlot(int slot, TFire& fire) {
+        int id = heads[slot];
+        heads[slot] = -1;
+        while (id >= 0) {
+            Timer& timer = timers[id];
+            int next = timer.next;
+            fire(timer.payload);
+            timer.payload = TPayload();
+            timer.slot = -1;
+            timer.generation++;
+            free_ids.push_back(id);
+            pending--;
+            id = next;
+        }
+    }
+
+public:
+    TimingWheel(int64_t now) : current(now), pending(0) {
+        for (int i = 0; i < kSlotCount; i++) heads[i] = -1;
+    }
+
+    // Trả về mã bộ hẹn giờ (chỉ số + thế hệ) để hủy về sau
+    uint64_t Schedule(int64_t due, const TPayload& payload) {
+        int id;
+        if (!free_ids.empty()) {
+            id = free_ids.back();
+            free_ids.pop_back();
+        }
+        else {
+            id = (int)timers.size();
+            timers.push_back(Timer());
+            timers[id].generation = 0;
+        }
+        timers[id].due = due;
+        timers[id].payload = payload;
+        Link(id, SlotFor(due));
+        pending++;
+        return ((uint64_t)timers[id].generation << 32) | (uint32_t)id;
+    }
+
+    bool Cancel(uint64_t timer_id) {
+        int id = (int)(uint32_t)timer_id;
+        if (id >= (int)timers.size()) return false;
+        Timer& timer = timers[id];
+        if (timer.slot < 0 || timer.generation != (uint32_t)(timer_id >> 32)) return false;
+        Unlink(id);
+        timer.payload = TPayload();
+        timer.slot = -1;
+        timer.generation++;
+        free_ids.push_back(id);
+        pending--;
+        return true;
+    }
+
+    // Tiến tới phút now, gọi fire cho mọi bộ hẹn giờ tới hạn theo thứ tự phút
+    template <typename TFire>
+    void Advance(int64_t now, TFire fire) {
+        FireSlot(kReady, fire);
+        while (current < now) {
+            current++;
+            if (current % 1440 == 0) {
+                if ((current / 1440) % WHEEL_DAY_SLOTS == 0) Cascade(kOverflow);
+                Cascade(kDayBase + (int)((current / 1440) % WHEEL_DAY_SLOTS));
+            }
+            if (current % 60 == 0) Cascade(kHourBase + (int)((current / 60) % WHEEL_HOUR_SLOTS));
+            FireSlot((int)(current % WHEEL_MINUTE_SLOTS), fire);
+            FireSlot(kReady, fire);
+        }
+    }
+
+    size_t Pending() const {
+        return pending;
+    }
+};
+
+struct NhacNho {
+    string appointment_id;
+    string patient_id;
+    string doctor_id;
+    string status;
+    time_t time; // cùng hệ quy chiếu với Appointment::time
+    int lead_minutes;
+};
+
+typedef function<void(const vector<NhacNho>&)> ReminderSink;
+
+// Một mục đăng ký hàng loạt; utc_time là thời điểm thật theo epoch
+struct LichNhac {
+    uint64_t key;
+    time_t utc_time;
+    NhacNho reminder;
+};
+
+// Luồng nền phát nhắc nhở đúng hạn cho từng mốc "nhắc trước" được cấu hình.
+// Nhắc nhở cùng phút được gom thành một lô rồi giao cho sink bên ngoài khóa.
+class ReminderScheduler {
+private:
+    mutex lock;
+    condition_variable wake;
+    thread worker;
+    bool stopping;
+    TimingWheel<NhacNho> wheel;
+    vector<int> lead_minutes;
+    Hashmap<vector<uint64_t>, uint64_t> timers_by_key;
+    vector<LichNhac> backlog; // lô đăng ký hàng loạt chưa đưa vào bánh xe
+    ReminderSink sink;
+
+    static int64_t NowMinute() {
+        return (int64_t)time(nullptr) / 60;
+    }
+
+    void CancelLocked(uint64_t key) {
+        vector<uint64_t>* ids = timers_by_key.Find(key);
+        if (!ids) return;
+        for (uint64_t id : *ids) wheel.Cancel(id);
+        timers_by_key.Remove(key);
+    }
+
+    void ScheduleLocked(uint64_t key, time_t utc_time, const NhacNho& reminder) {
+        CancelLocked(key);
+        vector<uint64_t> ids;
+        int64_t now = NowMinute();
+        for (int lead : lead_minutes) {
+            int64_t due = (int64_t)utc_time / 60 - lead;
+            if (due < now) continue; // đã qua mốc nhắc
+            NhacNho item = reminder;
+            item.lead_minutes = lead;
+            ids.push_back(wheel.Schedule(due, item));
+        }
+        if (!ids.empty()) timers_by_key.Insert(key, move(ids));
+    }
+
+    // Mọi thao tác trên bánh xe gọi hàm này trước, nên lô hàng loạt luôn được áp dụng
+    // trước các lần DatLich/Huy đến sau nó
+    void ApplyBacklogLocked() {
+        if (backlog.empty()) return;
+        timers_by_key.Reserve(timers_by_key.Size() + backlog.size());
+        for (const LichNhac& item : backlog) ScheduleLocked(item.key, item.utc_time, item.reminder);
+        vector<LichNhac>().swap(backlog);
+    }
+
+    void Run() {
+        unique_lock<mutex> guard(lock);
+        while (!stopping) {
+            ApplyBacklogLocked();
+            vector<NhacNho> batch;
+            wheel.Advance(NowMinute(), [&](const NhacNho& reminder) { batch.push_back(reminder); });
+            if (!batch.empty()) {
+                guard.unlock();
+                sink(batch);
+                guard.lock();
+                continue;
+            }
+            auto next_minute = chrono::system_clock::from_time_t((time_t)(NowMinute() + 1) * 60);
+            wake.wait_until(guard, next_minute);
+        }
+    }
+
+public:
+    ReminderScheduler(const vector<int>& leads, ReminderSink output)
+        : stopping(false), wheel(NowMinute()), lead_minutes(leads), sink(output) {
+        worker = thread(&ReminderScheduler::Run, this);
+    }
+
+    ReminderScheduler(const ReminderScheduler&) = delete;
+    ReminderScheduler& operator=(const ReminderScheduler&) = delete;
+
+    // Đăng ký (hoặc đăng ký lại) nhắc nhở cho một lịch hẹn; utc_time là thời điểm thật theo epoch.
+    // Khóa 64 bit để nhiều hệ thống dùng chung một bộ nhắc nhở, mỗi hệ thống một dải khóa riêng.
+    void DatLich(uint64_t key, time_t utc_time, const NhacNho& reminder) {
+        lock_guard<mutex> guard(lock);
+        ApplyBacklogLocked();
+        ScheduleLocked(key, utc_time, reminder);
+        wake.notify_one();
+    }
+
+    // Giao cả lô cho luồng nền rồi trả về ngay (dùng khi nạp ảnh chụp). Các khóa trong lô phải
+    // khác nhau; luồng nền đưa lô vào bánh xe khi rảnh, hoặc sớm hơn nếu có DatLich/Huy gọi tới.
+    void DatLichHangLoat(vector<LichNhac>&& items) {
+        lock_guard<mutex> guard(lock);
+        ApplyBacklogLocked();
+        backlog = move(items);
+        wake.notify_one();
+    }
+
+    void Huy(uint64_t key) {
+        lock_guard<mutex> guard(lock);
+        ApplyBacklogLocked();
+        CancelLocked(key);
+    }
+
+    size_t Pending() {
+        lock_guard<mutex> guard(lock);
+        ApplyBacklogLocked();
+        return wheel.Pending();
+    }
+
+    ~ReminderScheduler() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+};
+
+#endif
@@ -0,0 +1,529 @@
+#ifndef REQUEST_SERVER_H
+#define REQUEST_SERVER_H
+
+// Máy chủ dùng epoll nên chỉ có trên Linux
+#ifdef __linux__
+
+#include "write_ahead_log.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Khung trên dây: [độ dài nội dung 4 byte little-endian][nội dung]; khung lớn hơn thì ngắt kết nối
+#define SERVER_MAX_FRAME (1 << 20)
+// Bộ đệm vào hoặc ra của một kết nối vượt ngưỡng này thì ngừng đọc cho tới khi gửi bớt trả lời
+#define SERVER_BUFFER_LIMIT (4 << 20)
+#define SERVER_READ_CHUNK (64 << 10)
+#define SERVER_EPOLL_EVENTS 256
+
+// "host:port" là TCP IPv4 (thường là 127.0.0.1), còn lại là đường dẫn Unix domain socket
+struct SocketAddress {
+    sockaddr_storage storage;
+    socklen_t length;
+    bool is_unix;
+    string path;
+
+    explicit SocketAddress(const string& text) : length(0), is_unix(false) {
+        memset(&storage, 0, sizeof(storage));
+        size_t colon = text.rfind(':');
+        if (text.empty()) throw runtime_error("Địa chỉ máy chủ rỗng");
+        if (colon == string::npos || text.find('/') != string::npos) {
+            sockaddr_un* address = (sockaddr_un*)&storage;
+            if (text.size() >= sizeof(address->sun_path)) throw runtime_error("Đường dẫn socket quá dài: " + text);
+            address->sun_family = AF_UNIX;
+            memcpy(address->sun_path, text.data(), text.size());
+            length = sizeof(sockaddr_un);
+            is_unix = true;
+            path = text;
+            return;
+        }
+        string host = text.substr(0, colon);
+        string port = text.substr(colon + 1);
+        sockaddr_in* address = (sockaddr_in*)&storage;
+        address->sin_family = AF_INET;
+        if (port.empty() || port.size() > 5 || port.find_first_not_of("0123456789") != string::npos || stoi(port) > 65535) {
+            throw runtime_error("Cổng không hợp lệ: " + port);
+        }
+        address->sin_port = htons((uint16_t)stoi(port));
+        if (inet_pton(AF_INET, host.empty() ? "127.0.0.1" : host.c_str(), &address->sin_addr) != 1) {
+            throw runtime_error("Địa chỉ IPv4 không hợp lệ: " + host);
+        }
+        length = sizeof(sockaddr_in);
+    }
+
+    int Open() const {
+        int fd = socket(is_unix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw runtime_error(string("Không tạo được socket: ") + strerror(errno));
+        if (!is_unix) {
+            // Trả lời nhỏ và nhiều: không chờ gom gói theo Nagle
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return fd;
+    }
+};
+
+// Nối một khung (độ dài + nội dung) vào out
+inline void AppendFrame(string& out, const string& body) {
+    if (body.size() > SERVER_MAX_FRAME) throw runtime_error("Khung quá lớn");
+    ByteWriter header;
+    header.U32((uint32_t)body.size());
+    out += header.bytes;
+    out += body;
+}
+
+// Xử lý một yêu cầu: đọc nội dung khung từ request, ghi nội dung khung trả lời vào cuối response.
+// Không được ném lỗi cho yêu cầu sai, lỗi phải nằm trong trả lời. Trả về true nếu yêu cầu đã đổi dữ
+// liệu; khi đó before_reply chạy trước khi gửi trả lời của cả lô.
+typedef function<bool(ByteReader& request, ByteWriter& response)> RequestHandler;
+
+// Máy chủ yêu cầu/trả lời: một luồng epoll nhận kết nối, đọc và ghi socket không chặn; các luồng xử lý
+// chạy handler. Khách được gửi liên tiếp nhiều yêu cầu không chờ trả lời (pipelining): mỗi lần luồng
+// epoll chuyển mọi khung đã đủ của một kết nối thành một lô cho luồng xử lý, và mỗi kết nối chỉ có một
+// lô đang xử lý, nên trả lời luôn theo đúng thứ tự yêu cầu còn các kết nối khác nhau chạy song song.
+// Trả lời của cả lô được gửi bằng một lần ghi, sau before_reply (vd. chờ nhật ký bền vững).
+class RequestServer {
+private:
+    struct Connection {
+        int fd;
+        string input; // byte đã nhận, chưa thành lô
+        string output; // trả lời chưa gửi, từ vị trí sent
+        size_t sent;
+        bool busy; // có một lô đang ở luồng xử lý
+        bool peer_closed; // khách đã đóng chiều gửi
+        uint32_t events; // đang đăng ký với epoll
+    };
+
+    struct Task {
+        uint64_t id; // kết nối; có thể đã đóng khi xử lý xong
+        string frames;
+        string replies;
+        bool failed;
+    };
+
+    // Giá trị epoll_event.data của socket nghe và eventfd, kết nối đánh số từ FIRST_CONNECTION
+    static const uint64_t LISTEN_ID = 0;
+    static const uint64_t WAKE_ID = 1;
+    static const uint64_t FIRST_CONNECTION = 2;
+
+    SocketAddress address;
+    int thread_count;
+    RequestHandler handler;
+    function<void()> before_reply;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd; // luồng xử lý báo có lô xong, Stop báo dừng
+    atomic<bool> stopping;
+    atomic<uint64_t> served;
+
+    // Chỉ luồng epoll dùng
+    unordered_map<uint64_t, Connection> connections;
+    uint64_t next_id;
+
+    mutex lock;
+    condition_variable ready;
+    deque<Task> tasks;
+    deque<Task> done;
+    vector<thread> workers;
+
+    void Watch(int fd, uint64_t id, uint32_t events, int op) {
+        epoll_event event;
+        event.events = events;
+        event.data.u64 = id;
+        if (epoll_ctl(epoll_fd, op, fd, &event) != 0) {
+            throw runtime_error(string("Không đăng ký được socket với epoll: ") + strerror(errno));
+        }
+    }
+
+    void Wake() {
+        uint64_t one = 1;
+        ssize_t result = write(wake_fd, &one, sizeof(one));
+        (void)result; // eventfd đầy thì luồng epoll vẫn sẽ thức dậy
+    }
+
+    void Close(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        close(it->second.fd); // tự gỡ khỏi epoll
+        connections.erase(it);
+    }
+
+    void Accept() {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return; // EAGAIN, hoặc hết fd: thử lại ở lần báo sau
+            }
+            if (!address.is_unix) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            uint64_t id = next_id++;
+            Connection& connection = connections[id];
+            connection.fd = fd;
+            connection.sent = 0;
+            connection.busy = false;
+            connection.peer_closed = false;
+            connection.events = EPOLLIN;
+            Watch(fd, id, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    // false nếu kết nối hỏng
+    bool Receive(Connection& connection) {
+        char chunk[SERVER_READ_CHUNK];
+        while (connection.input.size() < SERVER_BUFFER_LIMIT) {
+            ssize_t n = recv(connection.fd, chunk, sizeof(chunk), 0);
+            if (n > 0) {
+                connection.input.append(chunk, n);
+                if ((size_t)n < sizeof(chunk)) return true;
+            }
+            else if (n == 0) {
+                connection.peer_closed = true;
+                return true;
+            }
+            else if (errno == EINTR) continue;
+            else return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        return true;
+    }
+
+    bool Send(Connection& connection) {
+        while (connection.sent < connection.output.size()) {
+            ssize_t n = send(connection.fd, connection.output.data() + connection.sent,
+                connection.output.size() - connection.sent, MSG_NOSIGNAL);
+            if (n > 0) connection.sent += n;
+            else if (n < 0 && errno == EINTR) continue;
+            else return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        connection.output.clear();
+        connection.sent = 0;
+        return true;
+    }
+
+    // Chuyển mọi khung đã đủ thành một lô nếu kết nối đang rảnh; false nếu gặp khung quá lớn
+    bool Dispatch(uint64_t id, Connection& connection) {
+        if (connection.busy) return true;
+        size_t end = 0;
+        while (connection.input.size() - end >= 4) {
+            ByteReader header(connection.input.data() + end, 4);
+            uint32_t size = header.U32();
+            if (size > SERVER_MAX_FRAME) return false;
+            if (connection.input.size() - end - 4 < size) break;
+            end += 4 + size;
+        }
+        if (end == 0) return true;
+        Task task;
+        task.id = id;
+        task.failed = false;
+        if (end == connection.input.size()) swap(task.frames, connection.input);
+        else {
+            task.frames.assign(connection.input, 0, end);
+            connection.input.erase(0, end);
+        }
+        connection.busy = true;
+        {
+            lock_guard<mutex> guard(lock);
+            tasks.push_back(move(task));
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    // Đăng ký lại sự kiện theo trạng thái bộ đệm, hoặc đóng kết nối đã xong việc
+    void Update(uint64_t id, Connection& connection) {
+        if (!Dispatch(id, connection)) {
+            Close(id);
+            return;
+        }
+        size_t pending = connection.output.size() - connection.sent;
+        if (connection.peer_closed && !connection.busy && pending == 0) {
+            Close(id);
+            return;
+        }
+        uint32_t events = 0;
+        if (!connection.peer_closed && connection.input.size() < SERVER_BUFFER_LIMIT && pending < SERVER_BUFFER_LIMIT) {
+            events |= EPOLLIN;
+        }
+        if (pending) events |= EPOLLOUT;
+        if (events != connection.events) {
+            // Không chờ gì thì gỡ hẳn khỏi epoll, nếu không EPOLLHUP vẫn được báo liên tục
+            if (events == 0) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+            else Watch(connection.fd, id, events, connection.events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+            connection.events = events;
+        }
+    }
+
+    void Complete(Task& task) {
+        auto it = connections.find(task.id);
+        if (it == connections.end()) return;
+        Connection& connection = it->second;
+        connection.busy = false;
+        if (task.failed) {
+            Close(task.id);
+            return;
+        }
+        if (connection.output.empty()) swap(connection.output, task.replies);
+        else {
+            connection.output.erase(0, connection.sent);
+            connection.sent = 0;
+            connection.output += task.replies;
+        }
+        if (!Send(connection)) {
+            Close(task.id);
+            return;
+        }
+        Update(task.id, connection);
+    }
+
+    // Chạy handler cho từng khung của lô; trả lời dựng thẳng thành khung trong một chuỗi
+    void Execute(Task& task) {
+        ByteWriter replies;
+        bool changed = false;
+        size_t count = 0;
+        try {
+            for (size_t pos = 0; pos < task.frames.size(); count++) {
+                ByteReader header(task.frames.data() + pos, 4);
+                uint32_t size = header.U32();
+                ByteReader request(task.frames.data() + pos + 4, size);
+                pos += 4 + size;
+                size_t start = replies.bytes.size();
+                replies.U32(0);
+                if (handler(request, replies)) changed = true;
+                size_t length = replies.bytes.size() - start - 4;
+                if (length > SERVER_MAX_FRAME) throw runtime_error("Trả lời quá lớn");
+                for (int i = 0; i < 4; i++) replies.bytes[start + i] = (char)(length >> (8 * i));
+            }
+            if (changed && before_reply) before_reply();
+        }
+        catch (const exception&) {
+            // Không trả lời được đúng sự thật (vd. nhật ký hỏng) thì ngắt kết nối thay vì báo thành công
+            task.failed = true;
+        }
+        served += count;
+        task.frames.clear();
+        swap(task.replies, replies.bytes);
+    }
+
+    void Work() {
+        while (true) {
+            Task task;
+            {
+                unique_lock<mutex> guard(lock);
+                ready.wait(guard, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = move(tasks.front());
+                tasks.pop_front();
+            }
+            Execute(task);
+            {
+                lock_guard<mutex> guard(lock);
+                done.push_back(move(task));
+            }
+            Wake();
+        }
+    }
+
+    void Release() {
+        for (auto& item : connections) close(item.second.fd);
+        connections.clear();
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            if (address.is_unix) unlink(address.path.c_str());
+        }
+        if (epoll_fd >= 0) close(epoll_fd);
+        if (wake_fd >= 0) close(wake_fd);
+        listen_fd = epoll_fd = wake_fd = -1;
+    }
+
+public:
+    // Mở socket nghe ngay để lỗi địa chỉ được báo trước khi chạy; file socket Unix cũ bị thay
+    RequestServer(const string& listen_address, int threads, const RequestHandler& request_handler,
+        const function<void()>& before = nullptr)
+        : address(listen_address), thread_count(max(threads, 1)), handler(request_handler), before_reply(before),
+        listen_fd(-1), epoll_fd(-1), wake_fd(-1), stopping(false), served(0), next_id(FIRST_CONNECTION) {
+        try {
+            listen_fd = address.Open();
+            if (address.is_unix) unlink(address.path.c_str());
+            else {
+                int one = 1;
+                setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            }
+            if (::bind(listen_fd, (const sockaddr*)&address.storage, address.length) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+                throw runtime_error("Không lắng nghe được tại " + listen_address + ": " + strerror(errno));
+            }
+            fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (epoll_fd < 0 || wake_fd < 0) throw runtime_error(string("Không tạo được epoll: ") + strerror(errno));
+            Watch(listen_fd, LISTEN_ID, EPOLLIN, EPOLL_CTL_ADD);
+            Watch(wake_fd, WAKE_ID, EPOLLIN, EPOLL_CTL_ADD);
+        }
+        catch (...) {
+            Release();
+            throw;
+        }
+    }
+
+    RequestServer(const RequestServer&) = delete;
+    RequestServer& operator=(const RequestServer&) = delete;
+
+    ~RequestServer() {
+        Release();
+    }
+
+    // Chạy tới khi Stop. Các lô đã nhận vẫn được xử lý xong trước khi trả về, trả lời chưa gửi bị bỏ
+    void Run() {
+        for (int i = 0; i < thread_count; i++) workers.emplace_back(&RequestServer::Work, this);
+        epoll_event events[SERVER_EPOLL_EVENTS];
+        while (!stopping) {
+            int count = epoll_wait(epoll_fd, events, SERVER_EPOLL_EVENTS, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (int i = 0; i < count; i++) {
+                uint64_t id = events[i].data.u64;
+                if (id == LISTEN_ID) {
+                    Accept();
+                    continue;
+                }
+                if (id == WAKE_ID) {
+                    uint64_t value;
+                    ssize_t result = read(wake_fd, &value, sizeof(value));
+                    (void)result;
+                    deque<Task> finished;
+                    {
+                        lock_guard<mutex> guard(lock);
+                        swap(finished, done);
+                    }
+                    for (Task& task : finished) Complete(task);
+                    continue;
+                }
+                auto it = connections.find(id);
+                if (it == connections.end()) continue;
+                Connection& connection = it->second;
+                bool ok = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ok = Receive(connection);
+                if (ok && (events[i].events & EPOLLOUT)) ok = Send(connection);
+                if (ok) Update(id, connection);
+                else Close(id);
+            }
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (thread& worker : workers) worker.join();
+        workers.clear();
+        done.clear();
+        // eventfd còn mở tới khi hủy để Stop gọi muộn không ghi vào fd đã đóng
+        for (auto& item : connections) close(item.second.fd);
+        connections.clear();
+    }
+
+    // An toàn khi gọi từ trình xử lý tín hiệu
+    void Stop() {
+        stopping = true;
+        Wake();
+    }
+
+    uint64_t Served() const {
+        return served;
+    }
+};
+
+// Kết nối chặn tới RequestServer, dùng cho khách đo tải: gửi nhiều khung một lần rồi nhận trả lời theo
+// đúng thứ tự đã gửi
+class RequestClient {
+private:
+    int fd;
+    string input;
+    size_t begin; // đầu khung chưa nhận trong input
+    string current; // nội dung khung vừa nhận
+
+    bool HasFrame() const {
+        if (input.size() - begin < 4) return false;
+        ByteReader header(input.data() + begin, 4);
+        return input.size() - begin - 4 >= header.U32();
+    }
+
+public:
+    explicit RequestClient(const string& server_address) : fd(-1), begin(0) {
+        SocketAddress address(server_address);
+        fd = address.Open();
+        if (connect(fd, (const sockaddr*)&address.storage, address.length) != 0) {
+            string error = strerror(errno);
+            close(fd);
+            throw runtime_error("Không kết nối được tới " + server_address + ": " + error);
+        }
+    }
+
+    RequestClient(const RequestClient&) = delete;
+    RequestClient& operator=(const RequestClient&) = delete;
+
+    ~RequestClient() {
+        close(fd);
+    }
+
+    // frames gồm một hoặc nhiều khung đã nối bằng AppendFrame
+    void Send(const string& frames) {
+        for (size_t sent = 0; sent < frames.size();) {
+            ssize_t n = send(fd, frames.data() + sent, frames.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw runtime_error(string("Không gửi được yêu cầu: ") + strerror(errno));
+            sent += n;
+        }
+    }
+
+    // Đã có sẵn một trả lời đầy đủ, Receive sẽ không phải chờ
+    bool Buffered() const {
+        return HasFrame();
+    }
+
+    // Chờ trả lời kế tiếp; ByteReader trỏ vào bộ đệm nên chỉ hợp lệ tới lần Receive sau
+    ByteReader Receive() {
+        while (!HasFrame()) {
+            if (begin) {
+                input.erase(0, begin);
+                begin = 0;
+            }
+            char chunk[SERVER_READ_CHUNK];
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw runtime_error("Máy chủ đã đóng kết nối");
+            input.append(chunk, n);
+        }
+        ByteReader header(input.data() + begin, 4);
+        uint32_t size = header.U32();
+        current.assign(input, begin + 4, size);
+        begin += 4 + size;
+        return ByteReader(current.data(), current.size());
+    }
+};
+
+#endif
+
+#endif
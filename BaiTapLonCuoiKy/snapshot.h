@@ -0,0 +1,362 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "appointment_structures.h"
+#include "write_ahead_log.h"
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#define SNAPSHOT_MAGIC "LHANHCHP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 64
+
+// Bản ghi kích thước cố định trong ảnh chụp. Các ID là chỉ số trong bảng chuỗi của ảnh:
+// nạp bảng chuỗi theo thứ tự vào IdTable rỗng thì chỉ số trùng với ID nội bộ.
+struct SnapshotRecord {
+    int64_t time;
+    uint32_t appointment_id;
+    uint32_t patient_id;
+    uint32_t doctor_id;
+    uint16_t duration;
+    uint8_t status;
+    uint8_t is_valid;
+};
+
+static_assert(sizeof(SnapshotRecord) == 24, "SnapshotRecord phải đúng 24 byte");
+
+// Trạng thái được chép ra ở luồng chính, phần còn lại của việc ghi ảnh chụp không đụng tới hệ thống
+struct SnapshotData {
+    vector<Appointment> records; // mọi lịch hẹn còn giữ, kể cả lịch hẹn bị từ chối chưa thu hồi
+    vector<string> appointment_names; // theo ID nội bộ
+    vector<string> patient_names;
+    vector<string> doctor_names;
+    uint64_t wal_lsn; // ảnh chụp chứa đúng các thao tác có LSN < wal_lsn
+    SnapshotData() : wal_lsn(0) {}
+};
+
+// Định dạng tệp (little-endian):
+//   phần đầu 64 byte: magic, phiên bản, kích thước bản ghi, số bản ghi, số chuỗi của ba bảng ID,
+//     kích thước bảng chuỗi, LSN nhật ký, CRC32 của phần thân, CRC32 của 60 byte đầu
+//   phần bản ghi: record_count x SnapshotRecord, sắp theo (time, appointment_id)
+//   bảng chuỗi: ID lịch hẹn, rồi ID bệnh nhân, rồi ID bác sĩ; mỗi chuỗi là [độ dài 2 byte][nội dung]
+// Phần bản ghi là ảnh nhị phân của SnapshotRecord nên đọc thẳng từ vùng nhớ ánh xạ, không giải mã.
+inline void WriteSnapshot(const string& path, SnapshotData& data) {
+    vector<Appointment>& records = data.records;
+    sort(records.begin(), records.end(), [](const Appointment& a, const Appointment& b) {
+        return a.time < b.time || (a.time == b.time && a.appointment_id < b.appointment_id);
+    });
+
+    // Đánh lại ID theo thứ tự xuất hiện: bỏ ID đã trả lại và ID không còn lịch hẹn nào tham chiếu
+    vector<uint32_t> patient_map(data.patient_names.size(), UINT32_MAX);
+    vector<uint32_t> doctor_map(data.doctor_names.size(), UINT32_MAX);
+    ByteWriter appointment_pool, patient_pool, doctor_pool;
+    uint32_t patient_count = 0;
+    uint32_t doctor_count = 0;
+    string body(records.size() * sizeof(SnapshotRecord), '\0');
+    for (size_t i = 0; i < records.size(); i++) {
+        const Appointment& app = records[i];
+        if (patient_map[app.patient_id] == UINT32_MAX) {
+            patient_map[app.patient_id] = patient_count++;
+            patient_pool.Str(data.patient_names[app.patient_id]);
+        }
+        if (doctor_map[app.doctor_id] == UINT32_MAX) {
+            doctor_map[app.doctor_id] = doctor_count++;
+            doctor_pool.Str(data.doctor_names[app.doctor_id]);
+        }
+        appointment_pool.Str(data.appointment_names[app.appointment_id]);
+        SnapshotRecord record;
+        record.time = (int64_t)app.time;
+        record.appointment_id = (uint32_t)i;
+        record.patient_id = patient_map[app.patient_id];
+        record.doctor_id = doctor_map[app.doctor_id];
+        record.duration = app.duration;
+        record.status = (uint8_t)app.status;
+        record.is_valid = app.is_valid;
+        memcpy(&body[i * sizeof(SnapshotRecord)], &record, sizeof(record));
+    }
+    body += appointment_pool.bytes;
+    body += patient_pool.bytes;
+    body += doctor_pool.bytes;
+    size_t pool_size = body.size() - records.size() * sizeof(SnapshotRecord);
+
+    ByteWriter header;
+    header.bytes = SNAPSHOT_MAGIC;
+    header.U32(SNAPSHOT_VERSION);
+    header.U32((uint32_t)sizeof(SnapshotRecord));
+    header.I64((int64_t)records.size());
+    header.U32((uint32_t)records.size());
+    header.U32(patient_count);
+    header.U32(doctor_count);
+    header.U32(0); // dự trữ
+    header.I64((int64_t)pool_size);
+    header.I64((int64_t)data.wal_lsn);
+    header.U32(Crc32(body.data(), body.size()));
+    header.U32(Crc32(header.bytes.data(), header.bytes.size()));
+
+    // Ghi ra tệp tạm rồi đổi tên: sập giữa chừng thì ảnh chụp cũ vẫn nguyên vẹn
+    string temp_path = path + ".tmp";
+    LogFile file;
+    file.Open(temp_path);
+    try {
+        file.Truncate(0);
+        file.Write(header.bytes);
+        file.Write(body);
+        file.Sync();
+    }
+    catch (...) {
+        file.Close();
+        throw;
+    }
+    file.Close();
+    AtomicRename(temp_path, path);
+}
+
+// Ánh xạ cả tệp vào bộ nhớ chỉ để đọc
+struct MappedFile {
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    MappedFile() : data(nullptr), size(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        fd = -1;
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Trả về false nếu tệp chưa tồn tại
+    bool Open(const string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            if (GetLastError() == ERROR_FILE_NOT_FOUND) return false;
+            throw runtime_error("Không mở được tệp: " + path);
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size)) throw runtime_error("Không đọc được kích thước tệp: " + path);
+        size = (size_t)file_size.QuadPart;
+        if (size == 0) return true;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) throw runtime_error("Không ánh xạ được tệp: " + path);
+        data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data) throw runtime_error("Không ánh xạ được tệp: " + path);
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            if (errno == ENOENT) return false;
+            throw runtime_error("Không mở được tệp: " + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) throw runtime_error("Không đọc được kích thước tệp: " + path);
+        size = (size_t)info.st_size;
+        if (size == 0) return true;
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) throw runtime_error("Không ánh xạ được tệp: " + path);
+        data = (const char*)view;
+        madvise(view, size, MADV_SEQUENTIAL);
+#endif
+        return true;
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void*)data, size);
+        if (fd >= 0) close(fd);
+#endif
+    }
+};
+
+// Ảnh chụp đã ánh xạ và đã kiểm tra phần đầu, kích thước và CRC
+class SnapshotFile {
+private:
+    MappedFile file;
+    size_t record_count;
+    uint32_t name_counts[3];
+    uint64_t wal_lsn;
+    const SnapshotRecord* records;
+    const char* pool;
+    size_t pool_size;
+
+    static void Corrupt(const string& reason) {
+        throw runtime_error("Ảnh chụp bị hỏng: " + reason);
+    }
+
+public:
+    enum NameTable { kLichHen, kBenhNhan, kBacSi };
+
+    SnapshotFile() : record_count(0), wal_lsn(0), records(nullptr), pool(nullptr), pool_size(0) {
+        name_counts[0] = name_counts[1] = name_counts[2] = 0;
+    }
+
+    // Trả về false nếu chưa có ảnh chụp
+    bool Open(const string& path) {
+        if (!file.Open(path)) return false;
+        if (file.size < SNAPSHOT_HEADER_SIZE || memcmp(file.data, SNAPSHOT_MAGIC, 8) != 0) Corrupt("sai định dạng");
+        ByteReader header(file.data + 8, SNAPSHOT_HEADER_SIZE - 8);
+        uint32_t version = header.U32();
+        uint32_t record_size = header.U32();
+        uint64_t count = (uint64_t)header.I64();
+        for (int i = 0; i < 3; i++) name_counts[i] = header.U32();
+        header.U32();
+        uint64_t pool_bytes = (uint64_t)header.I64();
+        wal_lsn = (uint64_t)header.I64();
+        uint32_t body_crc = header.U32();
+        uint32_t header_crc = header.U32();
+        if (Crc32(file.data, SNAPSHOT_HEADER_SIZE - 4) != header_crc) Corrupt("sai CRC phần đầu");
+        if (version != SNAPSHOT_VERSION) Corrupt("phiên bản " + to_string(version) + " không được hỗ trợ");
+        if (record_size != sizeof(SnapshotRecord)) Corrupt("kích thước bản ghi không khớp");
+        if (count != name_counts[kLichHen] || count > (file.size - SNAPSHOT_HEADER_SIZE) / sizeof(SnapshotRecord)
+            || pool_bytes > file.size
+            || SNAPSHOT_HEADER_SIZE + count * sizeof(SnapshotRecord) + pool_bytes != file.size) {
+            Corrupt("kích thước tệp không khớp");
+        }
+        const char* body = file.data + SNAPSHOT_HEADER_SIZE;
+        if (Crc32(body, file.size - SNAPSHOT_HEADER_SIZE) != body_crc) Corrupt("sai CRC phần thân");
+        record_count = (size_t)count;
+        records = reinterpret_cast<const SnapshotRecord*>(body);
+        pool = body + record_count * sizeof(SnapshotRecord);
+        pool_size = (size_t)pool_bytes;
+        return true;
+    }
+
+    size_t RecordCount() const { return record_count; }
+    uint32_t NameCount(NameTable table) const { return name_counts[table]; }
+    uint64_t WalLsn() const { return wal_lsn; }
+
+    // Bản ghi thứ i, đã kiểm tra các chỉ số ID và giá trị trạng thái
+    const SnapshotRecord& Record(size_t i) const {
+        const SnapshotRecord& record = records[i];
+        if (record.appointment_id != i || record.patient_id >= name_counts[kBenhNhan]
+            || record.doctor_id >= name_counts[kBacSi] || record.status > (uint8_t)TrangThai::BiTuChoi
+            || record.is_valid > 1 || record.duration == 0 || (i && record.time < records[i - 1].time)) {
+            Corrupt("bản ghi " + to_string(i) + " không hợp lệ");
+        }
+        return record;
+    }
+
+    // Gọi visit(bảng, chuỗi) cho từng chuỗi theo đúng thứ tự chỉ số của ba bảng
+    template <typename TVisitor>
+    void ForEachName(TVisitor visit) const {
+        size_t pos = 0;
+        string name;
+        for (int table = kLichHen; table <= kBacSi; table++) {
+            for (uint32_t i = 0; i < name_counts[table]; i++) {
+                if (pool_size - pos < 2) Corrupt("bảng chuỗi ID bị cắt cụt");
+                size_t size = (unsigned char)pool[pos] | (size_t)(unsigned char)pool[pos + 1] << 8;
+                pos += 2;
+                if (pool_size - pos < size) Corrupt("bảng chuỗi ID bị cắt cụt");
+                name.assign(pool + pos, size);
+                pos += size;
+                visit((NameTable)table, name);
+            }
+        }
+        if (pos != pool_size) Corrupt("bảng chuỗi ID thừa dữ liệu");
+    }
+};
+
+// Ghi ảnh chụp ở luồng nền để hệ thống vẫn phục vụ: luồng chính chỉ chép bản ghi và bảng ID
+// (AppointmentSystem::ChupAnh), còn sắp xếp, mã hóa, fsync và cắt nhật ký chạy ở đây.
+class SnapshotWriter {
+private:
+    string path;
+    WriteAheadLog* wal; // có thể null
+    thread worker;
+    mutex lock;
+    bool busy;
+    string error;
+    uint64_t started_lsn; // LSN của ảnh chụp gần nhất đã bắt đầu ghi
+
+    void Run(SnapshotData data) {
+        string failure;
+        try {
+            WriteSnapshot(path, data);
+            if (wal) wal->DropPrefix(data.wal_lsn);
+        }
+        catch (const exception& e) {
+            failure = e.what();
+        }
+        lock_guard<mutex> guard(lock);
+        if (!failure.empty()) error = failure;
+        busy = false;
+    }
+
+public:
+    SnapshotWriter(const string& file_path, WriteAheadLog* log, uint64_t loaded_lsn)
+        : path(file_path), wal(log), busy(false), started_lsn(loaded_lsn) {}
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Trả về false nếu ảnh chụp trước chưa ghi xong
+    bool Start(SnapshotData&& data) {
+        {
+            lock_guard<mutex> guard(lock);
+            if (busy) return false;
+            busy = true;
+        }
+        if (worker.joinable()) worker.join();
+        uint64_t lsn = data.wal_lsn;
+        try {
+            worker = thread(&SnapshotWriter::Run, this, move(data));
+        }
+        catch (...) {
+            // Không tạo được luồng thì lần sau thử lại từ đầu
+            lock_guard<mutex> guard(lock);
+            busy = false;
+            throw;
+        }
+        started_lsn = lsn;
+        return true;
+    }
+
+    bool Busy() {
+        lock_guard<mutex> guard(lock);
+        return busy;
+    }
+
+    uint64_t StartedLsn() const {
+        return started_lsn;
+    }
+
+    // Lỗi của lần ghi gần nhất (rỗng nếu không có), chỉ báo một lần
+    string TakeError() {
+        lock_guard<mutex> guard(lock);
+        string result;
+        result.swap(error);
+        return result;
+    }
+
+    void Wait() {
+        if (worker.joinable()) worker.join();
+    }
+
+    ~SnapshotWriter() {
+        Wait();
+    }
+};
+
+#endif
@@ -0,0 +1,352 @@
+// Bộ đo vi mô cho các cấu trúc trong appointment_structures.h, tách khỏi chương trình chính (không cần
+// windows.h). Biên dịch và chạy trên Linux:
+//   g++ -std=c++14 -O2 -DNDEBUG structure_benchmark.cpp -o structure_benchmark
+//   ./structure_benchmark [--toi-da <mũ>] [--cau-truc <tên>] > ket_qua.json
+// --toi-da     kích thước lớn nhất là 10^mũ (mặc định 7, tức 10^2 .. 10^7)
+// --cau-truc   chỉ đo một cấu trúc: HashmapId, HashmapString, AVLTree, BPlusTree, PriorityQueue
+//
+// Mỗi cấu trúc được nạp n lịch hẹn theo thứ tự đến với ba phân bố:
+//   uniform    thời gian rải đều trên một năm (ô 30 phút), bác sĩ đều trên 1000 người
+//   clustered  mọi lịch hẹn cùng một ngày, nhiều lịch hẹn trùng thời điểm
+//   skewed     bác sĩ theo phân bố Zipf (một bác sĩ rất đông), lịch mỗi bác sĩ là các ô liên tiếp;
+//              truy vấn cũng rơi vào bác sĩ theo Zipf nên tập nóng nhỏ
+// rồi đo insert, find, range_scan (tối đa SCAN_ROWS dòng từ một thời điểm), remove và pop tùy cấu
+// trúc. ops_per_sec đo trên cả khối thao tác; latency_ns đo riêng từng thao tác trên một mẫu (phần
+// cuối của insert, phần đầu của remove/pop để kích thước khi đo gần n), có lẫn chi phí đọc đồng hồ
+// ghi ở clock_overhead_ns. Kết quả là một tài liệu JSON trên stdout, tiến độ in ra stderr.
+
+#include "appointment_structures.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+// Số thao tác được đo độ trễ riêng lẻ của mỗi phép đo
+#define LATENCY_SAMPLES 10000
+// Số lần find/range_scan của mỗi phép đo
+#define QUERY_COUNT 200000
+#define SCAN_ROWS 100
+#define DOCTOR_COUNT 1000
+#define ZIPF_EXPONENT 1.1
+
+typedef chrono::steady_clock Clock;
+
+volatile uint64_t sink; // giữ kết quả để trình biên dịch không bỏ vòng đo
+
+struct Dataset {
+    const char* name;
+    AppointmentSlab records;
+    vector<AppointmentHandle> handles; // theo thứ tự đến, handles[i] là lịch hẹn ID i
+    vector<string> names; // ID dạng chuỗi, chỉ dựng khi đo bảng băm khóa chuỗi
+    vector<uint32_t> queries; // lịch hẹn được find/range_scan hỏi tới, theo phân bố
+    vector<uint32_t> removals; // hoán vị ngẫu nhiên: thứ tự remove
+};
+
+// Bảng phân phối tích lũy Zipf trên DOCTOR_COUNT bác sĩ
+class ZipfDoctor {
+private:
+    vector<double> cdf;
+
+public:
+    ZipfDoctor() : cdf(DOCTOR_COUNT) {
+        double total = 0;
+        for (int k = 0; k < DOCTOR_COUNT; k++) {
+            total += 1.0 / pow(k + 1, ZIPF_EXPONENT);
+            cdf[k] = total;
+        }
+        for (double& value : cdf) value /= total;
+    }
+
+    template <typename TRng>
+    uint32_t operator()(TRng& rng) const {
+        double u = uniform_real_distribution<double>(0, 1)(rng);
+        return (uint32_t)min<size_t>(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin(), DOCTOR_COUNT - 1);
+    }
+};
+
+void BuildDataset(Dataset& data, const char* distribution, size_t n, bool with_names) {
+    const time_t base = 1924992000; // 01-01-2031 00:00 theo quy ước lưu trữ, chỉ cần cố định
+    const time_t slot = 1800;
+    mt19937_64 rng(n * 31 + strlen(distribution));
+    ZipfDoctor zipf;
+    bool skewed = strcmp(distribution, "skewed") == 0;
+    bool clustered = strcmp(distribution, "clustered") == 0;
+    vector<uint32_t> per_doctor(DOCTOR_COUNT, 0);
+    vector<vector<uint32_t>> by_doctor(skewed ? DOCTOR_COUNT : 0);
+
+    data.name = distribution;
+    data.records.Reserve(n);
+    data.handles.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t doctor = skewed ? zipf(rng) : (uint32_t)(rng() % DOCTOR_COUNT);
+        time_t time;
+        if (skewed) time = base + (time_t)per_doctor[doctor]++ * slot;
+        else if (clustered) time = base + (time_t)(rng() % SLOTS_PER_DAY) * slot;
+        else time = base + (time_t)(rng() % (365 * SLOTS_PER_DAY)) * slot;
+        // Mỗi lịch hẹn một bệnh nhân: chỉ mục thời gian từ chối hai lịch hẹn cùng giờ, cùng bệnh nhân và bác sĩ
+        data.handles.push_back(data.records.Allocate(Appointment((uint32_t)i, (uint32_t)i, doctor, time, TrangThai::DangCho)));
+        if (skewed) by_doctor[doctor].push_back((uint32_t)i);
+    }
+    if (with_names) {
+        data.names.reserve(n);
+        for (size_t i = 0; i < n; i++) data.names.push_back("A" + to_string(i));
+    }
+    data.queries.resize(QUERY_COUNT);
+    for (uint32_t& query : data.queries) {
+        if (!skewed) {
+            query = (uint32_t)(rng() % n);
+            continue;
+        }
+        const vector<uint32_t>* list;
+        do {
+            list = &by_doctor[zipf(rng)];
+        } while (list->empty());
+        query = (*list)[rng() % list->size()];
+    }
+    data.removals.resize(n);
+    for (size_t i = 0; i < n; i++) data.removals[i] = (uint32_t)i;
+    shuffle(data.removals.begin(), data.removals.end(), rng);
+}
+
+struct Result {
+    string structure;
+    string distribution;
+    size_t size;
+    string op;
+    size_t ops; // số thao tác của khối đo thông lượng
+    double seconds;
+    vector<double> latencies; // ns, đã sắp
+};
+
+double ClockOverhead() {
+    const int rounds = 1000000;
+    Clock::time_point last = Clock::now();
+    Clock::time_point start = last;
+    for (int i = 0; i < rounds; i++) last = Clock::now();
+    return chrono::duration<double, nano>(last - start).count() / rounds;
+}
+
+// Chạy op(k) với k trong [0, count): sample thao tác đầu (hoặc cuối nếu !sample_first) đo từng cái,
+// phần còn lại đo cả khối để tính thông lượng
+template <typename TOp>
+Result Measure(const char* structure, const Dataset& data, const char* name, size_t count, bool sample_first, TOp op) {
+    Result result;
+    result.structure = structure;
+    result.distribution = data.name;
+    result.size = data.handles.size();
+    result.op = name;
+    size_t sample = min<size_t>(LATENCY_SAMPLES, count / 2);
+    size_t block_first = sample_first ? sample : 0;
+    size_t block_last = sample_first ? count : count - sample;
+    auto timed = [&](size_t first, size_t last) {
+        result.latencies.reserve(last - first);
+        for (size_t k = first; k < last; k++) {
+            Clock::time_point started = Clock::now();
+            op(k);
+            result.latencies.push_back(chrono::duration<double, nano>(Clock::now() - started).count());
+        }
+    };
+    if (sample_first) timed(0, sample);
+    Clock::time_point started = Clock::now();
+    for (size_t k = block_first; k < block_last; k++) op(k);
+    result.seconds = chrono::duration<double>(Clock::now() - started).count();
+    result.ops = block_last - block_first;
+    if (!sample_first) timed(count - sample, count);
+    sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+// Thao tác trên từng cấu trúc. Mỗi bộ chuyển đổi giữ một cấu trúc rỗng cho kích thước đang đo.
+struct HashmapIdBench {
+    static const char* Name() { return "HashmapId"; }
+    Hashmap<AppointmentHandle, uint32_t> map;
+    const Dataset& data;
+    explicit HashmapIdBench(const Dataset& d) : data(d) {}
+
+    void Insert(size_t i) { map.Insert((uint32_t)i, data.handles[i]); }
+    uint64_t Find(uint32_t i) { return map.Find(i)->index; }
+    void Remove(uint32_t i) { map.Remove(i); }
+    size_t Size() { return map.Size(); }
+};
+
+// Như IdTable: chuỗi ID chỉ được băm ở biên hệ thống
+struct HashmapStringBench {
+    static const char* Name() { return "HashmapString"; }
+    Hashmap<uint32_t> map;
+    const Dataset& data;
+    explicit HashmapStringBench(const Dataset& d) : data(d) {}
+
+    void Insert(size_t i) { map.Insert(data.names[i], (uint32_t)i); }
+    uint64_t Find(uint32_t i) { return *map.Find(data.names[i]); }
+    void Remove(uint32_t i) { map.Remove(data.names[i]); }
+    size_t Size() { return map.Size(); }
+};
+
+template <typename TIndex>
+struct TimeIndexBench {
+    static const char* Name();
+    TIndex index;
+    const Dataset& data;
+    explicit TimeIndexBench(const Dataset& d) : index(d.records), data(d) {}
+
+    const Appointment& Record(uint32_t i) { return *data.records.Get(data.handles[i]); }
+    void Insert(size_t i) { index.Insert(data.handles[i]); }
+    // Lịch hẹn đầu tiên tại thời điểm của lịch hẹn i
+    uint64_t Find(uint32_t i) {
+        time_t time = Record(i).time;
+        return (*index.Range(time, time).begin()).index;
+    }
+    uint64_t Scan(uint32_t i) {
+        uint64_t total = 0;
+        int rows = 0;
+        for (AppointmentHandle handle : index.Range(Record(i).time, numeric_limits<time_t>::max())) {
+            total += handle.index;
+            if (++rows == SCAN_ROWS) break;
+        }
+        return total;
+    }
+    void Remove(uint32_t i) { index.Remove(Record(i).time, i); }
+    size_t Size() { return index.Size(); }
+};
+
+template <> const char* TimeIndexBench<AVLTree<>>::Name() { return "AVLTree"; }
+template <> const char* TimeIndexBench<BPlusTree<>>::Name() { return "BPlusTree"; }
+
+struct PriorityQueueBench {
+    static const char* Name() { return "PriorityQueue"; }
+    PriorityQueue queue;
+    const Dataset& data;
+    explicit PriorityQueueBench(const Dataset& d) : queue(d.records, (int)d.handles.size()), data(d) {}
+
+    void Insert(size_t i) { queue.Push(data.handles[i]); }
+    uint64_t Find(uint32_t i) { return queue.Contains(data.handles[i]); }
+    void Remove(uint32_t i) { queue.Remove(data.handles[i]); }
+    uint64_t Pop() { return queue.Pop().index; }
+    size_t Size() { return queue.Size(); }
+};
+
+// Chỉ cây chỉ mục thời gian có range_scan
+template <typename TBench>
+void MeasureScan(TBench&, const Dataset&, vector<Result>&) {}
+
+template <typename TIndex>
+void MeasureScan(TimeIndexBench<TIndex>& bench, const Dataset& data, vector<Result>& results) {
+    results.push_back(Measure(bench.Name(), data, "range_scan", data.queries.size() / 10, true,
+        [&](size_t k) { sink += bench.Scan(data.queries[k]); }));
+}
+
+// Xóa hết theo thứ tự ngẫu nhiên. Hàng đợi xóa một nửa như vậy rồi pop nửa còn lại.
+template <typename TBench>
+void MeasureDrain(TBench& bench, const Dataset& data, vector<Result>& results) {
+    results.push_back(Measure(bench.Name(), data, "remove", data.handles.size(), true,
+        [&](size_t k) { bench.Remove(data.removals[k]); }));
+}
+
+void MeasureDrain(PriorityQueueBench& bench, const Dataset& data, vector<Result>& results) {
+    size_t n = data.handles.size();
+    results.push_back(Measure(bench.Name(), data, "remove", n / 2, true, [&](size_t k) { bench.Remove(data.removals[k]); }));
+    results.push_back(Measure(bench.Name(), data, "pop", n - n / 2, true, [&](size_t) { sink += bench.Pop(); }));
+}
+
+template <typename TBench>
+void MeasureStructure(const Dataset& data, vector<Result>& results) {
+    size_t n = data.handles.size();
+    unique_ptr<TBench> bench(new TBench(data));
+    results.push_back(Measure(TBench::Name(), data, "insert", n, false, [&](size_t i) { bench->Insert(i); }));
+    if (bench->Size() != n) throw runtime_error(string(TBench::Name()) + " thiếu phần tử sau khi insert");
+    results.push_back(Measure(TBench::Name(), data, "find", data.queries.size(), true,
+        [&](size_t k) { sink += bench->Find(data.queries[k]); }));
+    MeasureScan(*bench, data, results);
+    MeasureDrain(*bench, data, results);
+    if (bench->Size() != 0) throw runtime_error(string(TBench::Name()) + " chưa rỗng sau khi xóa hết");
+}
+
+double Percentile(const vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    return sorted[min(sorted.size() - 1, (size_t)(q * sorted.size()))];
+}
+
+void WriteJson(ostream& out, const vector<Result>& results, double clock_overhead) {
+    out << fixed << setprecision(1);
+    out << "{\n  \"benchmark\": \"structure_benchmark\",\n";
+#ifdef __VERSION__
+    out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+    out << "  \"clock_overhead_ns\": " << clock_overhead << ",\n";
+    out << "  \"latency_samples\": " << LATENCY_SAMPLES << ",\n";
+    out << "  \"scan_rows\": " << SCAN_ROWS << ",\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double ns_per_op = r.ops ? r.seconds * 1e9 / r.ops : 0;
+        out << (i ? ",\n" : "\n") << "    {\"structure\": \"" << r.structure << "\", \"distribution\": \"" << r.distribution
+            << "\", \"size\": " << r.size << ", \"op\": \"" << r.op << "\", \"ops\": " << r.ops
+            << ", \"ops_per_sec\": " << (r.seconds > 0 ? r.ops / r.seconds : 0) << ", \"ns_per_op\": " << ns_per_op
+            << ", \"latency_ns\": {\"samples\": " << r.latencies.size() << ", \"p50\": " << Percentile(r.latencies, 0.5)
+            << ", \"p90\": " << Percentile(r.latencies, 0.9) << ", \"p99\": " << Percentile(r.latencies, 0.99)
+            << ", \"p999\": " << Percentile(r.latencies, 0.999) << ", \"max\": "
+            << (r.latencies.empty() ? 0 : r.latencies.back()) << "}}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    int max_exponent = 7;
+    string only;
+    const char* structures[] = { "HashmapId", "HashmapString", "AVLTree", "BPlusTree", "PriorityQueue" };
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--toi-da" && i + 1 < argc) {
+                string value = argv[++i];
+                if (value.size() != 1 || value[0] < '2' || value[0] > '9') throw runtime_error("Số mũ phải từ 2 tới 9: " + value);
+                max_exponent = value[0] - '0';
+            }
+            else if (arg == "--cau-truc" && i + 1 < argc) {
+                only = argv[++i];
+                if (find(begin(structures), end(structures), only) == end(structures)) {
+                    throw runtime_error("Cấu trúc không hợp lệ: " + only);
+                }
+            }
+            else throw runtime_error("Tham số không hợp lệ: " + arg);
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Lỗi: " << e.what() << endl;
+        return 1;
+    }
+    auto wanted = [&only](const char* name) { return only.empty() || only == name; };
+
+    double clock_overhead = ClockOverhead();
+    vector<Result> results;
+    const char* distributions[] = { "uniform", "clustered", "skewed" };
+    try {
+        size_t n = 10;
+        for (int exponent = 2; exponent <= max_exponent; exponent++) {
+            n *= 10;
+            for (const char* distribution : distributions) {
+                auto started = Clock::now();
+                Dataset data;
+                BuildDataset(data, distribution, n, wanted("HashmapString"));
+                if (wanted("HashmapId")) MeasureStructure<HashmapIdBench>(data, results);
+                if (wanted("HashmapString")) MeasureStructure<HashmapStringBench>(data, results);
+                if (wanted("AVLTree")) MeasureStructure<TimeIndexBench<AVLTree<>>>(data, results);
+                if (wanted("BPlusTree")) MeasureStructure<TimeIndexBench<BPlusTree<>>>(data, results);
+                if (wanted("PriorityQueue")) MeasureStructure<PriorityQueueBench>(data, results);
+                cerr << "Đã đo " << n << " lịch hẹn, phân bố " << distribution << " trong "
+                    << chrono::duration_cast<chrono::milliseconds>(Clock::now() - started).count() << " ms." << endl;
+            }
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Lỗi: " << e.what() << endl;
+        return 1;
+    }
+    WriteJson(cout, results, clock_overhead);
+    return 0;
+}
@@ -0,0 +1,553 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Các thao tác làm thay đổi dữ liệu, ghi theo đúng thứ tự đã thực hiện thành công
+enum class LogOp : uint8_t {
+    ThemLichHen = 1,
+    XoaLichHen = 2,
+    ChinhSuaLichHen = 3,
+    XacNhanLichHen = 4,
+    ThuHoiLichHen = 5 // lịch hẹn bị từ chối đã được dọn, ID có thể dùng lại
+};
+
+struct LogRecord {
+    LogOp op;
+    string appointment_id;
+    string patient_id;
+    string doctor_id; // bác sĩ mới khi chỉnh sửa, bác sĩ xác nhận khi xác nhận
+    string user_id; // người xóa
+    time_t time;
+    uint8_t status; // TrangThai
+    uint16_t duration;
+    bool flag; // is_doctor khi xóa, confirm khi xác nhận
+    LogRecord() : op(LogOp::ThemLichHen), time(0), status(0), duration(0), flag(false) {}
+};
+
+// Đánh đổi giữa độ bền và thông lượng
+enum class SyncMode {
+    PerOp, // ghi và fsync trước khi mỗi thao tác trả về
+    Group, // gom các thao tác trong một cửa sổ rồi fsync một lần, thao tác chờ tới khi bền vững
+    Async // thao tác trả về ngay, luồng nền fsync định kỳ; có thể mất cửa sổ cuối khi sập
+};
+
+// Bảng cho CRC32 kiểu slicing-by-8: entries[k][b] là CRC của byte b theo sau k byte 0,
+// nhờ đó mỗi vòng lặp xử lý 8 byte bằng 8 lần tra bảng độc lập thay vì 8 vòng nối tiếp
+struct Crc32Table {
+    uint32_t entries[8][256];
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[0][i] = c;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (uint32_t i = 0; i < 256; i++) entries[k][i] = (entries[k - 1][i] >> 8) ^ entries[0][entries[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+inline uint32_t Crc32(const char* data, size_t size) {
+    static const Crc32Table table; // khởi tạo một lần, an toàn giữa các luồng
+    const uint32_t (*t)[256] = table.entries;
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint32_t low = crc ^ (p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+            ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    for (; size; size--, p++) crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Độ dài tối đa của một chuỗi (ID) trong nhật ký, vì độ dài được ghi bằng 16 bit
+#define LOG_MAX_STRING UINT16_MAX
+
+// Mã hóa nhị phân little-endian, độ dài chuỗi 16 bit
+struct ByteWriter {
+    string bytes;
+
+    void U8(uint8_t v) { bytes.push_back((char)v); }
+    void U16(uint16_t v) { for (int i = 0; i < 2; i++) bytes.push_back((char)(v >> (8 * i))); }
+    void U32(uint32_t v) { for (int i = 0; i < 4; i++) bytes.push_back((char)(v >> (8 * i))); }
+    void I64(int64_t v) { for (int i = 0; i < 8; i++) bytes.push_back((char)((uint64_t)v >> (8 * i))); }
+    void Str(const string& s) {
+        if (s.size() > LOG_MAX_STRING) throw runtime_error("Chuỗi quá dài để ghi nhật ký");
+        U16((uint16_t)s.size());
+        bytes += s;
+    }
+};
+
+struct ByteReader {
+    const char* data;
+    size_t size;
+    size_t pos;
+
+    ByteReader(const char* d, size_t n) : data(d), size(n), pos(0) {}
+
+    void Need(size_t n) {
+        if (size - pos < n) throw runtime_error("Bản ghi nhật ký bị cắt cụt");
+    }
+    uint64_t Bytes(int n) {
+        Need(n);
+        uint64_t v = 0;
+        for (int i = 0; i < n; i++) v |= (uint64_t)(unsigned char)data[pos + i] << (8 * i);
+        pos += n;
+        return v;
+    }
+    uint8_t U8() { return (uint8_t)Bytes(1); }
+    uint16_t U16() { return (uint16_t)Bytes(2); }
+    uint32_t U32() { return (uint32_t)Bytes(4); }
+    int64_t I64() { return (int64_t)Bytes(8); }
+    string Str() {
+        size_t n = U16();
+        Need(n);
+        string s(data + pos, n);
+        pos += n;
+        return s;
+    }
+};
+
+inline string EncodeLogRecord(const LogRecord& r) {
+    ByteWriter w;
+    w.U8((uint8_t)r.op);
+    w.Str(r.appointment_id);
+    w.Str(r.patient_id);
+    w.Str(r.doctor_id);
+    w.Str(r.user_id);
+    w.I64((int64_t)r.time);
+    w.U8(r.status);
+    w.U16(r.duration);
+    w.U8(r.flag ? 1 : 0);
+    return w.bytes;
+}
+
+inline LogRecord DecodeLogRecord(const char* data, size_t size) {
+    ByteReader r(data, size);
+    LogRecord rec;
+    uint8_t op = r.U8();
+    if (op < (uint8_t)LogOp::ThemLichHen || op > (uint8_t)LogOp::ThuHoiLichHen) {
+        throw runtime_error("Loại bản ghi nhật ký không hợp lệ");
+    }
+    rec.op = (LogOp)op;
+    rec.appointment_id = r.Str();
+    rec.patient_id = r.Str();
+    rec.doctor_id = r.Str();
+    rec.user_id = r.Str();
+    rec.time = (time_t)r.I64();
+    rec.status = r.U8();
+    rec.duration = r.U16();
+    rec.flag = r.U8() != 0;
+    return rec;
+}
+
+// Khung mỗi bản ghi: [độ dài 4 byte][CRC32 của nội dung 4 byte][nội dung]
+inline string FrameLogRecord(const LogRecord& r) {
+    string payload = EncodeLogRecord(r);
+    ByteWriter w;
+    w.U32((uint32_t)payload.size());
+    w.U32(Crc32(payload.data(), payload.size()));
+    return w.bytes + payload;
+}
+
+#define WAL_MAGIC "LHNHATKY"
+#define WAL_HEADER_SIZE 20
+
+// Đầu tệp: [8 byte WAL_MAGIC][số thứ tự của bản ghi đầu tiên 8 byte][CRC32 của 16 byte trước 4 byte].
+// Số thứ tự cho biết các bản ghi trước đó đã nằm trong ảnh chụp và đã bị cắt khỏi tệp.
+inline string EncodeLogHeader(uint64_t base_lsn) {
+    ByteWriter w;
+    w.bytes = WAL_MAGIC;
+    w.I64((int64_t)base_lsn);
+    w.U32(Crc32(w.bytes.data(), w.bytes.size()));
+    return w.bytes;
+}
+
+// Bọc lời gọi hệ thống theo nền tảng
+struct LogFile {
+    int fd;
+
+    LogFile() : fd(-1) {}
+
+    void Open(const string& path) {
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+#endif
+        if (fd < 0) throw runtime_error("Không mở được tệp nhật ký: " + path);
+    }
+
+    void Write(const string& bytes) {
+        size_t done = 0;
+        while (done < bytes.size()) {
+#ifdef _WIN32
+            int n = _write(fd, bytes.data() + done, (unsigned)(bytes.size() - done));
+#else
+            ssize_t n = write(fd, bytes.data() + done, bytes.size() - done);
+#endif
+            if (n <= 0) throw runtime_error("Không ghi được nhật ký");
+            done += (size_t)n;
+        }
+    }
+
+    void Sync() {
+#ifdef _WIN32
+        int result = _commit(fd);
+#else
+        int result = fsync(fd);
+#endif
+        if (result != 0) throw runtime_error("Không đồng bộ được nhật ký xuống đĩa");
+    }
+
+    int64_t Size() {
+#ifdef _WIN32
+        int64_t size = _lseeki64(fd, 0, SEEK_END);
+#else
+        int64_t size = (int64_t)lseek(fd, 0, SEEK_END);
+#endif
+        if (size < 0) throw runtime_error("Không đọc được kích thước nhật ký");
+        return size;
+    }
+
+    void Truncate(int64_t size) {
+#ifdef _WIN32
+        int result = _chsize_s(fd, size);
+#else
+        int result = ftruncate(fd, (off_t)size);
+#endif
+        if (result != 0) throw runtime_error("Không cắt được phần hỏng của nhật ký");
+    }
+
+    void Close() {
+        if (fd < 0) return;
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+        fd = -1;
+    }
+};
+
+// Đổi tên from thành to, thay thế tệp cũ nếu có; tệp đọc được luôn là bản cũ hoặc bản mới đầy đủ
+inline void AtomicRename(const string& from, const string& to) {
+#ifdef _WIN32
+    if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        throw runtime_error("Không thay thế được tệp: " + to);
+    }
+#else
+    if (rename(from.c_str(), to.c_str()) != 0) throw runtime_error("Không thay thế được tệp: " + to);
+    // fsync thư mục chứa để việc đổi tên cũng bền vững
+    size_t slash = to.rfind('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : to.substr(0, slash));
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
+}
+
+// Nhật ký ghi trước, chỉ nối thêm. Replay đọc lại từ đầu và dừng ở bản ghi hỏng đầu tiên
+// (thường là bản ghi ghi dở khi sập), phần đuôi hỏng bị cắt để các bản ghi mới nối tiếp đúng chỗ.
+// Mỗi bản ghi có số thứ tự (LSN) tăng dần; ảnh chụp ghi lại LSN của nó để DropPrefix cắt phần đầu.
+class WriteAheadLog {
+private:
+    string path;
+    SyncMode mode;
+    int window_ms;
+    LogFile file;
+
+    mutex lock;
+    condition_variable pending_cv; // báo luồng nền có dữ liệu mới
+    condition_variable durable_cv; // báo các thao tác đang chờ fsync xong
+    thread flusher;
+    bool stopping;
+    bool flushing; // luồng nền đang ghi một lô ngoài khóa
+    string buffer;
+    uint64_t appended; // số bản ghi đã đưa vào buffer
+    uint64_t durable; // số bản ghi đã fsync
+    string error; // lỗi ghi của luồng nền, báo lại cho thao tác kế tiếp
+    uint64_t base_lsn; // LSN của bản ghi đầu tiên trong tệp
+    uint64_t next_lsn; // LSN sẽ cấp cho bản ghi kế tiếp
+
+    // Bỏ toàn bộ nội dung tệp, bắt đầu lại với bản ghi kế tiếp mang số base
+    void Restart(uint64_t base) {
+        file.Truncate(0);
+        file.Write(EncodeLogHeader(base));
+        file.Sync();
+        base_lsn = base;
+        next_lsn = base;
+    }
+
+    void Flush(unique_lock<mutex>& guard) {
+        string batch;
+        batch.swap(buffer);
+        uint64_t upto = appended;
+        flushing = true;
+        guard.unlock();
+        string failure;
+        try {
+            file.Write(batch);
+            file.Sync();
+        }
+        catch (const exception& e) {
+            failure = e.what();
+        }
+        guard.lock();
+        flushing = false;
+        if (!failure.empty()) error = failure;
+        durable = upto;
+        durable_cv.notify_all();
+    }
+
+    void Run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            if (mode == SyncMode::Async) {
+                pending_cv.wait_for(guard, chrono::milliseconds(window_ms), [this] { return stopping; });
+            }
+            else {
+                pending_cv.wait(guard, [this] { return stopping || !buffer.empty(); });
+                // Giữ cửa sổ mở để gom thêm thao tác của các luồng khác
+                if (!stopping) pending_cv.wait_for(guard, chrono::milliseconds(window_ms), [this] { return stopping; });
+            }
+            if (!buffer.empty()) Flush(guard);
+            if (stopping && buffer.empty()) return;
+        }
+    }
+
+    // Ghi và fsync ngay phần còn trong buffer ngay trên luồng gọi, giữ khóa; chờ lô đang ghi dở của
+    // luồng nền xong trước để thứ tự bản ghi trong tệp không đổi
+    void FlushNow(unique_lock<mutex>& guard) {
+        durable_cv.wait(guard, [this] { return !flushing; });
+        if (!error.empty()) throw runtime_error(error);
+        if (buffer.empty()) return;
+        try {
+            file.Write(buffer);
+            file.Sync();
+        }
+        catch (const exception& e) {
+            error = e.what(); // như Flush: phần đã ghi dở có thể còn trong tệp
+            throw;
+        }
+        buffer.clear();
+        durable = appended;
+        durable_cv.notify_all();
+    }
+
+    // count bản ghi đã đóng khung liền nhau trong frames
+    void AppendFrames(const string& frames, uint64_t count) {
+        unique_lock<mutex> guard(lock);
+        if (!error.empty()) throw runtime_error(error);
+        if (mode == SyncMode::PerOp) {
+            int64_t size = file.Size();
+            try {
+                file.Write(frames);
+                file.Sync();
+            }
+            catch (const exception&) {
+                // Khung ghi dở làm Replay dừng ở đó và bỏ mọi bản ghi sau nó, kể cả bản ghi đã báo
+                // thành công; cắt về kích thước cũ, không cắt được thì mọi lần ghi sau đều lỗi
+                try {
+                    file.Truncate(size);
+                }
+                catch (const exception& e) {
+                    error = e.what();
+                }
+                throw;
+            }
+            next_lsn += count;
+            return;
+        }
+        buffer += frames;
+        next_lsn += count;
+        appended += count;
+        uint64_t seq = appended;
+        if (mode == SyncMode::Async) return;
+        pending_cv.notify_one();
+        durable_cv.wait(guard, [this, seq] { return durable >= seq; });
+        if (!error.empty()) throw runtime_error(error);
+    }
+
+public:
+    WriteAheadLog(const string& file_path, SyncMode sync_mode, int group_window_ms = 5)
+        : path(file_path), mode(sync_mode), window_ms(max(group_window_ms, 0)), stopping(false), flushing(false),
+        appended(0), durable(0), base_lsn(0), next_lsn(0) {
+        file.Open(path);
+        if (mode != SyncMode::PerOp) flusher = thread(&WriteAheadLog::Run, this);
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Gọi một lần trước lần Append đầu tiên. Bản ghi có LSN < from_lsn đã nằm trong ảnh chụp nên
+    // được bỏ qua; trả về số bản ghi hợp lệ đã áp dụng.
+    size_t Replay(uint64_t from_lsn, const function<void(const LogRecord&)>& apply) {
+        ifstream in(path, ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (data.size() < WAL_HEADER_SIZE && string(WAL_MAGIC).compare(0, data.size(), data) == 0) {
+            // Tệp mới, hoặc phần đầu ghi dở ngay khi vừa tạo
+            Restart(from_lsn);
+            return 0;
+        }
+        size_t pos = 0;
+        base_lsn = 0; // nhật ký cũ không có phần đầu bắt đầu từ LSN 0
+        if (data.compare(0, 8, WAL_MAGIC) == 0) {
+            ByteReader header(data.data() + 8, 12);
+            base_lsn = (uint64_t)header.I64();
+            if (Crc32(data.data(), 16) != header.U32()) throw runtime_error("Phần đầu nhật ký bị hỏng: " + path);
+            pos = WAL_HEADER_SIZE;
+        }
+        if (base_lsn > from_lsn) {
+            throw runtime_error("Nhật ký bắt đầu từ thao tác " + to_string(base_lsn)
+                + " nhưng ảnh chụp chỉ tới thao tác " + to_string(from_lsn));
+        }
+        size_t count = 0;
+        uint64_t lsn = base_lsn;
+        while (data.size() - pos >= 8) {
+            ByteReader header(data.data() + pos, 8);
+            uint32_t size = header.U32();
+            uint32_t crc = header.U32();
+            if (data.size() - pos - 8 < size || Crc32(data.data() + pos + 8, size) != crc) break;
+            LogRecord record;
+            try {
+                record = DecodeLogRecord(data.data() + pos + 8, size);
+            }
+            catch (const exception&) {
+                break;
+            }
+            if (lsn++ >= from_lsn) {
+                apply(record);
+                count++;
+            }
+            pos += 8 + size;
+        }
+        if (pos < data.size()) file.Truncate((int64_t)pos);
+        next_lsn = lsn;
+        // Ảnh chụp mới hơn cả nhật ký (đuôi chưa kịp fsync khi sập): mọi bản ghi đều đã có trong ảnh,
+        // bắt đầu lại từ LSN của ảnh để các bản ghi mới không bị bỏ qua ở lần khởi động sau
+        if (next_lsn < from_lsn) Restart(from_lsn);
+        return count;
+    }
+
+    // Rào bền vững: trả về khi mọi bản ghi đã Append đều đã fsync. Ở chế độ khong-doi, gọi trước khi
+    // công bố kết quả ra ngoài thì cả lô thao tác chỉ tốn một lần fsync mà vẫn không báo thành công sớm.
+    void Sync() {
+        unique_lock<mutex> guard(lock);
+        if (!error.empty()) throw runtime_error(error);
+        if (mode != SyncMode::PerOp) FlushNow(guard);
+    }
+
+    uint64_t NextLsn() {
+        lock_guard<mutex> guard(lock);
+        return next_lsn;
+    }
+
+    // Cắt các bản ghi có LSN < upto_lsn (đã bền vững trong ảnh chụp): chép phần còn lại sang tệp tạm
+    // với phần đầu mới rồi thay thế tệp cũ. Các thao tác mới chờ trong lúc chép, nhưng phần còn lại
+    // chỉ gồm các thao tác đến sau lúc chụp nên ngắn.
+    void DropPrefix(uint64_t upto_lsn) {
+        unique_lock<mutex> guard(lock);
+        if (!error.empty()) throw runtime_error(error);
+        if (upto_lsn <= base_lsn) return;
+        if (upto_lsn > next_lsn) throw runtime_error("LSN cắt nhật ký vượt quá bản ghi cuối");
+        FlushNow(guard);
+        ifstream in(path, ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        in.close();
+        size_t pos = data.compare(0, 8, WAL_MAGIC) == 0 ? WAL_HEADER_SIZE : 0;
+        for (uint64_t lsn = base_lsn; lsn < upto_lsn; lsn++) {
+            if (data.size() - pos < 8) throw runtime_error("Nhật ký ngắn hơn số bản ghi đã ghi");
+            ByteReader header(data.data() + pos, 4);
+            pos += 8 + header.U32();
+        }
+        if (pos > data.size()) throw runtime_error("Nhật ký ngắn hơn số bản ghi đã ghi");
+
+        string temp_path = path + ".tmp";
+        LogFile temp;
+        temp.Open(temp_path);
+        try {
+            temp.Truncate(0);
+            temp.Write(EncodeLogHeader(upto_lsn));
+            temp.Write(data.substr(pos));
+            temp.Sync();
+        }
+        catch (...) {
+            temp.Close();
+            throw;
+        }
+        temp.Close();
+        file.Close(); // Windows không cho đổi tên đè lên tệp đang mở
+        try {
+            AtomicRename(temp_path, path);
+            file.Open(path);
+        }
+        catch (const exception& e) {
+            // Tệp cũ vẫn nguyên nếu đổi tên thất bại; mở lại được thì ghi tiếp như chưa có gì
+            try {
+                file.Open(path);
+            }
+            catch (const exception&) {
+                error = e.what();
+            }
+            throw;
+        }
+        base_lsn = upto_lsn;
+    }
+
+    // Trả về khi bản ghi đã bền vững theo chế độ đã chọn
+    void Append(const LogRecord& record) {
+        AppendFrames(FrameLogRecord(record), 1);
+    }
+
+    // Như Append nhưng cả lô chỉ chờ một lần ghi và một lần fsync
+    void AppendBatch(const vector<LogRecord>& records) {
+        if (records.empty()) return;
+        string frames;
+        for (const LogRecord& record : records) frames += FrameLogRecord(record);
+        AppendFrames(frames, records.size());
+    }
+
+    ~WriteAheadLog() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        pending_cv.notify_one();
+        if (flusher.joinable()) flusher.join();
+        file.Close();
+    }
+};
+
+#endif